@@ -0,0 +1,191 @@
+/**
+ *******************************************************************************
+ *
+ * @file  compressbench.c
+ *
+ * @brief Host benchmark for the tx LZSS compressor.
+ *
+ *        Compresses about 4 MB of synthetic timestamped log lines, written
+ *        one line per call as writeLine does (line without flush, then its
+ *        terminator with flush), and decodes the result. Prints the output
+ *        size as a fraction of the input and the encode and decode cost per
+ *        input byte, and fails if the round trip doesn't reproduce the input.
+ *        CPU figures are the host's; compare runs on the same machine.
+ *
+ *        make -C bench run
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Module under test.
+#include "FS_STM32F4xxUSARTCompress.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+#define COMPRESSBENCH_INPUT_BYTES 4000000
+
+// Room for the input plus the longest line generated.
+#define COMPRESSBENCH_BUFFER_BYTES ( COMPRESSBENCH_INPUT_BYTES + 256 )
+
+#define COMPRESSBENCH_ARRAY_LENGTH(a) ( sizeof(a) / sizeof( (a)[0] ) )
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+static char input[COMPRESSBENCH_BUFFER_BYTES];
+static size_t inputLength;
+
+// Worst case is 9/8 of the input plus terminators.
+static char encoded[2 * COMPRESSBENCH_BUFFER_BYTES];
+static size_t encodedLength;
+
+static char decoded[COMPRESSBENCH_BUFFER_BYTES];
+static size_t decodedLength;
+
+static char encoderWindow[FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES];
+static char decoderWindow[FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES];
+
+/*------------------------------------------------------------------------------
+--------------------- END PRIVATE GLOBAL VARIABLES -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE FUNCTIONS -------------------------------
+------------------------------------------------------------------------------*/
+
+static double nowNs(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+static void encodedSink(void * ctx, const char * bytes, uint16_t numBytes)
+{
+  (void)ctx;
+  memcpy(&( encoded[encodedLength] ), bytes, numBytes);
+  encodedLength += numBytes;
+}
+
+static void decodedSink(void * ctx, char byte)
+{
+  (void)ctx;
+
+  if(decodedLength < sizeof(decoded))
+  {
+    decoded[decodedLength] = byte;
+  }
+
+  decodedLength++;
+}
+
+// Fill the input with log lines like a firmware console's, each ending '\n'.
+static void generateInput(void)
+{
+  static const char * const modules[] = { "usart", "i2c", "sensor", "motor", "power", "app" };
+  static const char * const messages[] =
+  {
+    "state change %d -> %d",
+    "rx frame len=%d crc=%04x",
+    "temp=%d.%02dC",
+    "retry %d of %d",
+    "voltage %dmV current %dmA",
+    "heartbeat seq=%d uptime=%d"
+  };
+  unsigned timestamp = 0;
+  int n;
+
+  srand(1);
+  inputLength = 0;
+
+  while(inputLength < COMPRESSBENCH_INPUT_BYTES)
+  {
+    timestamp += (unsigned)( rand() % 50 );
+
+    n = snprintf(&( input[inputLength] ), 64, "[%10u] %-6s I: ",
+                 timestamp, modules[rand() % (int)COMPRESSBENCH_ARRAY_LENGTH(modules)]);
+    n += snprintf(&( input[inputLength + n] ), 128,
+                  messages[rand() % (int)COMPRESSBENCH_ARRAY_LENGTH(messages)],
+                  rand() % 1000, rand() % 100);
+    input[inputLength + n] = '\n';
+    inputLength += (size_t)n + 1;
+  }
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+
+int main(void)
+{
+  FS_STM32F4xxUSARTCompress_Encoder_t encoder;
+  FS_STM32F4xxUSARTCompress_Decoder_t decoder;
+  double t0, encodeNs, decodeNs;
+  const char * lineEnd;
+  size_t pos, lineLength;
+  _Bool ok;
+
+  generateInput();
+
+  FS_STM32F4xxUSARTCompress_EncoderInit(&encoder, encoderWindow);
+  encodedLength = 0;
+
+  t0 = nowNs();
+
+  for(pos = 0; pos < inputLength; pos += lineLength + 1)
+  {
+    lineEnd = memchr(&( input[pos] ), '\n', inputLength - pos);
+    lineLength = (size_t)( lineEnd - &( input[pos] ) );
+
+    FS_STM32F4xxUSARTCompress_Encode(&encoder, &( input[pos] ), (uint16_t)lineLength,
+                                     false, encodedSink, NULL);
+    FS_STM32F4xxUSARTCompress_Encode(&encoder, "\n", 1, true, encodedSink, NULL);
+  }
+
+  encodeNs = nowNs() - t0;
+
+  FS_STM32F4xxUSARTCompress_DecoderInit(&decoder, decoderWindow);
+  decodedLength = 0;
+
+  t0 = nowNs();
+  FS_STM32F4xxUSARTCompress_Decode(&decoder, encoded, (uint32_t)encodedLength, decodedSink, NULL);
+  decodeNs = nowNs() - t0;
+
+  ok = ( decodedLength == inputLength ) && ( 0 == memcmp(decoded, input, inputLength) );
+
+  printf("# LZSS, log lines written one per call\n");
+  printf("in %zu out %zu (%.1f%%)\n", inputLength, encodedLength,
+         100.0 * (double)encodedLength / (double)inputLength);
+  printf("encode %.1f ns/byte decode %.1f ns/byte\n",
+         encodeNs / (double)inputLength, decodeNs / (double)inputLength);
+  printf("round trip %s\n", ok ? "ok" : "FAILED");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+/**
+ *******************************************************************************
+ *
+ * @file  compresstest.c
+ *
+ * @brief Host round-trip test for the tx LZSS compressor and its decoder.
+ *
+ *        Encodes pseudo-random writes of several kinds - text, binary, long
+ *        runs for maximum-length and overlapping back-references, empty
+ *        writes, and lines sent as line plus flushed terminator - and checks
+ *        that:
+ *
+ *        - each flushed write decodes completely from the bytes output so
+ *          far, so nothing is held back on the wire;
+ *        - each write's output is within FS_STM32F4XXUSARTCOMPRESS_MAX_ENCODED_BYTES;
+ *        - the decoder gives the same result whether the stream arrives in
+ *          one piece or a byte at a time.
+ *
+ *        Exits non-zero on the first failure.
+ *
+ *        make -C bench test
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Module under test.
+#include "FS_STM32F4xxUSARTCompress.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+#define COMPRESSTEST_WRITES 20000
+#define COMPRESSTEST_MAX_WRITE_BYTES 1000
+#define COMPRESSTEST_STREAM_BYTES ( COMPRESSTEST_WRITES * ( COMPRESSTEST_MAX_WRITE_BYTES + 1 ) )
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PRIVATE TYPE DEFINITIONS --------------------------
+------------------------------------------------------------------------------*/
+
+typedef struct
+{
+  char * data;
+  size_t length;
+
+}Stream;
+
+/*------------------------------------------------------------------------------
+----------------------- END PRIVATE TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+static char encoderWindow[FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES];
+static char decoderWindow[FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES];
+static char byteDecoderWindow[FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES];
+
+/*------------------------------------------------------------------------------
+--------------------- END PRIVATE GLOBAL VARIABLES -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE FUNCTIONS -------------------------------
+------------------------------------------------------------------------------*/
+
+static void encodedSink(void * ctx, const char * bytes, uint16_t numBytes)
+{
+  Stream * stream = ctx;
+
+  memcpy(&( stream->data[stream->length] ), bytes, numBytes);
+  stream->length += numBytes;
+}
+
+static void decodedSink(void * ctx, char byte)
+{
+  Stream * stream = ctx;
+
+  stream->data[stream->length++] = byte;
+}
+
+// Fill buf with one write's worth of data of a randomly chosen kind.
+static uint16_t generateWrite(char * buf)
+{
+  static const char text[] = "abcdefgh ";
+  uint16_t length, i, period;
+
+  length = (uint16_t)( rand() % ( COMPRESSTEST_MAX_WRITE_BYTES + 1 ) );
+
+  switch(rand() % 5)
+  {
+    // Empty.
+    case 0:
+      return 0;
+
+    // Short text from a small alphabet, compressible.
+    case 1:
+      length %= 80;
+
+      for(i = 0; i < length; i++)
+      {
+        buf[i] = text[rand() % ( sizeof(text) - 1 )];
+      }
+
+      return length;
+
+    // Binary, mostly incompressible, including zero bytes.
+    case 2:
+      for(i = 0; i < length; i++)
+      {
+        buf[i] = (char)( rand() & 0xFF );
+      }
+
+      return length;
+
+    // Short repeating pattern: overlapping and maximum-length back-references.
+    case 3:
+      period = (uint16_t)( 1 + rand() % 4 );
+
+      for(i = 0; i < length; i++)
+      {
+        buf[i] = (char)( 'A' + ( i % period ) );
+      }
+
+      return length;
+
+    // Repeats of earlier data at random distances.
+    default:
+      for(i = 0; i < length; i++)
+      {
+        if( ( i > 8 ) && ( rand() % 4 ) )
+        {
+          buf[i] = buf[i - 1 - ( rand() % ( i < 255 ? i : 255 ) )];
+        }
+
+        else
+        {
+          buf[i] = (char)( rand() & 0xFF );
+        }
+      }
+
+      return length;
+  }
+}
+
+static _Bool fail(const char * what, unsigned write)
+{
+  printf("FAIL: %s (write %u)\n", what, write);
+  return false;
+}
+
+static _Bool runTest(void)
+{
+  FS_STM32F4xxUSARTCompress_Encoder_t encoder;
+  FS_STM32F4xxUSARTCompress_Decoder_t decoder, byteDecoder;
+  static char inputData[COMPRESSTEST_STREAM_BYTES];
+  static char encodedData[2 * COMPRESSTEST_STREAM_BYTES];
+  static char decodedData[COMPRESSTEST_STREAM_BYTES];
+  static char byteDecodedData[COMPRESSTEST_STREAM_BYTES];
+  Stream input = { inputData, 0 };
+  Stream encoded = { encodedData, 0 };
+  Stream decoded = { decodedData, 0 };
+  Stream byteDecoded = { byteDecodedData, 0 };
+  char write[COMPRESSTEST_MAX_WRITE_BYTES];
+  size_t encodedBefore, decodedUpTo, i;
+  uint16_t length;
+  unsigned w;
+
+  FS_STM32F4xxUSARTCompress_EncoderInit(&encoder, encoderWindow);
+  FS_STM32F4xxUSARTCompress_DecoderInit(&decoder, decoderWindow);
+  FS_STM32F4xxUSARTCompress_DecoderInit(&byteDecoder, byteDecoderWindow);
+
+  srand(1);
+  decodedUpTo = 0;
+
+  for(w = 0; w < COMPRESSTEST_WRITES; w++)
+  {
+    length = generateWrite(write);
+    encodedBefore = encoded.length;
+
+    memcpy(&( input.data[input.length] ), write, length);
+    input.length += length;
+
+    // Every other write as writeLine sends it, the rest as writeBytes does.
+    if(w & 1)
+    {
+      FS_STM32F4xxUSARTCompress_Encode(&encoder, write, length, false, encodedSink, &encoded);
+      FS_STM32F4xxUSARTCompress_Encode(&encoder, "\n", 1, true, encodedSink, &encoded);
+      input.data[input.length++] = '\n';
+      length++;
+    }
+
+    else
+    {
+      FS_STM32F4xxUSARTCompress_Encode(&encoder, write, length, true, encodedSink, &encoded);
+    }
+
+    if( ( encoded.length - encodedBefore ) > FS_STM32F4XXUSARTCOMPRESS_MAX_ENCODED_BYTES( (uint32_t)length ) )
+    {
+      return fail("output exceeds FS_STM32F4XXUSARTCOMPRESS_MAX_ENCODED_BYTES", w);
+    }
+
+    // Decode what has gone out so far: all of this write must be recovered.
+    FS_STM32F4xxUSARTCompress_Decode(&decoder,
+                                     &( encoded.data[decodedUpTo] ),
+                                     (uint32_t)( encoded.length - decodedUpTo ),
+                                     decodedSink,
+                                     &decoded);
+    decodedUpTo = encoded.length;
+
+    if( ( decoded.length != input.length ) || memcmp(decoded.data, input.data, input.length) )
+    {
+      return fail("flushed write not fully decodable", w);
+    }
+  }
+
+  // The same stream a byte at a time, as a receiver would see it.
+  for(i = 0; i < encoded.length; i++)
+  {
+    FS_STM32F4xxUSARTCompress_Decode(&byteDecoder, &( encoded.data[i] ), 1, decodedSink, &byteDecoded);
+  }
+
+  if( ( byteDecoded.length != input.length ) || memcmp(byteDecoded.data, input.data, input.length) )
+  {
+    return fail("byte-at-a-time decode differs", w);
+  }
+
+  printf("%u writes, %zu bytes in, %zu bytes out: ok\n", w, input.length, encoded.length);
+
+  return true;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+
+int main(void)
+{
+  return runTest() ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+/**
+ *******************************************************************************
+ *
+ * @file  pipelinetest.c
+ *
+ * @brief Host test of rx pipeline line framing through the driver.
+ *
+ *        Writes chunks into a 16-byte rx buffer, so that later ones wrap, and
+ *        runs the driver's rxPipelineRun on them with a line framer stage
+ *        (8-byte line buffer) ahead of a stage recording what it is given.
+ *        Checks the lines, whether each was passed on in place in the rx
+ *        buffer or assembled, the too-long line event (0x0100,
+ *        FS_STM32F4XXUSARTPIPELINE_EVENT_LINE_TOO_LONG) and that the pipeline
+ *        consumes everything. The driver is compiled in directly, against the
+ *        stub headers in stubs/, with FS_STM32F4XXUSART_ENABLE_RX_PIPELINE.
+ *
+ *        Exits non-zero on the first failure.
+ *
+ *        make -C bench test
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// The driver under test, statics and all.
+#include "../src/fs_stm32f4xxusart.c"
+
+// C standard library includes.
+#include <stdio.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+#define PIPELINETEST_MAX_RECORDS 16
+#define PIPELINETEST_RECORD_BYTES 32
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+// What the last stage and the event handler were given, as text.
+static char records[PIPELINETEST_MAX_RECORDS][PIPELINETEST_RECORD_BYTES];
+static unsigned numRecords;
+
+/*------------------------------------------------------------------------------
+--------------------- END PRIVATE GLOBAL VARIABLES -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE FUNCTIONS -------------------------------
+------------------------------------------------------------------------------*/
+
+static void recordLine(FS_STM32F4xxUSARTPipeline_Stage_t * stage, const char * data, uint16_t length)
+{
+  _Bool inPlace;
+
+  (void)stage;
+
+  inPlace = ( data >= masterBuffer ) && ( data < &( masterBuffer[sizeof(masterBuffer)] ) );
+
+  if(numRecords < PIPELINETEST_MAX_RECORDS)
+  {
+    snprintf(records[numRecords++], PIPELINETEST_RECORD_BYTES, "line %.*s %s",
+             (int)length, data, inPlace ? "in-place" : "assembled");
+  }
+}
+
+static void recordEvent(void * ctx, FS_STM32F4xxUSARTPipeline_Stage_t * stage,
+                        uint16_t event, const void * data, uint16_t length)
+{
+  (void)ctx;
+  (void)stage;
+  (void)data;
+
+  if(numRecords < PIPELINETEST_MAX_RECORDS)
+  {
+    snprintf(records[numRecords++], PIPELINETEST_RECORD_BYTES, "event %04x %u", event, length);
+  }
+}
+
+// Receive bytes as the service pass would, then run the pipeline.
+static void receive(USART * usart, const char * bytes)
+{
+  bufferWriteBlock( &( usart->rxBuffer ), bytes, (uint16_t)strlen(bytes) );
+  rxPipelineRun(usart);
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+
+int main(void)
+{
+  static const char * const expected[] =
+  {
+    "line ab in-place",
+    "line cd in-place",
+    "line efgh assembled",
+    "event 0100 5",
+    "line 01234567 assembled",
+    "line xy in-place"
+  };
+  FS_STM32F4xxUSARTPipeline_LineFramer_t framer;
+  FS_STM32F4xxUSARTPipeline_Stage_t stages[2];
+  FS_STM32F4xxUSARTPipeline_t pipeline;
+  char lineBuffer[8];
+  USART * usart;
+  unsigned i;
+  _Bool ok;
+
+  usart = &( usartList[FS_STM32F4xxUSART_Port_USART1] );
+  masterBufferAllocatedBytes = 0;
+  usart->enabled = true;
+  usart->txBuffer.length = 16;
+  usart->rxBuffer.length = 16;
+  bufferInit( &( usart->txBuffer ) );
+  bufferInit( &( usart->rxBuffer ) );
+
+  framer.buffer = lineBuffer;
+  framer.size = sizeof(lineBuffer);
+  framer.length = 0;
+  framer.droppedBytes = 0;
+
+  stages[0].process = FS_STM32F4xxUSARTPipeline_LineFramer;
+  stages[0].ctx = &framer;
+  stages[1].process = recordLine;
+  stages[1].ctx = NULL;
+
+  if( !FS_STM32F4xxUSARTPipeline_Init(&pipeline, stages, 2, recordEvent, NULL) ||
+      !FS_STM32F4xxUSART_SetRxPipeline(FS_STM32F4xxUSART_Port_USART1, &pipeline) )
+  {
+    printf("FAIL: pipeline setup\n");
+    return 1;
+  }
+
+  // Two whole lines and the start of a third.
+  receive(usart, "ab\ncd\nef");
+
+  // The end of the third line, and the start of one too long for the framer.
+  receive(usart, "gh\n0123456");
+
+  // The end of the long line, and a short one, wrapping in the rx buffer.
+  receive(usart, "789ABC\nxy\n");
+
+  ok = ( numRecords == sizeof(expected) / sizeof(expected[0]) ) &&
+       ( 0 == usart->rxBuffer.fillLevel ) &&
+       ( 28 == pipeline.bytesIn );
+
+  for(i = 0; ok && ( i < numRecords ); i++)
+  {
+    ok = ( 0 == strcmp(records[i], expected[i]) );
+  }
+
+  for(i = 0; i < numRecords; i++)
+  {
+    printf("%s\n", records[i]);
+  }
+
+  printf("fill %u bytes in %lu: %s\n", usart->rxBuffer.fillLevel,
+         (unsigned long)pipeline.bytesIn, ok ? "ok" : "FAIL");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,440 @@
+/**
+ *******************************************************************************
+ *
+ * @file  ringbench.c
+ *
+ * @brief Host micro-benchmarks for the USART driver's ring buffer paths.
+ *
+ *        Times bufferPush and bufferPop (each on its own and as a pair),
+ *        writeBytes, readBytes and readLine across fill levels, wrap positions
+ *        and chunk/line lengths, printing ns per call and per byte. Operations
+ *        too short to time singly are timed in batches of RINGBENCH_BATCH_OPS
+ *        from a freshly placed buffer state.
+ *
+ *        Host only: the driver is compiled in directly so its static functions
+ *        can be called, against the stub headers in stubs/, with the
+ *        bare-metal OSAL whose locks are stubbed to nothing.
+ *        Absolute figures depend on the host; compare runs on the same machine
+ *        before and after a change to the ring code.
+ *
+ *        make -C bench run
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// The driver under test, statics and all.
+#include "../src/fs_stm32f4xxusart.c"
+
+// C standard library includes.
+#include <stdio.h>
+#include <time.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+// Iterations per measurement, scaled down for the longer operations.
+#define RINGBENCH_ITERATIONS 2000000
+
+#define RINGBENCH_BUFFER_LENGTH 1024
+
+// Pushes or pops timed together between resets of the buffer state.
+#define RINGBENCH_BATCH_OPS 64
+#define RINGBENCH_BATCHES ( RINGBENCH_ITERATIONS / RINGBENCH_BATCH_OPS )
+
+#define RINGBENCH_ARRAY_LENGTH(a) ( sizeof(a) / sizeof( (a)[0] ) )
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+static USART benchUsart;
+static char scratch[RINGBENCH_BUFFER_LENGTH];
+
+/*------------------------------------------------------------------------------
+--------------------- END PRIVATE GLOBAL VARIABLES -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PRIVATE FUNCTIONS -------------------------------
+------------------------------------------------------------------------------*/
+
+static double nowNs(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+// Give both buffers length bytes at the start of a fresh master buffer.
+static void setupBuffers(uint16_t length)
+{
+  masterBufferAllocatedBytes = 0;
+  benchUsart.rxBuffer.length = length;
+  benchUsart.txBuffer.length = length;
+  bufferInit(&benchUsart.txBuffer);
+  bufferInit(&benchUsart.rxBuffer);
+  benchUsart.enabled = true;
+}
+
+// Put the buffer's head headOffset bytes in, holding fill bytes.
+static void placeData(USARTBuffer * buf, uint16_t headOffset, uint16_t fill)
+{
+  buf->head = buf->base + headOffset;
+  buf->tail = buf->base + ( headOffset + fill ) % buf->length;
+  buf->fillLevel = fill;
+}
+
+/*
+Time bufferPush on its own: batches of pushes from a given fill level, with
+the tail either clear of the buffer end or wrapping part way through. Pushes
+into a full buffer overwrite the oldest data.
+*/
+static void benchPush(void)
+{
+  static const uint16_t fills[] =
+  {
+    0,
+    RINGBENCH_BUFFER_LENGTH / 2,
+    RINGBENCH_BUFFER_LENGTH - RINGBENCH_BATCH_OPS,
+    RINGBENCH_BUFFER_LENGTH
+  };
+  USARTBuffer * buf;
+  uint16_t headOffset;
+  double ns, t0;
+  uint32_t i, k;
+  size_t f;
+  int wrap;
+
+  printf("# bufferPush, ns/push\n");
+
+  setupBuffers(RINGBENCH_BUFFER_LENGTH);
+  buf = &benchUsart.rxBuffer;
+
+  for(f = 0; f < RINGBENCH_ARRAY_LENGTH(fills); f++)
+  {
+    for(wrap = 0; wrap < 2; wrap++)
+    {
+      // Put the tail at the start, or half a batch before the end.
+      headOffset = (uint16_t)( ( ( wrap ? RINGBENCH_BUFFER_LENGTH - RINGBENCH_BATCH_OPS / 2 : 0 ) +
+                                 RINGBENCH_BUFFER_LENGTH - fills[f] ) % RINGBENCH_BUFFER_LENGTH );
+      ns = 0;
+
+      for(i = 0; i < RINGBENCH_BATCHES; i++)
+      {
+        placeData(buf, headOffset, fills[f]);
+        t0 = nowNs();
+
+        for(k = 0; k < RINGBENCH_BATCH_OPS; k++)
+        {
+          bufferPush(buf, 'a');
+        }
+
+        ns += nowNs() - t0;
+      }
+
+      printf("fill %4u %s: %.2f\n", fills[f], wrap ? "wrap  " : "nowrap",
+             ns / ( (double)RINGBENCH_BATCHES * RINGBENCH_BATCH_OPS ));
+    }
+  }
+}
+
+/*
+Time bufferPop on its own: batches of pops from a given fill level, with the
+head either clear of the buffer end or wrapping part way through.
+*/
+static void benchPop(void)
+{
+  static const uint16_t fills[] =
+  {
+    RINGBENCH_BATCH_OPS,
+    RINGBENCH_BUFFER_LENGTH / 2,
+    RINGBENCH_BUFFER_LENGTH
+  };
+  volatile char sink;
+  USARTBuffer * buf;
+  uint16_t headOffset;
+  double ns, t0;
+  uint32_t i, k;
+  char c = 0;
+  size_t f;
+  int wrap;
+
+  printf("# bufferPop, ns/pop\n");
+
+  setupBuffers(RINGBENCH_BUFFER_LENGTH);
+  buf = &benchUsart.rxBuffer;
+
+  for(f = 0; f < RINGBENCH_ARRAY_LENGTH(fills); f++)
+  {
+    for(wrap = 0; wrap < 2; wrap++)
+    {
+      headOffset = wrap ? RINGBENCH_BUFFER_LENGTH - RINGBENCH_BATCH_OPS / 2 : 0;
+      ns = 0;
+
+      for(i = 0; i < RINGBENCH_BATCHES; i++)
+      {
+        placeData(buf, headOffset, fills[f]);
+        t0 = nowNs();
+
+        for(k = 0; k < RINGBENCH_BATCH_OPS; k++)
+        {
+          bufferPop(buf, &c);
+        }
+
+        ns += nowNs() - t0;
+      }
+
+      printf("fill %4u %s: %.2f\n", fills[f], wrap ? "wrap  " : "nowrap",
+             ns / ( (double)RINGBENCH_BATCHES * RINGBENCH_BATCH_OPS ));
+    }
+  }
+
+  sink = c;
+  (void)sink;
+}
+
+// Time bufferPush and bufferPop in alternation, holding the fill level steady.
+static void benchPushPop(void)
+{
+  static const uint16_t fills[] = { 0, RINGBENCH_BUFFER_LENGTH / 2, RINGBENCH_BUFFER_LENGTH - 1 };
+  volatile char sink;
+  char c = 0;
+  double t0;
+  uint32_t i;
+  size_t f;
+
+  printf("# bufferPush + bufferPop pair, ns/pair\n");
+
+  setupBuffers(RINGBENCH_BUFFER_LENGTH);
+
+  for(f = 0; f < RINGBENCH_ARRAY_LENGTH(fills); f++)
+  {
+    placeData(&benchUsart.rxBuffer, 0, fills[f]);
+
+    t0 = nowNs();
+    for(i = 0; i < RINGBENCH_ITERATIONS; i++)
+    {
+      bufferPush(&benchUsart.rxBuffer, 'a');
+      bufferPop(&benchUsart.rxBuffer, &c);
+    }
+
+    printf("fill %4u len %u: %.2f\n", fills[f], RINGBENCH_BUFFER_LENGTH,
+           ( nowNs() - t0 ) / RINGBENCH_ITERATIONS);
+  }
+
+  // Every push and pop wraps.
+  setupBuffers(2);
+  placeData(&benchUsart.rxBuffer, 0, 1);
+
+  t0 = nowNs();
+  for(i = 0; i < RINGBENCH_ITERATIONS; i++)
+  {
+    bufferPush(&benchUsart.rxBuffer, 'a');
+    bufferPop(&benchUsart.rxBuffer, &c);
+  }
+
+  printf("len 2 (wrap every op): %.2f\n", ( nowNs() - t0 ) / RINGBENCH_ITERATIONS);
+
+  sink = c;
+  (void)sink;
+}
+
+// Average ns for one writeBytes of n bytes into the tx buffer at the given fill level.
+static double timeWrite(uint16_t n, uint16_t fill, _Bool wrap, uint32_t reps)
+{
+  uint16_t headOffset;
+  double ns, t0;
+  uint32_t i;
+
+  // Wrapping chunks straddle the end of the buffer half and half.
+  headOffset = (uint16_t)( ( ( wrap ? RINGBENCH_BUFFER_LENGTH - n / 2 : 0 ) +
+                             RINGBENCH_BUFFER_LENGTH - fill ) % RINGBENCH_BUFFER_LENGTH );
+  ns = 0;
+
+  for(i = 0; i < reps; i++)
+  {
+    placeData(&benchUsart.txBuffer, headOffset, fill);
+    t0 = nowNs();
+    writeBytes(&benchUsart, scratch, n);
+    ns += nowNs() - t0;
+  }
+
+  return ns / reps;
+}
+
+// Average ns for one readBytes of n bytes from the rx buffer at the given fill level.
+static double timeRead(uint16_t n, uint16_t fill, _Bool wrap, uint32_t reps)
+{
+  uint16_t headOffset;
+  double ns, t0;
+  uint32_t i;
+
+  headOffset = wrap ? RINGBENCH_BUFFER_LENGTH - n / 2 : 0;
+  ns = 0;
+
+  for(i = 0; i < reps; i++)
+  {
+    placeData(&benchUsart.rxBuffer, headOffset, fill);
+    t0 = nowNs();
+    readBytes(&benchUsart, scratch, n);
+    ns += nowNs() - t0;
+  }
+
+  return ns / reps;
+}
+
+static void benchWriteReadBytes(void)
+{
+  static const uint16_t chunks[] = { 1, 4, 16, 64, 256, 1000 };
+  static const uint16_t fillChunks[] = { 16, 256 };
+  static const uint16_t fillPercents[] = { 0, 25, 50, 75, 100 };
+  double writeNs, readNs;
+  uint16_t n, writeFill, readFill;
+  uint32_t reps;
+  size_t k, f;
+  int wrap;
+
+  printf("# writeBytes into an empty buffer / readBytes of exactly the fill, ns/call (ns/byte)\n");
+
+  setupBuffers(RINGBENCH_BUFFER_LENGTH);
+
+  for(k = 0; k < RINGBENCH_ARRAY_LENGTH(chunks); k++)
+  {
+    n = chunks[k];
+    reps = RINGBENCH_ITERATIONS / ( n < 64 ? 1 : n / 16 );
+
+    for(wrap = 0; wrap < 2; wrap++)
+    {
+      writeNs = timeWrite(n, 0, wrap, reps);
+      readNs = timeRead(n, n, wrap, reps);
+
+      printf("chunk %4u %s: write %.1f (%.2f) read %.1f (%.2f)\n",
+             n, wrap ? "wrap  " : "nowrap",
+             writeNs, writeNs / n, readNs, readNs / n);
+    }
+  }
+
+  /*
+  The fill level curve. Writes range from an empty buffer to a full one, where
+  the oldest data is overwritten; reads from just the chunk to a full buffer.
+  */
+  printf("# writeBytes / readBytes by fill level (%% of length), ns/call (ns/byte)\n");
+
+  for(k = 0; k < RINGBENCH_ARRAY_LENGTH(fillChunks); k++)
+  {
+    n = fillChunks[k];
+    reps = RINGBENCH_ITERATIONS / ( n < 64 ? 1 : n / 16 );
+
+    for(f = 0; f < RINGBENCH_ARRAY_LENGTH(fillPercents); f++)
+    {
+      writeFill = (uint16_t)( (uint32_t)RINGBENCH_BUFFER_LENGTH * fillPercents[f] / 100 );
+      readFill = writeFill < n ? n : writeFill;
+
+      for(wrap = 0; wrap < 2; wrap++)
+      {
+        writeNs = timeWrite(n, writeFill, wrap, reps);
+        readNs = timeRead(n, readFill, wrap, reps);
+
+        printf("chunk %4u fill %3u%% %s: write %.1f (%.2f) read %.1f (%.2f)\n",
+               n, fillPercents[f], wrap ? "wrap  " : "nowrap",
+               writeNs, writeNs / n, readNs, readNs / n);
+      }
+    }
+  }
+}
+
+/*
+Time one readLine of a line of n bytes including its '\n', at the start of the
+buffer or straddling its end, or a scan of n bytes finding no line ending.
+*/
+static double timeReadLine(uint16_t n, _Bool wrap, _Bool lineEnding, uint32_t reps)
+{
+  char * data;
+  uint16_t headOffset, last;
+  double t0;
+  uint32_t i;
+
+  data = &( masterBuffer[benchUsart.rxBuffer.base] );
+  headOffset = wrap ? RINGBENCH_BUFFER_LENGTH - n / 2 : 0;
+  last = (uint16_t)( ( headOffset + n - 1 ) % RINGBENCH_BUFFER_LENGTH );
+
+  memset(data, 'x', RINGBENCH_BUFFER_LENGTH);
+
+  if(lineEnding)
+  {
+    data[last] = '\n';
+  }
+
+  t0 = nowNs();
+  for(i = 0; i < reps; i++)
+  {
+    placeData(&benchUsart.rxBuffer, headOffset, n);
+    readLine(&benchUsart, scratch);
+  }
+
+  return ( nowNs() - t0 ) / reps;
+}
+
+static void benchReadLine(void)
+{
+  static const uint16_t lines[] = { 8, 32, 128, 512, 1000 };
+  double ns;
+  uint32_t reps;
+  uint16_t n;
+  size_t k;
+  int wrap;
+
+  printf("# readLine, ns/call (ns/byte)\n");
+
+  setupBuffers(RINGBENCH_BUFFER_LENGTH);
+
+  for(k = 0; k < RINGBENCH_ARRAY_LENGTH(lines); k++)
+  {
+    n = lines[k];
+    reps = RINGBENCH_ITERATIONS / ( n / 4 + 1 );
+
+    for(wrap = 0; wrap < 2; wrap++)
+    {
+      // Scan and copy of a line ending in the last byte.
+      ns = timeReadLine(n, wrap, true, reps);
+      printf("line %4u %s: %.1f (%.2f)\n", n, wrap ? "wrap  " : "nowrap", ns, ns / n);
+
+      // No line ending present: a full scan with nothing copied.
+      ns = timeReadLine(n, wrap, false, reps);
+      printf("line %4u %s no-eol scan: %.1f (%.2f)\n", n, wrap ? "wrap  " : "nowrap", ns, ns / n);
+    }
+  }
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+
+int main(void)
+{
+  benchPush();
+  benchPop();
+  benchPushPop();
+  benchWriteReadBytes();
+  benchReadLine();
+
+  return 0;
+}
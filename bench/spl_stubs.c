@@ -0,0 +1,35 @@
+/**
+ *******************************************************************************
+ *
+ * @file  spl_stubs.c
+ *
+ * @brief Empty ST peripheral library functions for the host benches.
+ *
+ *        The driver only calls these from init and the interrupt paths, which
+ *        the benches don't time. They exist so that the driver links.
+ *
+ *******************************************************************************
+ */
+
+#include "stm32f4xx_conf.h"
+
+void GPIO_Init(GPIO_TypeDef * port, GPIO_InitTypeDef * init){ (void)port; (void)init; }
+void GPIO_StructInit(GPIO_InitTypeDef * init){ (void)init; }
+void GPIO_PinAFConfig(GPIO_TypeDef * port, uint16_t pinSource, uint8_t af){ (void)port; (void)pinSource; (void)af; }
+
+void USART_Init(USART_TypeDef * usart, USART_InitTypeDef * init){ (void)usart; (void)init; }
+void USART_StructInit(USART_InitTypeDef * init){ (void)init; }
+void USART_ClockInit(USART_TypeDef * usart, USART_ClockInitTypeDef * init){ (void)usart; (void)init; }
+void USART_Cmd(USART_TypeDef * usart, FunctionalState state){ (void)usart; (void)state; }
+void USART_ITConfig(USART_TypeDef * usart, uint16_t it, FunctionalState state){ (void)usart; (void)it; (void)state; }
+void USART_SendData(USART_TypeDef * usart, uint16_t data){ (void)usart; (void)data; }
+uint16_t USART_ReceiveData(USART_TypeDef * usart){ (void)usart; return 0; }
+FlagStatus USART_GetFlagStatus(USART_TypeDef * usart, uint16_t flag){ (void)usart; (void)flag; return RESET; }
+ITStatus USART_GetITStatus(USART_TypeDef * usart, uint16_t it){ (void)usart; (void)it; return RESET; }
+void USART_ClearITPendingBit(USART_TypeDef * usart, uint16_t it){ (void)usart; (void)it; }
+
+void RCC_AHB1PeriphClockCmd(uint32_t periph, FunctionalState state){ (void)periph; (void)state; }
+void RCC_APB1PeriphClockCmd(uint32_t periph, FunctionalState state){ (void)periph; (void)state; }
+void RCC_APB2PeriphClockCmd(uint32_t periph, FunctionalState state){ (void)periph; (void)state; }
+
+void NVIC_Init(NVIC_InitTypeDef * init){ (void)init; }
@@ -0,0 +1,27 @@
+/*
+Host bench stand-in for the FS datatypes library: only the types the USART
+driver's header uses.
+*/
+#ifndef FS_DT_CONF_H
+#define FS_DT_CONF_H
+
+#include <stdint.h>
+
+typedef struct
+{
+  uint16_t(*bytesAvailableToRead)(void);
+  uint16_t(*readBytes)(char * buf, uint16_t len);
+  uint16_t(*readLine)(char * buf);
+  uint16_t(*readLineTruncate)(char * buf, uint16_t len);
+  uint16_t(*writeBytes)(const char * buf, uint16_t len);
+  uint16_t(*writeLine)(const char * buf);
+
+}FS_DT_IOStream_t;
+
+typedef struct
+{
+  int unused;
+
+}FS_DT_GPIO_PinControlInterface_t;
+
+#endif // FS_DT_CONF_H
@@ -0,0 +1,6 @@
+/*
+Host bench configuration: the bare-metal backend, whose locks only save and
+restore PRIMASK - stubbed to nothing in stm32f4xx.h here - so the timings
+exclude any locking cost.
+*/
+#define FS_STM32F4XXOSAL_BAREMETAL
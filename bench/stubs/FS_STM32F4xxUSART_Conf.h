@@ -0,0 +1,6 @@
+/*
+Host bench configuration: optional features off, with room for the two 1 KiB
+buffers the bench uses.
+*/
+#define FS_STM32F4XXUSART_MASTER_BUFFER_LENGTH_BYTES 4096
+#define FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS 10
@@ -0,0 +1,68 @@
+/*
+Host bench stand-in for the ST device header. Peripherals are never touched by
+the ring buffer paths the bench times, so the instances point at addresses
+that are only ever compared, and the PRIMASK intrinsics do nothing.
+*/
+#ifndef STM32F4XX_H
+#define STM32F4XX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum { RESET = 0, SET = !RESET } FlagStatus, ITStatus;
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+
+typedef enum
+{
+  USART1_IRQn = 37,
+  USART2_IRQn = 38,
+  USART3_IRQn = 39,
+  UART4_IRQn = 52,
+  UART5_IRQn = 53,
+  USART6_IRQn = 71
+
+}IRQn_Type;
+
+typedef struct
+{
+  volatile uint16_t SR, r0, DR, r1, BRR, r2, CR1, r3, CR2, r4, CR3, r5, GTPR, r6;
+
+}USART_TypeDef;
+
+typedef struct
+{
+  volatile uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR;
+  volatile uint16_t BSRRL, BSRRH;
+  volatile uint32_t LCKR, AFR[2];
+
+}GPIO_TypeDef;
+
+#define USART1 ( (USART_TypeDef *)0x40011000u )
+#define USART2 ( (USART_TypeDef *)0x40004400u )
+#define USART3 ( (USART_TypeDef *)0x40004800u )
+#define UART4  ( (USART_TypeDef *)0x40004C00u )
+#define UART5  ( (USART_TypeDef *)0x40005000u )
+#define USART6 ( (USART_TypeDef *)0x40011400u )
+
+#define USART_SR_PE      0x0001u
+#define USART_SR_FE      0x0002u
+#define USART_SR_NE      0x0004u
+#define USART_SR_ORE     0x0008u
+#define USART_SR_IDLE    0x0010u
+#define USART_SR_RXNE    0x0020u
+#define USART_SR_TXE     0x0080u
+#define USART_CR1_IDLEIE 0x0010u
+#define USART_CR1_RXNEIE 0x0020u
+#define USART_CR1_TXEIE  0x0080u
+#define USART_CR1_OVER8  0x8000u
+#define USART_CR3_DMAR   0x0040u
+
+static inline uint32_t __get_PRIMASK(void){ return 0; }
+static inline void __set_PRIMASK(uint32_t primask){ (void)primask; }
+static inline void __disable_irq(void){}
+static inline void __enable_irq(void){}
+static inline void __WFI(void){}
+static inline void __DSB(void){}
+static inline void __ISB(void){}
+
+#endif // STM32F4XX_H
@@ -0,0 +1,100 @@
+/*
+Host bench stand-in for the ST peripheral library: the USART and NVIC types,
+constants and functions the driver uses in its default configuration.
+Definitions of the functions are in ../spl_stubs.c.
+*/
+#ifndef STM32F4XX_CONF_H
+#define STM32F4XX_CONF_H
+
+#include "stm32f4xx.h"
+#include "stm32f4xx_gpio.h"
+
+typedef struct
+{
+  uint32_t USART_BaudRate;
+  uint16_t USART_WordLength;
+  uint16_t USART_StopBits;
+  uint16_t USART_Parity;
+  uint16_t USART_Mode;
+  uint16_t USART_HardwareFlowControl;
+
+}USART_InitTypeDef;
+
+typedef struct
+{
+  uint16_t USART_Clock;
+  uint16_t USART_CPOL;
+  uint16_t USART_CPHA;
+  uint16_t USART_LastBit;
+
+}USART_ClockInitTypeDef;
+
+typedef struct
+{
+  uint8_t NVIC_IRQChannel;
+  uint8_t NVIC_IRQChannelPreemptionPriority;
+  uint8_t NVIC_IRQChannelSubPriority;
+  FunctionalState NVIC_IRQChannelCmd;
+
+}NVIC_InitTypeDef;
+
+#define USART_WordLength_8b 0x0000
+#define USART_WordLength_9b 0x1000
+#define USART_StopBits_1    0x0000
+#define USART_StopBits_0_5  0x1000
+#define USART_StopBits_2    0x2000
+#define USART_StopBits_1_5  0x3000
+#define USART_Parity_No     0x0000
+
+#define USART_HardwareFlowControl_None    0x0000
+#define USART_HardwareFlowControl_RTS     0x0100
+#define USART_HardwareFlowControl_CTS     0x0200
+#define USART_HardwareFlowControl_RTS_CTS 0x0300
+
+#define USART_FLAG_PE   0x0001
+#define USART_FLAG_FE   0x0002
+#define USART_FLAG_NE   0x0004
+#define USART_FLAG_ORE  0x0008
+#define USART_FLAG_IDLE 0x0010
+#define USART_FLAG_RXNE 0x0020
+#define USART_FLAG_TC   0x0040
+#define USART_FLAG_TXE  0x0080
+
+#define USART_IT_ERR  0x0060
+#define USART_IT_IDLE 0x0424
+#define USART_IT_RXNE 0x0525
+#define USART_IT_TC   0x0626
+#define USART_IT_TXE  0x0727
+
+#define RCC_APB2Periph_USART1 0x00000010
+#define RCC_APB2Periph_USART6 0x00000020
+#define RCC_APB1Periph_USART2 0x00020000
+#define RCC_APB1Periph_USART3 0x00040000
+#define RCC_APB1Periph_UART4  0x00080000
+#define RCC_APB1Periph_UART5  0x00100000
+
+#define GPIO_AF_USART1 7
+#define GPIO_AF_USART2 7
+#define GPIO_AF_USART3 7
+#define GPIO_AF_UART4  8
+#define GPIO_AF_UART5  8
+#define GPIO_AF_USART6 8
+
+void USART_Init(USART_TypeDef * usart, USART_InitTypeDef * init);
+void USART_StructInit(USART_InitTypeDef * init);
+void USART_ClockInit(USART_TypeDef * usart, USART_ClockInitTypeDef * init);
+void USART_Cmd(USART_TypeDef * usart, FunctionalState state);
+void USART_ITConfig(USART_TypeDef * usart, uint16_t it, FunctionalState state);
+void USART_SendData(USART_TypeDef * usart, uint16_t data);
+uint16_t USART_ReceiveData(USART_TypeDef * usart);
+FlagStatus USART_GetFlagStatus(USART_TypeDef * usart, uint16_t flag);
+ITStatus USART_GetITStatus(USART_TypeDef * usart, uint16_t it);
+void USART_ClearITPendingBit(USART_TypeDef * usart, uint16_t it);
+
+void RCC_AHB1PeriphClockCmd(uint32_t periph, FunctionalState state);
+void RCC_APB1PeriphClockCmd(uint32_t periph, FunctionalState state);
+void RCC_APB2PeriphClockCmd(uint32_t periph, FunctionalState state);
+
+void NVIC_Init(NVIC_InitTypeDef * init);
+
+#endif // STM32F4XX_CONF_H
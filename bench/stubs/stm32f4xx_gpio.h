@@ -0,0 +1,32 @@
+/*
+Host bench stand-in for the ST GPIO header: just the types the driver headers
+use.
+*/
+#ifndef STM32F4XX_GPIO_H
+#define STM32F4XX_GPIO_H
+
+#include "stm32f4xx.h"
+
+typedef enum { GPIO_Mode_IN = 0, GPIO_Mode_OUT, GPIO_Mode_AF, GPIO_Mode_AN } GPIOMode_TypeDef;
+typedef enum { GPIO_OType_PP = 0, GPIO_OType_OD } GPIOOType_TypeDef;
+typedef enum { GPIO_Speed_2MHz = 0 } GPIOSpeed_TypeDef;
+typedef enum { GPIO_PuPd_NOPULL = 0, GPIO_PuPd_UP } GPIOPuPd_TypeDef;
+
+typedef struct
+{
+  uint32_t GPIO_Pin;
+  GPIOMode_TypeDef GPIO_Mode;
+  GPIOSpeed_TypeDef GPIO_Speed;
+  GPIOOType_TypeDef GPIO_OType;
+  GPIOPuPd_TypeDef GPIO_PuPd;
+
+}GPIO_InitTypeDef;
+
+void GPIO_Init(GPIO_TypeDef * port, GPIO_InitTypeDef * init);
+void GPIO_StructInit(GPIO_InitTypeDef * init);
+void GPIO_PinAFConfig(GPIO_TypeDef * port, uint16_t pinSource, uint8_t af);
+void GPIO_SetBits(GPIO_TypeDef * port, uint16_t pins);
+void GPIO_ResetBits(GPIO_TypeDef * port, uint16_t pins);
+uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef * port, uint16_t pin);
+
+#endif // STM32F4XX_GPIO_H
@@ -0,0 +1,140 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_STM32F4xxCLI.h
+ *
+ * @brief Command line interpreter running on top of the U(S)ART driver.
+ *
+ *        Lines are tokenised in place in the driver's rx buffer - tokens are
+ *        descriptions of bytes in the buffer, not copies - and dispatched via
+ *        a perfect hash of the command names built once at initialisation.
+ *        Nothing is allocated or copied per line.
+ *
+ *        Handlers must not retain tokens after returning since the line is
+ *        consumed from the rx buffer as soon as its handler has run.
+ *
+ * @author Andy Norris [andy@firmwaresavvy.com]
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_STM32F4XXCLI_H
+#define FS_STM32F4XXCLI_H
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// FS library includes.
+#include "FS_STM32F4xxUSART.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PUBLIC DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Defaults for the settings below may be overridden in FS_STM32F4xxUSART_Conf.h.
+The slot count must be a power of two no greater than 256 and should be
+comfortably larger than the number of commands for initialisation to find
+a perfect hash quickly.
+*/
+#ifndef FS_STM32F4XXCLI_MAX_ARGS
+#define FS_STM32F4XXCLI_MAX_ARGS 8
+#endif
+
+#ifndef FS_STM32F4XXCLI_HASH_SLOTS
+#define FS_STM32F4XXCLI_HASH_SLOTS 128
+#endif
+
+#ifndef FS_STM32F4XXCLI_HASH_BUCKETS
+#define FS_STM32F4XXCLI_HASH_BUCKETS 32
+#endif
+
+/*------------------------------------------------------------------------------
+-------------------------- END PUBLIC DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+/*
+A token within a received line. Tokens which straddle the end of the rx buffer
+are described by two parts, otherwise the second part is empty.
+*/
+typedef struct
+{
+  FS_STM32F4xxUSART_Span_t part[2];
+
+}FS_STM32F4xxCLI_Token_t;
+
+// argv[0] is the command name itself.
+typedef void(*FS_STM32F4xxCLI_Handler_t)(uint8_t argc,
+                                         const FS_STM32F4xxCLI_Token_t * argv,
+                                         void * ctx);
+
+typedef struct
+{
+  const char * name;
+  FS_STM32F4xxCLI_Handler_t handler;
+
+}FS_STM32F4xxCLI_Command_t;
+
+typedef struct
+{
+  // U(S)ART on which the command line is run.
+  FS_STM32F4xxUSART_Port_e port;
+
+  // Application's command table.
+  const FS_STM32F4xxCLI_Command_t * commands;
+  uint8_t numCommands;
+
+  // Called for lines whose first token is not a command. May be NULL.
+  FS_STM32F4xxCLI_Handler_t unknownCommandHandler;
+
+  // Passed through to the handlers.
+  void * ctx;
+
+  // Perfect hash: per-bucket displacement and per-slot command index + 1 (0 if empty).
+  uint16_t displacement[FS_STM32F4XXCLI_HASH_BUCKETS];
+  uint8_t slot[FS_STM32F4XXCLI_HASH_SLOTS];
+
+}FS_STM32F4xxCLI_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+// Returns false if the command table is too large or contains duplicate names.
+_Bool FS_STM32F4xxCLI_Init(FS_STM32F4xxCLI_t * cli,
+                           FS_STM32F4xxUSART_Port_e port,
+                           const FS_STM32F4xxCLI_Command_t * commands,
+                           uint8_t numCommands,
+                           FS_STM32F4xxCLI_Handler_t unknownCommandHandler,
+                           void * ctx);
+
+// Dispatch every complete line received so far. Returns the number of lines handled.
+uint16_t FS_STM32F4xxCLI_Poll(FS_STM32F4xxCLI_t * cli);
+
+// Token helpers.
+uint16_t FS_STM32F4xxCLI_TokenLength(const FS_STM32F4xxCLI_Token_t * token);
+_Bool FS_STM32F4xxCLI_TokenEquals(const FS_STM32F4xxCLI_Token_t * token, const char * str);
+uint16_t FS_STM32F4xxCLI_TokenCopy(const FS_STM32F4xxCLI_Token_t * token, char * buf, uint16_t bufLength);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+#endif // FS_STM32F4XXCLI_H
@@ -0,0 +1,153 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_STM32F4xxDMA.h
+ *
+ * @brief DMA stream allocation shared between drivers.
+ *
+ *        Each peripheral DMA request (U(S)ART rx, I2C tx and so on) can only be
+ *        served by one or two fixed stream/channel pairs, and each stream
+ *        serves one request at a time. Drivers claim the stream for a request
+ *        here, normally at init, rather than hard-coding their own, so that a
+ *        clash between two drivers is caught when the second one initialises
+ *        instead of showing up as corrupted transfers later. Where the
+ *        reference manual offers a second stream for a request, it is used if
+ *        the first is taken.
+ *
+ *        This module owns the interrupt handlers of all sixteen streams. Each
+ *        handler clears the stream's flags and passes them to the handler
+ *        registered by the stream's owner. Drivers and applications using DMA
+ *        directly must therefore claim their streams here too, rather than
+ *        defining DMAx_StreamY_IRQHandler themselves. The handlers honour
+ *        FS_STM32F4XXUSART_ENABLE_RAMFUNC from FS_STM32F4xxUSART_Conf.h.
+ *
+ * @author Andy Norris [andy@firmwaresavvy.com]
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_STM32F4XXDMA_H
+#define FS_STM32F4XXDMA_H
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// C standard library includes.
+#include <stdint.h>
+
+// ST library includes.
+#include "stm32f4xx.h"
+#include "stm32f4xx_conf.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PUBLIC DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+// Stream interrupt flags passed to handlers, in stream 0's positions whatever the stream.
+#define FS_STM32F4XXDMA_FLAG_FIFO_ERROR     0x01
+#define FS_STM32F4XXDMA_FLAG_DIRECT_ERROR   0x04
+#define FS_STM32F4XXDMA_FLAG_TRANSFER_ERROR 0x08
+#define FS_STM32F4XXDMA_FLAG_HALF_TRANSFER  0x10
+#define FS_STM32F4XXDMA_FLAG_COMPLETE       0x20
+
+#define FS_STM32F4XXDMA_FLAG_ALL ( FS_STM32F4XXDMA_FLAG_FIFO_ERROR | \
+                                   FS_STM32F4XXDMA_FLAG_DIRECT_ERROR | \
+                                   FS_STM32F4XXDMA_FLAG_TRANSFER_ERROR | \
+                                   FS_STM32F4XXDMA_FLAG_HALF_TRANSFER | \
+                                   FS_STM32F4XXDMA_FLAG_COMPLETE )
+
+/*------------------------------------------------------------------------------
+-------------------------- END PUBLIC DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef enum
+{
+  FS_STM32F4xxDMA_Request_USART1_Rx = 0,
+  FS_STM32F4xxDMA_Request_USART2_Rx,
+  FS_STM32F4xxDMA_Request_USART3_Rx,
+  FS_STM32F4xxDMA_Request_UART4_Rx,
+  FS_STM32F4xxDMA_Request_UART5_Rx,
+  FS_STM32F4xxDMA_Request_USART6_Rx,
+
+  FS_STM32F4xxDMA_Request_USART1_Tx,
+  FS_STM32F4xxDMA_Request_USART2_Tx,
+  FS_STM32F4xxDMA_Request_USART3_Tx,
+  FS_STM32F4xxDMA_Request_UART4_Tx,
+  FS_STM32F4xxDMA_Request_UART5_Tx,
+  FS_STM32F4xxDMA_Request_USART6_Tx,
+
+  FS_STM32F4xxDMA_Request_I2C1_Rx,
+  FS_STM32F4xxDMA_Request_I2C2_Rx,
+  FS_STM32F4xxDMA_Request_I2C3_Rx,
+
+  FS_STM32F4xxDMA_Request_I2C1_Tx,
+  FS_STM32F4xxDMA_Request_I2C2_Tx,
+  FS_STM32F4xxDMA_Request_I2C3_Tx,
+
+  FS_STM32F4xxDMA_NumRequests
+
+}FS_STM32F4xxDMA_Request_e;
+
+/*
+A stream's interrupt, with its FS_STM32F4XXDMA_FLAG_* flags, which have already
+been cleared. Runs in interrupt context.
+*/
+typedef void(*FS_STM32F4xxDMA_Handler_t)(void * ctx, uint32_t flags);
+
+// A claimed stream. stream is NULL when nothing is claimed.
+typedef struct
+{
+  DMA_Stream_TypeDef * stream;
+
+  // DMA_Channel_x value for the stream's DMA_InitTypeDef.
+  uint32_t channel;
+
+  // Managed by the module.
+  uint8_t streamIndex;
+
+}FS_STM32F4xxDMA_Allocation_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Claim a free stream able to serve the request, start its DMA controller's clock
+and enable its interrupt, at the same priority as the drivers' peripheral
+interrupts. handler may be NULL if the stream's interrupts won't be used.
+Returns false, leaving allocation untouched, if every stream which could serve
+the request is already claimed.
+*/
+_Bool FS_STM32F4xxDMA_Claim(FS_STM32F4xxDMA_Request_e request,
+                            FS_STM32F4xxDMA_Handler_t handler,
+                            void * ctx,
+                            FS_STM32F4xxDMA_Allocation_t * allocation);
+
+/*
+Give a claimed stream back, disabling its interrupt. The stream must already
+have been stopped. Does nothing if allocation holds no stream.
+*/
+void FS_STM32F4xxDMA_Release(FS_STM32F4xxDMA_Allocation_t * allocation);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+#endif // FS_STM32F4XXDMA_H
@@ -0,0 +1,187 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_STM32F4xxOSAL.h
+ *
+ * @brief Thin operating system abstraction layer for the FS drivers.
+ *
+ *        Provides the handful of primitives the drivers need - locks, an
+ *        interrupt-to-task signal, event flags, a tick count and critical
+ *        sections - with two backends, selected in FS_STM32F4xxOSAL_Conf.h:
+ *
+ *        FreeRTOS (default): locks are mutexes, signals are binary semaphores
+ *        and event flags are event groups.
+ *
+ *        Bare metal (FS_STM32F4XXOSAL_BAREMETAL defined): no kernel objects
+ *        at all. Locks mask interrupts, signals and event flags are set from
+ *        interrupt handlers or the main loop and waiting sleeps the core with
+ *        WFI. The application must
+ *        call FS_STM32F4xxOSAL_TickIncrement from its SysTick handler at
+ *        FS_STM32F4XXOSAL_TICK_RATE_HZ for timeouts to work.
+ *
+ * @author Andy Norris [andy@firmwaresavvy.com]
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_STM32F4XXOSAL_H
+#define FS_STM32F4XXOSAL_H
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// C standard library includes.
+#include <stdint.h>
+
+// Project must supply this header.
+#include "FS_STM32F4xxOSAL_Conf.h"
+
+// For FS_STM32F4XXUSART_ENABLE_RAMFUNC - see FS_STM32F4XXOSAL_RAMFUNC.
+#include "FS_STM32F4xxUSART_Conf.h"
+
+#if !defined(FS_STM32F4XXOSAL_BAREMETAL)
+// Free RTOS includes.
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "event_groups.h"
+#endif
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PUBLIC DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+// Timeout value meaning "block until successful".
+#define FS_STM32F4XXOSAL_WAIT_FOREVER 0xFFFFFFFFu
+
+// Event flags available - FreeRTOS reserves the top byte of an event group.
+#define FS_STM32F4XXOSAL_EVENTS_BITS 24
+
+#if defined(FS_STM32F4XXOSAL_BAREMETAL)
+#ifndef FS_STM32F4XXOSAL_TICK_RATE_HZ
+#define FS_STM32F4XXOSAL_TICK_RATE_HZ 1000
+#endif
+#else
+#define FS_STM32F4XXOSAL_TICK_RATE_HZ configTICK_RATE_HZ
+#endif
+
+/*
+With FS_STM32F4XXUSART_ENABLE_RAMFUNC, the primitives on the U(S)ART driver's
+interrupt path run from SRAM along with it - see FS_STM32F4xxUSART.h. long_call
+lets code in flash reach them.
+*/
+#if defined(FS_STM32F4XXUSART_ENABLE_RAMFUNC)
+#define FS_STM32F4XXOSAL_RAMFUNC __attribute__((section(".ramfunc"), long_call))
+#else
+#define FS_STM32F4XXOSAL_RAMFUNC
+#endif
+
+/*------------------------------------------------------------------------------
+-------------------------- END PUBLIC DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef uint32_t FS_STM32F4xxOSAL_Ticks_t;
+
+#if defined(FS_STM32F4XXOSAL_BAREMETAL)
+
+// Interrupt mask state to restore when the lock is given back.
+typedef struct
+{
+  uint32_t savedPrimask;
+
+}FS_STM32F4xxOSAL_Lock_t;
+
+typedef struct
+{
+  volatile uint8_t pending;
+
+}FS_STM32F4xxOSAL_Signal_t;
+
+typedef struct
+{
+  volatile uint32_t bits;
+
+}FS_STM32F4xxOSAL_Events_t;
+
+#else
+
+typedef struct
+{
+  SemaphoreHandle_t mutex;
+
+}FS_STM32F4xxOSAL_Lock_t;
+
+typedef struct
+{
+  SemaphoreHandle_t semaphore;
+
+}FS_STM32F4xxOSAL_Signal_t;
+
+typedef struct
+{
+  EventGroupHandle_t group;
+
+}FS_STM32F4xxOSAL_Events_t;
+
+#endif
+
+// Opaque state returned by FS_STM32F4xxOSAL_EnterCritical.
+typedef uint32_t FS_STM32F4xxOSAL_CriticalState_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+// Locks - mutual exclusion between tasks. Not for use from interrupt handlers.
+_Bool FS_STM32F4xxOSAL_LockCreate(FS_STM32F4xxOSAL_Lock_t * lock);
+FS_STM32F4XXOSAL_RAMFUNC _Bool FS_STM32F4xxOSAL_LockTake(FS_STM32F4xxOSAL_Lock_t * lock, FS_STM32F4xxOSAL_Ticks_t timeout);
+FS_STM32F4XXOSAL_RAMFUNC void FS_STM32F4xxOSAL_LockGive(FS_STM32F4xxOSAL_Lock_t * lock);
+
+// Signals - wake a waiting task from an interrupt handler (or another task).
+_Bool FS_STM32F4xxOSAL_SignalCreate(FS_STM32F4xxOSAL_Signal_t * signal);
+void FS_STM32F4xxOSAL_SignalGive(FS_STM32F4xxOSAL_Signal_t * signal);
+FS_STM32F4XXOSAL_RAMFUNC void FS_STM32F4xxOSAL_SignalGiveFromISR(FS_STM32F4xxOSAL_Signal_t * signal);
+_Bool FS_STM32F4xxOSAL_SignalWait(FS_STM32F4xxOSAL_Signal_t * signal, FS_STM32F4xxOSAL_Ticks_t timeout);
+
+/*
+Event flags - any number of tasks may wait for any of a set of flags. Flags
+stay set until cleared. EventsWait returns those of the given flags which are
+set, or 0 on timeout. Not for use from interrupt handlers.
+*/
+_Bool FS_STM32F4xxOSAL_EventsCreate(FS_STM32F4xxOSAL_Events_t * events);
+void FS_STM32F4xxOSAL_EventsSet(FS_STM32F4xxOSAL_Events_t * events, uint32_t bits);
+void FS_STM32F4xxOSAL_EventsClear(FS_STM32F4xxOSAL_Events_t * events, uint32_t bits);
+uint32_t FS_STM32F4xxOSAL_EventsWait(FS_STM32F4xxOSAL_Events_t * events, uint32_t bits, FS_STM32F4xxOSAL_Ticks_t timeout);
+
+// Time.
+FS_STM32F4xxOSAL_Ticks_t FS_STM32F4xxOSAL_GetTicks(void);
+
+#if defined(FS_STM32F4XXOSAL_BAREMETAL)
+void FS_STM32F4xxOSAL_TickIncrement(void);
+#endif
+
+// Short critical sections, usable from tasks only.
+FS_STM32F4XXOSAL_RAMFUNC FS_STM32F4xxOSAL_CriticalState_t FS_STM32F4xxOSAL_EnterCritical(void);
+FS_STM32F4XXOSAL_RAMFUNC void FS_STM32F4xxOSAL_ExitCritical(FS_STM32F4xxOSAL_CriticalState_t state);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+#endif // FS_STM32F4XXOSAL_H
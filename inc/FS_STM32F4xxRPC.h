@@ -0,0 +1,247 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_STM32F4xxRPC.h
+ *
+ * @brief Request/response RPC layer over a framed stream.
+ *
+ *        Messages are SLIP framed (RFC 1055) and carry a CRC-16, so the link
+ *        resynchronises at the next frame after noise or a dropped byte.
+ *        Every request carries a 16-bit ID which the peer echoes in its
+ *        response, so any number of requests (up to
+ *        FS_STM32F4XXRPC_MAX_PENDING) may be outstanding at once and their
+ *        responses may come back in any order. Each request has its own
+ *        timeout and completion callback.
+ *
+ *        Frame contents, before SLIP escaping, all fields little-endian:
+ *
+ *          type (1 byte: 0 request, 1 response), ID (2 bytes),
+ *          method (request) or status (response) (1 byte), payload,
+ *          CRC-16/XMODEM of everything before it (2 bytes).
+ *
+ *        Both ends are symmetric - either may issue requests.
+ *
+ *        Calls, responses and cancellations may come from any task. Poll,
+ *        which runs the callbacks and request handler, should be called from
+ *        one task only.
+ *
+ * @author Andy Norris [andy@firmwaresavvy.com]
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_STM32F4XXRPC_H
+#define FS_STM32F4XXRPC_H
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// C standard library includes.
+#include <stdint.h>
+
+// FS library includes.
+#include "FS_DT_Conf.h"
+#include "FS_STM32F4xxOSAL.h"
+
+/*
+Project must supply this header. Included here so that every translation unit
+sees the same overrides of the settings below, some of which size structures.
+*/
+#include "FS_STM32F4xxUSART_Conf.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PUBLIC DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Defaults for the settings below may be overridden in FS_STM32F4xxUSART_Conf.h.
+*/
+
+// Requests which may await a response at once.
+#ifndef FS_STM32F4XXRPC_MAX_PENDING
+#define FS_STM32F4XXRPC_MAX_PENDING 8
+#endif
+
+// Largest request or response payload, sent or received.
+#ifndef FS_STM32F4XXRPC_MAX_PAYLOAD_BYTES
+#define FS_STM32F4XXRPC_MAX_PAYLOAD_BYTES 256
+#endif
+
+#ifndef FS_STM32F4XXRPC_LOCK_TIMEOUT_TICKS
+#define FS_STM32F4XXRPC_LOCK_TIMEOUT_TICKS 10
+#endif
+
+// Response status sent automatically for requests when there is no request handler.
+#define FS_STM32F4XXRPC_STATUS_UNSUPPORTED 0xFF
+
+#define FS_STM32F4XXRPC_HEADER_BYTES 4
+#define FS_STM32F4XXRPC_CRC_BYTES 2
+
+#define FS_STM32F4XXRPC_MAX_FRAME_BYTES ( FS_STM32F4XXRPC_HEADER_BYTES + \
+                                          FS_STM32F4XXRPC_MAX_PAYLOAD_BYTES + \
+                                          FS_STM32F4XXRPC_CRC_BYTES )
+
+// Every byte escaped, plus the delimiters either side.
+#define FS_STM32F4XXRPC_MAX_ENCODED_BYTES ( ( 2 * FS_STM32F4XXRPC_MAX_FRAME_BYTES ) + 2 )
+
+/*------------------------------------------------------------------------------
+-------------------------- END PUBLIC DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef enum
+{
+  // A response arrived - its status and payload are valid.
+  FS_STM32F4xxRPC_Result_Ok = 0,
+
+  // No response within the request's timeout. A late response is discarded.
+  FS_STM32F4xxRPC_Result_Timeout,
+
+  // Withdrawn with FS_STM32F4xxRPC_Cancel.
+  FS_STM32F4xxRPC_Result_Cancelled
+
+}FS_STM32F4xxRPC_Result_e;
+
+struct FS_STM32F4xxRPC_s;
+
+/*
+Completion of a request. status, data and length are only meaningful for
+FS_STM32F4xxRPC_Result_Ok, and data only for the duration of the call.
+*/
+typedef void(*FS_STM32F4xxRPC_Callback_t)(void * ctx,
+                                          FS_STM32F4xxRPC_Result_e result,
+                                          uint8_t status,
+                                          const uint8_t * data,
+                                          uint16_t length);
+
+/*
+A request from the peer. The handler answers with FS_STM32F4xxRPC_Respond,
+passing the ID, either before returning or later. data is only valid for the
+duration of the call.
+*/
+typedef void(*FS_STM32F4xxRPC_RequestHandler_t)(struct FS_STM32F4xxRPC_s * rpc,
+                                                uint16_t id,
+                                                uint8_t method,
+                                                const uint8_t * data,
+                                                uint16_t length,
+                                                void * ctx);
+
+// An outstanding request. ID 0 marks a free entry.
+typedef struct
+{
+  uint16_t id;
+  FS_STM32F4xxOSAL_Ticks_t sentTicks;
+  FS_STM32F4xxOSAL_Ticks_t timeoutTicks;
+  FS_STM32F4xxRPC_Callback_t callback;
+  void * ctx;
+
+}FS_STM32F4xxRPC_Pending_t;
+
+typedef struct
+{
+  // Frames discarded for a bad CRC or being too short.
+  uint32_t crcErrors;
+
+  // Frames discarded for being larger than FS_STM32F4XXRPC_MAX_FRAME_BYTES.
+  uint32_t oversizeFrames;
+
+  // Responses to no outstanding request, usually ones arriving after a timeout.
+  uint32_t unmatchedResponses;
+
+  uint32_t timeouts;
+
+}FS_STM32F4xxRPC_Stats_t;
+
+typedef struct FS_STM32F4xxRPC_s
+{
+  FS_DT_IOStream_t * stream;
+
+  // Handler for requests from the peer. May be NULL.
+  FS_STM32F4xxRPC_RequestHandler_t requestHandler;
+  void * handlerCtx;
+
+  // Protects the pending table, the ID counter and the tx frame.
+  FS_STM32F4xxOSAL_Lock_t lock;
+  uint16_t nextId;
+  FS_STM32F4xxRPC_Pending_t pending[FS_STM32F4XXRPC_MAX_PENDING];
+  uint8_t txFrame[FS_STM32F4XXRPC_MAX_ENCODED_BYTES];
+
+  // Frame being received, unescaped.
+  uint8_t rxFrame[FS_STM32F4XXRPC_MAX_FRAME_BYTES];
+  uint16_t rxLength;
+  _Bool rxEscape;
+  _Bool rxOversize;
+
+  FS_STM32F4xxRPC_Stats_t stats;
+
+}FS_STM32F4xxRPC_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+// Returns false if the lock can't be created.
+_Bool FS_STM32F4xxRPC_Init(FS_STM32F4xxRPC_t * rpc,
+                           FS_DT_IOStream_t * stream,
+                           FS_STM32F4xxRPC_RequestHandler_t requestHandler,
+                           void * handlerCtx);
+
+/*
+Send a request without waiting for earlier ones to complete. The callback
+runs exactly once: from FS_STM32F4xxRPC_Poll on the response or timeout, or
+from FS_STM32F4xxRPC_Cancel. Returns the request's ID, or 0 if the pending table is full, the
+payload too large or the stream refused the frame, in which case the callback
+will never run.
+*/
+uint16_t FS_STM32F4xxRPC_Call(FS_STM32F4xxRPC_t * rpc,
+                              uint8_t method,
+                              const uint8_t * data,
+                              uint16_t length,
+                              FS_STM32F4xxOSAL_Ticks_t timeoutTicks,
+                              FS_STM32F4xxRPC_Callback_t callback,
+                              void * ctx);
+
+// Answer a request passed to the request handler.
+_Bool FS_STM32F4xxRPC_Respond(FS_STM32F4xxRPC_t * rpc,
+                              uint16_t id,
+                              uint8_t status,
+                              const uint8_t * data,
+                              uint16_t length);
+
+/*
+Withdraw an outstanding request. Its callback runs with
+FS_STM32F4xxRPC_Result_Cancelled before this returns. Returns false if the
+request has already completed.
+*/
+_Bool FS_STM32F4xxRPC_Cancel(FS_STM32F4xxRPC_t * rpc, uint16_t id);
+
+// Requests awaiting a response.
+uint8_t FS_STM32F4xxRPC_PendingCount(FS_STM32F4xxRPC_t * rpc);
+
+/*
+Handle every frame received so far and expire overdue requests, running their
+callbacks and the request handler.
+*/
+void FS_STM32F4xxRPC_Poll(FS_STM32F4xxRPC_t * rpc);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+#endif // FS_STM32F4XXRPC_H
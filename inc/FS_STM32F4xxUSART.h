@@ -20,6 +20,7 @@
 
 // FS library includes.
 #include "FS_DT_Conf.h"
+#include "FS_STM32F4xxOSAL.h"
 #include "FS_STM32F4xxPinMux.h"
 
 // ST library includes.
@@ -34,10 +35,302 @@
 ------------------------------------------------------------------------------*/
 
 
+/*------------------------------------------------------------------------------
+------------------------- START PUBLIC DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Defaults for the settings below may be overridden in FS_STM32F4xxUSART_Conf.h.
+*/
+
+/*
+Maximum number of bytes moved in each direction for one U(S)ART before the
+main loop moves on to the next. Bounds the delay a busy U(S)ART can impose on
+the others.
+*/
+#ifndef FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES
+#define FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES 16
+#endif
+
+/*
+Adaptive rx mode switching (FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX). The rx
+rate is measured over windows of the given number of ticks. A U(S)ART
+receiving at least ENTER bytes per window switches to circular DMA, and one
+receiving no more than EXIT bytes per window switches back to per-byte
+interrupts. The gap between the two thresholds provides hysteresis.
+*/
+#ifndef FS_STM32F4XXUSART_ADAPTIVE_RX_WINDOW_TICKS
+#define FS_STM32F4XXUSART_ADAPTIVE_RX_WINDOW_TICKS 100
+#endif
+
+#ifndef FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_ENTER_BYTES
+#define FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_ENTER_BYTES 512
+#endif
+
+#ifndef FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_EXIT_BYTES
+#define FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_EXIT_BYTES 64
+#endif
+
+/*
+Times to poll for the rx DMA stream to stop when switching back to per-byte
+interrupts before giving up until the next window.
+*/
+#ifndef FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_STOP_POLLS
+#define FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_STOP_POLLS 1000
+#endif
+
+/*
+A U(S)ART counts as writable for FS_STM32F4xxUSART_Select once its tx buffer
+has this much free space (or is empty, if smaller).
+*/
+#ifndef FS_STM32F4XXUSART_SELECT_WRITABLE_BYTES
+#define FS_STM32F4XXUSART_SELECT_WRITABLE_BYTES 64
+#endif
+
+/*
+Broadcast writes (FS_STM32F4XXUSART_ENABLE_TX_BROADCAST). Each U(S)ART can
+have up to this many shared blocks queued for transmission at once - see
+FS_STM32F4xxUSART_Broadcast.
+*/
+#ifndef FS_STM32F4XXUSART_TX_BROADCAST_DEPTH
+#define FS_STM32F4XXUSART_TX_BROADCAST_DEPTH 4
+#endif
+
+/*
+Tx pacing (FS_STM32F4XXUSART_ENABLE_TX_PACING). Gaps between paced bytes are
+timed by a 32-bit timer, TIM5 or TIM2, which this driver runs at 1 MHz and
+whose interrupt handler it owns. The timer's capture/compare channel 1 wakes
+the service function when the next paced byte falls due.
+*/
+#ifndef FS_STM32F4XXUSART_TX_PACING_TIM
+#define FS_STM32F4XXUSART_TX_PACING_TIM TIM5
+#define FS_STM32F4XXUSART_TX_PACING_TIM_RCC RCC_APB1Periph_TIM5
+#define FS_STM32F4XXUSART_TX_PACING_TIM_IRQN TIM5_IRQn
+#define FS_STM32F4XXUSART_TX_PACING_TIM_IRQHANDLER TIM5_IRQHandler
+#endif
+
+/*
+Baud rate checks (FS_STM32F4XXUSART_ENABLE_BAUD_CHECK) time this many edges on
+the rx pin before reporting - see FS_STM32F4xxUSART_BaudCheckStart.
+*/
+#ifndef FS_STM32F4XXUSART_BAUD_CHECK_EDGES
+#define FS_STM32F4XXUSART_BAUD_CHECK_EDGES 256
+#endif
+
+/*
+Highest baud rate a check may be run at on an rx pin without a timer capture
+channel, whose edges are timestamped in the EXTI interrupt handler. Each
+timestamp is late by the interrupt's latency, which varies with what else the
+core is doing, and edges closer together than the handler can run are merged
+into one. At 115200 baud a bit lasts about 1460 cycles at 168 MHz, long enough
+for both to be small; at 921600 (182 cycles) they are not.
+*/
+#ifndef FS_STM32F4XXUSART_BAUD_CHECK_EXTI_MAX_BAUD
+#define FS_STM32F4XXUSART_BAUD_CHECK_EXTI_MAX_BAUD 115200
+#endif
+
+/*
+FS_STM32F4XXUSART_ENABLE_RAMFUNC places the U(S)ART and rx DMA interrupt
+handlers (including FS_STM32F4xxDMA's stream interrupt dispatch), the buffer
+push/pop functions and the service loop in the .ramfunc section, to run from
+SRAM free of flash wait states and ART cache misses. The linker script must
+load the section to flash and have the startup code copy it to RAM, most
+simply by including it in .data:
+
+  .data : { ... *(.ramfunc*) ... } >RAM AT> FLASH
+
+The OSAL lock, interrupt signal and critical section functions they call are
+placed there too. With FreeRTOS the kernel functions behind those still run
+from flash, as do the ST and C library functions the driver calls.
+
+FS_STM32F4XXUSART_ENABLE_TIMING_STATS measures the execution time of the same
+handlers and of each service pass with the DWT cycle counter, to show the
+effect (see FS_STM32F4xxUSART_GetTimingStats). Service pass figures include
+any time spent in interrupts which preempt it.
+
+FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS counts interrupts (each a potential
+CPU wake-up) and data moved by each U(S)ART, and measures every service pass
+with the DWT cycle counter, separating passes which moved data from idle ones
+(see FS_STM32F4xxUSART_GetActivityStats), as a basis for power profiling.
+*/
+
+// Conditions for FS_STM32F4xxUSART_Select, by port (FS_STM32F4xxUSART_Port_e).
+#define FS_STM32F4XXUSART_SELECT_READABLE(port) ( 0x000001u << (port) )
+#define FS_STM32F4XXUSART_SELECT_WRITABLE(port) ( 0x000100u << (port) )
+#define FS_STM32F4XXUSART_SELECT_ERROR(port)    ( 0x010000u << (port) )
+
+// Errors latched for FS_STM32F4xxUSART_GetErrors.
+#define FS_STM32F4XXUSART_ERROR_PARITY 0x01
+#define FS_STM32F4XXUSART_ERROR_FRAMING 0x02
+#define FS_STM32F4XXUSART_ERROR_NOISE 0x04
+#define FS_STM32F4XXUSART_ERROR_OVERRUN 0x08
+#define FS_STM32F4XXUSART_ERROR_RX_BUFFER_OVERFLOW 0x10
+
+/*------------------------------------------------------------------------------
+-------------------------- END PUBLIC DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
 /*------------------------------------------------------------------------------
 ---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
 ------------------------------------------------------------------------------*/
 
+// Identifies a U(S)ART for the driver's port-specific functions.
+typedef enum
+{
+  FS_STM32F4xxUSART_Port_USART1 = 0,
+  FS_STM32F4xxUSART_Port_USART2,
+  FS_STM32F4xxUSART_Port_USART3,
+  FS_STM32F4xxUSART_Port_UART4,
+  FS_STM32F4xxUSART_Port_UART5,
+  FS_STM32F4xxUSART_Port_USART6,
+  FS_STM32F4xxUSART_NumPorts
+
+}FS_STM32F4xxUSART_Port_e;
+
+// A contiguous run of bytes held in one of the driver's buffers.
+typedef struct
+{
+  const char * data;
+  uint16_t length;
+
+}FS_STM32F4xxUSART_Span_t;
+
+/*
+Payload sent to several U(S)ARTs by FS_STM32F4xxUSART_Broadcast. The data must
+stay valid and unchanged until release is called.
+*/
+typedef struct FS_STM32F4xxUSART_SharedBlock_s
+{
+  const char * data;
+  uint16_t length;
+
+  /*
+  Called once the last U(S)ART has sent the block, e.g. to return it to a
+  pool. May be NULL. Runs in the driver's service context, or in the caller's
+  if every U(S)ART has finished before FS_STM32F4xxUSART_Broadcast returns.
+  */
+  void(*release)(struct FS_STM32F4xxUSART_SharedBlock_s * block, void * ctx);
+  void * ctx;
+
+  // U(S)ARTs yet to finish sending the block - managed by the driver.
+  volatile uint8_t refCount;
+
+}FS_STM32F4xxUSART_SharedBlock_t;
+
+// Execution time of a piece of code, in core clock cycles.
+typedef struct
+{
+  uint32_t count;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+
+}FS_STM32F4xxUSART_CycleStats_t;
+
+typedef struct
+{
+  // All U(S)ART and rx DMA interrupt handlers.
+  FS_STM32F4xxUSART_CycleStats_t irq;
+
+  // Service passes (FS_STM32F4xxUSART_InitReturnsStruct_t service function).
+  FS_STM32F4xxUSART_CycleStats_t service;
+
+}FS_STM32F4xxUSART_TimingStats_t;
+
+// One U(S)ART's share of the driver's activity.
+typedef struct
+{
+  // Interrupts from the U(S)ART and its rx DMA stream, each of which may wake the CPU.
+  uint32_t interrupts;
+
+  // Service passes in which the U(S)ART moved data.
+  uint32_t usefulPasses;
+
+  uint32_t bytesReceived;
+  uint32_t bytesSent;
+
+}FS_STM32F4xxUSART_PortActivity_t;
+
+typedef struct
+{
+  FS_STM32F4xxUSART_PortActivity_t ports[FS_STM32F4xxUSART_NumPorts];
+
+  // Tx pacing timer interrupts, which wake the service function on behalf of paced U(S)ARTs.
+  uint32_t timerInterrupts;
+
+  /*
+  Service passes, and those in which no U(S)ART moved any data - wake-ups (or,
+  for a bare-metal main loop calling the service function, polls) which cost
+  power for nothing.
+  */
+  uint32_t passes;
+  uint32_t idlePasses;
+
+  // Core clock cycles spent in service passes, in total and in the longest.
+  uint64_t serviceCycles;
+  uint32_t maxPassCycles;
+
+  // OSAL ticks over which the figures were gathered, for working out rates and duty cycle.
+  FS_STM32F4xxOSAL_Ticks_t elapsedTicks;
+
+}FS_STM32F4xxUSART_ActivityStats_t;
+
+// Outcome of a baud rate check.
+typedef struct
+{
+  // The rate the U(S)ART was initialised with and the rate the peer is actually sending at.
+  uint32_t configuredBaud;
+  uint32_t measuredBaud;
+
+  /*
+  ( measured - configured ) / configured in parts per million. Framing errors
+  start to appear beyond about +/-20000 (2%) between two ends, counting both
+  ends' errors.
+  */
+  int32_t deviationPpm;
+
+  // Bit periods the measurement spans - the more, the less timing jitter matters. 0 if none could be timed.
+  uint32_t bitsMeasured;
+
+}FS_STM32F4xxUSART_BaudCheck_t;
+
+/*
+Faults to inject into a U(S)ART's received data, as probabilities per byte in
+units of 1/65536 (0 for none). Error faults latch the error for
+FS_STM32F4xxUSART_GetErrors and Select exactly as a real one would, but leave
+the byte itself intact - combine them with bit flips for corrupted data.
+*/
+typedef struct
+{
+  uint16_t framingError;
+  uint16_t noise;
+
+  // The byte is lost and an overrun latched.
+  uint16_t overrun;
+
+  // The byte is lost without trace.
+  uint16_t drop;
+
+  // One data bit of the byte, chosen at random, is inverted.
+  uint16_t bitFlip;
+
+  // Start of the pseudo-random sequence, so that runs can be repeated. Not 0.
+  uint32_t seed;
+
+}FS_STM32F4xxUSART_RxFaults_t;
+
+// Faults injected since FS_STM32F4xxUSART_SetRxFaults.
+typedef struct
+{
+  uint32_t framingErrors;
+  uint32_t noiseErrors;
+  uint32_t overruns;
+  uint32_t drops;
+  uint32_t bitFlips;
+
+}FS_STM32F4xxUSART_RxFaultStats_t;
+
 typedef struct
 {
   FS_DT_IOStream_t usart1;
@@ -71,17 +364,71 @@ typedef struct
   FS_STM32F4xxMuxablePin_t cts;
   FS_STM32F4xxMuxablePin_t sclk;
 
-  // Buffers.
+  // Buffers. In bytes, including for 9-bit U(S)ARTs (two bytes per frame).
   uint16_t txBufferSizeBytes;
   uint16_t rxBufferSizeBytes;
 
+  /*
+  Compress all tx data with the streaming LZSS compressor before it enters
+  the tx buffer (see FS_STM32F4xxUSARTCompress.h for the stream format).
+  Requires FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION to be defined in
+  FS_STM32F4xxUSART_Conf.h and costs a further
+  FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES of the master buffer. Writes return
+  0, sending nothing, unless the worst-case encoded size
+  (FS_STM32F4XXUSARTCOMPRESS_MAX_ENCODED_BYTES) fits in the tx buffer's free
+  space, as losing any of the stream would break decoding.
+  */
+  _Bool compressTx;
+
+  /*
+  Switch automatically between per-byte RXNE interrupts at low rx rates and
+  circular DMA into the rx buffer, with the line-idle interrupt, at high
+  rates. Requires FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX to be defined in
+  FS_STM32F4xxUSART_Conf.h. The U(S)ART's rx DMA stream is claimed from
+  FS_STM32F4xxDMA.h at init, which fails if no suitable stream is free.
+  Re-initialising a port first stops its stream, and fails if it won't stop.
+  */
+  _Bool adaptiveRx;
+
+  /*
+  Make a partial line - received data with no '\n' after it, such as a prompt -
+  readable as a line once the rx line has been silent for this many ticks, so
+  that line-oriented readers don't have to fall back to polling for bytes. The
+  end of each burst is picked up with the line-idle interrupt. 0 (the default)
+  leaves partial lines waiting for their '\n'. Not for 9-bit U(S)ARTs.
+  */
+  FS_STM32F4xxOSAL_Ticks_t partialLineTimeoutTicks;
+
+  /*
+  Tx pacing, for slow peripherals which need time between characters. Each
+  byte is followed by at least txByteGapUs microseconds of idle line, or
+  txFrameGapUs after a byte equal to txFrameEnd (8-bit U(S)ARTs only) - so a
+  frame gap without a byte gap spaces out '\n' terminated commands, say. The
+  gaps are timed by the service function against a hardware timer, so take no
+  task time; their precision is that of the service function's wake-up.
+  Requires FS_STM32F4XXUSART_ENABLE_TX_PACING to be defined in
+  FS_STM32F4xxUSART_Conf.h. 0 (the default) for both leaves tx unpaced.
+  */
+  uint16_t txByteGapUs;
+  uint16_t txFrameGapUs;
+  char txFrameEnd;
+
 }FS_STM32F4xxUSART_PeriphInitStruct_t;
 
 typedef struct
 {
   _Bool success;
+
+  // Task function for RTOS builds - blocks until a U(S)ART needs servicing.
   void(*mainLoop)(void * params);
 
+  /*
+  A single non-blocking service pass. For bare-metal builds, call this from
+  the application's main loop, e.g. after FS_STM32F4xxOSAL_SignalWait
+  returns or simply periodically to run the driver polled.
+  */
+  void(*service)(void);
+
 }FS_STM32F4xxUSART_InitReturnsStruct_t;
 
 typedef struct
@@ -115,6 +462,185 @@ void FS_STM32F4xxUSART_PeriphInitStructInit(FS_STM32F4xxUSART_PeriphInitStruct_t
 FS_STM32F4xxUSART_InitReturnsStruct_t
 FS_STM32F4xxUSART_Init(FS_STM32F4xxUSART_InitStruct_t * initStruct);
 
+/*
+Zero-copy access to received lines. RxPeekLine describes the first line in
+the rx buffer in place, split into two spans if it wraps around the end of the
+buffer, and returns its length including the '\n' (0 if no complete line has
+been received). The spans exclude the '\n'. If the buffer is full and holds no
+line ending, its entire contents are returned as a line without one, since no
+line could ever complete - as they are once partialLineTimeoutTicks has
+expired, if set. The spans remain valid until RxConsume is called,
+provided the rx buffer does not overflow in the meantime and, if adaptiveRx
+is set, the U(S)ART does not switch to DMA mode (which rotates the buffer).
+*/
+uint16_t FS_STM32F4xxUSART_RxPeekLine(FS_STM32F4xxUSART_Port_e port, FS_STM32F4xxUSART_Span_t spans[2]);
+uint16_t FS_STM32F4xxUSART_RxConsume(FS_STM32F4xxUSART_Port_e port, uint16_t numBytes);
+
+/*
+Block until a line - as readLine, readLineTruncate and RxPeekLine see it - can
+be read from an 8-bit U(S)ART, or until the timeout expires. Returns true if a
+line is ready. One task at a time may wait on each U(S)ART. Waiting relies on
+the service function running meanwhile, so bare-metal applications which call
+it from their own main loop should pass a timeout of 0 and simply poll.
+*/
+_Bool FS_STM32F4xxUSART_RxWaitLine(FS_STM32F4xxUSART_Port_e port, FS_STM32F4xxOSAL_Ticks_t timeout);
+
+/*
+9-bit data. A U(S)ART initialised with USART_WordLength_9b and USART_Parity_No
+carries nine data bits per frame, which its buffers hold as 16-bit elements -
+half as many as the configured buffer sizes in bytes. Such a U(S)ART is
+accessed through the functions below only: its FS_DT_IOStream_t functions,
+RxPeekLine and RxConsume all transfer nothing, and compressTx and adaptiveRx
+cannot be used with it. Bits above the ninth are ignored on write and read
+back as zero. The functions below transfer nothing on an 8-bit U(S)ART.
+*/
+uint16_t FS_STM32F4xxUSART_WriteWords(FS_STM32F4xxUSART_Port_e port, const uint16_t * words, uint16_t numWords);
+uint16_t FS_STM32F4xxUSART_ReadWords(FS_STM32F4xxUSART_Port_e port, uint16_t * buf, uint16_t numWords);
+uint16_t FS_STM32F4xxUSART_RxWordsAvailable(FS_STM32F4xxUSART_Port_e port);
+
+/*
+Append bytes to an 8-bit U(S)ART's rx buffer as though they had been received,
+for replaying captured traffic and the like. Returns the number of bytes
+written: 0 if the buffer is busy, the U(S)ART is receiving by DMA or the bytes
+would not fit in the buffer at all. As with received data, the oldest bytes are
+overwritten if the buffer overflows - except while an attached rx pipeline is
+reading them, when bytes which don't fit in the free space are refused (0) for
+now. Injected bytes are timestamped for the partial line timeout, wake
+FS_STM32F4xxUSART_RxWaitLine and FS_STM32F4xxUSART_Select and are passed to an
+attached rx pipeline just like received ones.
+*/
+uint16_t FS_STM32F4xxUSART_RxInject(FS_STM32F4xxUSART_Port_e port, const char * bytes, uint16_t numBytes);
+
+// Length of an 8-bit U(S)ART's rx buffer, the most RxInject takes at once. 0 if the port isn't one.
+uint16_t FS_STM32F4xxUSART_RxBufferLength(FS_STM32F4xxUSART_Port_e port);
+
+/*
+Attach a capture (see FS_STM32F4xxUSARTCapture.h) to record everything an 8-bit
+U(S)ART receives, or detach it with NULL. Returns false if the port is not in
+use, is a 9-bit port or FS_STM32F4XXUSART_ENABLE_RX_CAPTURE is not defined.
+*/
+struct FS_STM32F4xxUSARTCapture_s;
+_Bool FS_STM32F4xxUSART_SetRxCapture(FS_STM32F4xxUSART_Port_e port, struct FS_STM32F4xxUSARTCapture_s * capture);
+
+/*
+Attach a pipeline of rx processing stages (see FS_STM32F4xxUSARTPipeline.h) to
+an 8-bit U(S)ART, or detach it with NULL. While attached, the pipeline consumes
+everything received in the service context, so the U(S)ART's read functions
+find nothing. Returns false if the port is not in use, is a 9-bit port, has
+adaptiveRx set (its DMA stream could overwrite data the stages are reading) or
+FS_STM32F4XXUSART_ENABLE_RX_PIPELINE is not defined.
+*/
+struct FS_STM32F4xxUSARTPipeline_s;
+_Bool FS_STM32F4xxUSART_SetRxPipeline(FS_STM32F4xxUSART_Port_e port, struct FS_STM32F4xxUSARTPipeline_s * pipeline);
+
+/*
+Block until any of the given conditions (FS_STM32F4XXUSART_SELECT_READABLE etc.
+ORed together) holds, or until the timeout expires, and return those which
+hold - 0 on timeout. Readable means the rx buffer holds data, writable that the
+tx buffer has FS_STM32F4XXUSART_SELECT_WRITABLE_BYTES free and error that
+errors are latched (see FS_STM32F4xxUSART_GetErrors). Conditions are checked
+on entry, so one which already holds returns immediately; the driver's service
+path wakes callers as they change. As with RxWaitLine, bare-metal applications
+which run the service function from their own main loop should pass a timeout
+of 0.
+*/
+uint32_t FS_STM32F4xxUSART_Select(uint32_t conditions, FS_STM32F4xxOSAL_Ticks_t timeout);
+
+/*
+Return and clear the errors (FS_STM32F4XXUSART_ERROR_...) latched for a
+U(S)ART since the last call. Hardware errors are those seen by the interrupt
+handler, so are not reported for bytes received by DMA.
+*/
+uint8_t FS_STM32F4xxUSART_GetErrors(FS_STM32F4xxUSART_Port_e port);
+
+/*
+Send the same block on several 8-bit U(S)ARTs without copying it into their tx
+buffers. Each U(S)ART queues a reference to the block and its tx path streams
+from it directly, after whatever was written to it beforehand and before
+whatever is written afterwards. The block is released when the last U(S)ART
+has sent it. A U(S)ART is skipped if it is not in use, is a 9-bit port,
+compresses its tx data or already has FS_STM32F4XXUSART_TX_BROADCAST_DEPTH
+blocks queued. Returns the number of U(S)ARTs the block was queued on - if 0,
+it will never be released and remains the caller's. Always 0 unless
+FS_STM32F4XXUSART_ENABLE_TX_BROADCAST is defined.
+*/
+uint8_t FS_STM32F4xxUSART_Broadcast(FS_STM32F4xxUSART_SharedBlock_t * block,
+                                    const FS_STM32F4xxUSART_Port_e * ports,
+                                    uint8_t numPorts);
+
+/*
+Baud rate check, for diagnosing framing errors. Measures the bit period the
+peer is actually sending at by timestamping edges on the rx pin. Each edge is
+timed from the start bit of its character, so the measurement needs the line
+to have been idle for at least a character time once after the start, and
+traffic with some transitions within characters. The check stops by itself
+after FS_STM32F4XXUSART_BAUD_CHECK_EDGES edges.
+
+Where the rx pin has a timer input capture channel, the timer captures both
+edges and the times are exact to a timer clock:
+
+  PA10 (USART1)  TIM1 channel 3
+  PB7  (USART1)  TIM4 channel 2
+  PA3  (USART2)  TIM2 channel 4, else TIM5 channel 4, else TIM9 channel 2
+  PB11 (USART3)  TIM2 channel 4
+  PA1  (UART4)   TIM2 channel 2, else TIM5 channel 2
+  PC7  (USART6)  TIM3 channel 2, else TIM8 channel 2
+
+A timer is passed over if it is the tx pacing timer or another port's check
+has it. For the duration of the check the pin is switched to the timer, so the
+U(S)ART receives nothing, and the timer is taken over - it must not be in use
+otherwise. The application must enable the timer's capture interrupt in the
+NVIC and call BaudCheckEdge from its handler. An edge lost because the handler
+didn't read the previous capture in time is detected, and timing resumes from
+the next start bit.
+
+On other pins (PC11, PD2, PD6, PD9, PG9), or with no channel free, the edges
+are timestamped with the DWT cycle counter through an EXTI line on the pin
+(EXTI line n for pin n, both edges), which adds the interrupt's latency to
+every edge - so the check is limited to FS_STM32F4XXUSART_BAUD_CHECK_EXTI_MAX_BAUD. EXTI interrupt handlers
+are shared between pins, so are left to the application: it must enable the
+EXTI line's interrupt in the NVIC and call BaudCheckEdge from its handler when
+the line's pending bit is set, at a priority high enough for the edges to be
+timed promptly. No other pin may use the same EXTI line during the check.
+
+BaudCheckStart returns false if the port is not in use, a check is already
+running, the rx pin has no free capture channel and the baud rate is above
+FS_STM32F4XXUSART_BAUD_CHECK_EXTI_MAX_BAUD, or FS_STM32F4XXUSART_ENABLE_BAUD_CHECK
+is not defined. BaudCheckResult returns false until a check is complete.
+*/
+_Bool FS_STM32F4xxUSART_BaudCheckStart(FS_STM32F4xxUSART_Port_e port);
+void FS_STM32F4xxUSART_BaudCheckEdge(FS_STM32F4xxUSART_Port_e port);
+_Bool FS_STM32F4xxUSART_BaudCheckResult(FS_STM32F4xxUSART_Port_e port, FS_STM32F4xxUSART_BaudCheck_t * result);
+
+/*
+Fault injection, for measuring how the driver and the protocol layers above
+it hold up. SetRxFaults starts injecting the given faults into the bytes a
+U(S)ART receives (not those received by DMA or injected with RxInject), in the
+service context, or stops with NULL. An attached capture records the bytes as
+they arrived, before any faults. SetBaudSkew runs the U(S)ART's baud rate
+generator the given number of parts per million fast (or slow, if negative),
+within +/-100000, affecting both directions as a drifting clock would - 0
+restores the configured rate. Apply it while the line is idle. All return
+false if the port is not in use or FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION is
+not defined.
+*/
+_Bool FS_STM32F4xxUSART_SetRxFaults(FS_STM32F4xxUSART_Port_e port, const FS_STM32F4xxUSART_RxFaults_t * faults);
+_Bool FS_STM32F4xxUSART_GetRxFaultStats(FS_STM32F4xxUSART_Port_e port, FS_STM32F4xxUSART_RxFaultStats_t * stats);
+_Bool FS_STM32F4xxUSART_SetBaudSkew(FS_STM32F4xxUSART_Port_e port, int32_t ppm);
+
+/*
+Copy out the timing statistics, optionally starting a new measurement.
+maxCycles - minCycles is the jitter. Returns false unless
+FS_STM32F4XXUSART_ENABLE_TIMING_STATS is defined.
+*/
+_Bool FS_STM32F4xxUSART_GetTimingStats(FS_STM32F4xxUSART_TimingStats_t * stats, _Bool reset);
+
+/*
+Copy out the activity statistics, optionally starting a new measurement.
+Returns false unless FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS is defined.
+*/
+_Bool FS_STM32F4xxUSART_GetActivityStats(FS_STM32F4xxUSART_ActivityStats_t * stats, _Bool reset);
+
 /*------------------------------------------------------------------------------
 --------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
 ------------------------------------------------------------------------------*/
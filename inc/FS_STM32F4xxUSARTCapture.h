@@ -0,0 +1,181 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_STM32F4xxUSARTCapture.h
+ *
+ * @brief Recording and replay of timestamped U(S)ART rx traffic.
+ *
+ *        A capture attached to a U(S)ART with FS_STM32F4xxUSART_SetRxCapture
+ *        records everything received, in the chunks the driver moves it in,
+ *        into an application supplied block of memory. Once dumped (over
+ *        another port, by the debugger etc.) the capture can be loaded back
+ *        into a target and replayed into a U(S)ART's rx buffer with its
+ *        original timing, so that changes to the driver or to the parsers
+ *        above it can be measured against real traffic.
+ *
+ *        Recording requires FS_STM32F4XXUSART_ENABLE_RX_CAPTURE to be defined
+ *        in FS_STM32F4xxUSART_Conf.h. Replay goes through
+ *        FS_STM32F4xxUSART_RxInject and works in any build.
+ *
+ *        Capture format, all fields little-endian:
+ *
+ *          Header:  "FSRX", version (1 byte), 3 reserved bytes (zero),
+ *                   timestamp clock rate in Hz (4 bytes).
+ *          Records: timestamp relative to the start of the capture (4 bytes),
+ *                   length (2 bytes), received bytes.
+ *
+ *        A record's timestamp is taken when the driver picks the bytes up,
+ *        so the timing resolution is that of the clock or the driver's
+ *        service latency, whichever is coarser.
+ *
+ * @author Andy Norris [andy@firmwaresavvy.com]
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_STM32F4XXUSARTCAPTURE_H
+#define FS_STM32F4XXUSARTCAPTURE_H
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// C standard library includes.
+#include <stdint.h>
+
+// FS library includes.
+#include "FS_STM32F4xxUSART.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PUBLIC DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+#define FS_STM32F4XXUSARTCAPTURE_VERSION 1
+
+/*
+Replay feeds records to FS_STM32F4xxUSART_RxInject in pieces of at most this
+many bytes (or the target's rx buffer length if smaller), so that records as
+long as the rx buffer - as DMA mode produces - still go in. The default may
+be overridden in FS_STM32F4xxUSART_Conf.h.
+*/
+#ifndef FS_STM32F4XXUSARTCAPTURE_REPLAY_CHUNK_BYTES
+#define FS_STM32F4XXUSARTCAPTURE_REPLAY_CHUNK_BYTES 16
+#endif
+
+#define FS_STM32F4XXUSARTCAPTURE_HEADER_BYTES 12
+#define FS_STM32F4XXUSARTCAPTURE_RECORD_HEADER_BYTES 6
+
+/*------------------------------------------------------------------------------
+-------------------------- END PUBLIC DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Timestamp source, e.g. FS_STM32F4xxOSAL_GetTicks, or a function reading the
+DWT cycle counter for finer resolution. Must wrap at 2^32.
+*/
+typedef uint32_t(*FS_STM32F4xxUSARTCapture_Clock_t)(void);
+
+// Tagged so that FS_STM32F4xxUSART.h can refer to it without including this header.
+typedef struct FS_STM32F4xxUSARTCapture_s
+{
+  // Capture memory, its size and how much of it has been used.
+  uint8_t * data;
+  uint32_t size;
+  uint32_t length;
+
+  FS_STM32F4xxUSARTCapture_Clock_t clock;
+  uint32_t startTime;
+
+  // Bytes received after the capture memory filled up.
+  uint32_t droppedBytes;
+
+}FS_STM32F4xxUSARTCapture_t;
+
+typedef struct
+{
+  // The U(S)ART whose rx buffer is fed.
+  FS_STM32F4xxUSART_Port_e port;
+
+  // The capture, the offset of the next record to replay and how much of it has gone in.
+  const uint8_t * data;
+  uint32_t length;
+  uint32_t offset;
+  uint16_t recordSent;
+
+  FS_STM32F4xxUSARTCapture_Clock_t clock;
+  uint32_t startTime;
+
+  // Worst delay between a record falling due and being fed to the driver.
+  uint32_t maxLateness;
+
+}FS_STM32F4xxUSARTCapture_Replay_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Start a capture in the given memory, writing its header. Time zero is the
+moment of this call. Returns false if the memory can't hold the header.
+*/
+_Bool FS_STM32F4xxUSARTCapture_Init(FS_STM32F4xxUSARTCapture_t * capture,
+                                    uint8_t * mem,
+                                    uint32_t size,
+                                    FS_STM32F4xxUSARTCapture_Clock_t clock,
+                                    uint32_t clockHz);
+
+/*
+Append a record. Called by the driver for an attached capture. Once a record
+no longer fits, it and everything after it are counted in droppedBytes, so
+the capture always holds an unbroken prefix of the traffic.
+*/
+void FS_STM32F4xxUSARTCapture_Record(FS_STM32F4xxUSARTCapture_t * capture,
+                                     const char * bytes,
+                                     uint16_t numBytes);
+
+// Bytes of capture memory in use, i.e. how much to dump.
+uint32_t FS_STM32F4xxUSARTCapture_Length(FS_STM32F4xxUSARTCapture_t * capture);
+
+/*
+Prepare to replay a capture into a U(S)ART's rx buffer. The clock must run at
+the rate recorded in the capture's header. Returns false if the header is not
+valid or the rates differ. Time zero is the moment of this call.
+*/
+_Bool FS_STM32F4xxUSARTCapture_ReplayInit(FS_STM32F4xxUSARTCapture_Replay_t * replay,
+                                          FS_STM32F4xxUSART_Port_e port,
+                                          const uint8_t * data,
+                                          uint32_t length,
+                                          FS_STM32F4xxUSARTCapture_Clock_t clock,
+                                          uint32_t clockHz);
+
+/*
+Feed every record which has fallen due to the driver. Call as often as the
+timing needs to be reproduced - the worst lateness seen is kept in
+maxLateness. Returns false once the whole capture has been replayed, or
+straight away if the port can't take injected data at all (not in use, or
+9-bit). A port receiving by DMA takes nothing until it drops back to per-byte
+mode, so replay waits for that.
+*/
+_Bool FS_STM32F4xxUSARTCapture_ReplayPoll(FS_STM32F4xxUSARTCapture_Replay_t * replay);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+#endif // FS_STM32F4XXUSARTCAPTURE_H
@@ -0,0 +1,160 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_STM32F4xxUSARTCompress.h
+ *
+ * @brief Streaming LZSS compressor/decompressor for U(S)ART tx streams.
+ *
+ *        This module has no dependency on the ST library or on FreeRTOS so
+ *        that the decoder can be built into host tools unchanged.
+ *
+ *        Stream format:
+ *
+ *        The compressed stream is a sequence of groups. Each group starts
+ *        with a flag byte followed by up to eight items, the least significant
+ *        flag bit describing the first item. A clear bit denotes a literal
+ *        (one byte). A set bit denotes a back-reference (two bytes: distance
+ *        back into the window, 1 to 255, followed by match length minus 3).
+ *
+ *        A back-reference with a distance of zero terminates the current
+ *        group early. The encoder emits one at the end of every flushing call
+ *        which leaves a group part-filled so that each write is
+ *        self-delimiting on the wire and nothing is held back waiting for
+ *        more input.
+ *
+ *        Both ends start with a zeroed window.
+ *
+ * @author Andy Norris [andy@firmwaresavvy.com]
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_STM32F4XXUSARTCOMPRESS_H
+#define FS_STM32F4XXUSARTCOMPRESS_H
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// C standard library includes.
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PUBLIC DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+// History window length. Fixed so that distances fit in a single byte.
+#define FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES 256
+
+// Shortest back-reference worth emitting and the longest that can be encoded.
+#define FS_STM32F4XXUSARTCOMPRESS_MIN_MATCH 3
+#define FS_STM32F4XXUSARTCOMPRESS_MAX_MATCH ( FS_STM32F4XXUSARTCOMPRESS_MIN_MATCH + 255 )
+
+// Number of items described by each flag byte, and a group's size at most.
+#define FS_STM32F4XXUSARTCOMPRESS_ITEMS_PER_GROUP 8
+#define FS_STM32F4XXUSARTCOMPRESS_MAX_GROUP_BYTES ( 1 + ( FS_STM32F4XXUSARTCOMPRESS_ITEMS_PER_GROUP * 2 ) )
+
+/*
+Worst-case encoded size of n bytes passed to the encoder in one call, or in a
+run of calls ending with the only flush: every item a literal (9 bits per
+byte) plus a terminating back-reference.
+*/
+#define FS_STM32F4XXUSARTCOMPRESS_MAX_ENCODED_BYTES(n) \
+  ( (n) + ( ( (n) + 7 ) / 8 ) + 2 )
+
+/*------------------------------------------------------------------------------
+-------------------------- END PUBLIC DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+// Output function used by the encoder. Called with at most one group at a time.
+typedef void(*FS_STM32F4xxUSARTCompress_Sink_t)(void * ctx, const char * bytes, uint16_t numBytes);
+
+// Output function used by the decoder. Called once per decompressed byte.
+typedef void(*FS_STM32F4xxUSARTCompress_ByteSink_t)(void * ctx, char byte);
+
+typedef struct
+{
+  // History window - must be FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES long.
+  char * window;
+
+  // Window position at which the next byte will be stored.
+  uint8_t windowPos;
+
+  // Group left part-filled by a call without flush, for the next call to continue.
+  char group[FS_STM32F4XXUSARTCOMPRESS_MAX_GROUP_BYTES];
+  uint8_t groupLength;
+  uint8_t items;
+
+}FS_STM32F4xxUSARTCompress_Encoder_t;
+
+typedef struct
+{
+  // History window - must be FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES long.
+  char * window;
+
+  // Window position at which the next byte will be stored.
+  uint8_t windowPos;
+
+  // Flag byte of the group currently being decoded, shifted as items are consumed.
+  uint8_t flags;
+
+  // Number of items remaining in the current group.
+  uint8_t itemsRemaining;
+
+  // Set when the first byte (distance) of a back-reference has been consumed.
+  _Bool haveDistance;
+  uint8_t distance;
+
+}FS_STM32F4xxUSARTCompress_Decoder_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+void FS_STM32F4xxUSARTCompress_EncoderInit(FS_STM32F4xxUSARTCompress_Encoder_t * encoder,
+                                           char * window);
+
+/*
+Compress bytes, passing each complete group to the sink. With flush, a
+part-filled group is closed off and passed on too; without, it is kept for the
+next call, so that several pieces of one write (a line and its terminator,
+say) share groups and a single terminator. A call without flush must be
+followed by more calls before any other use of the encoder's output.
+*/
+uint16_t FS_STM32F4xxUSARTCompress_Encode(FS_STM32F4xxUSARTCompress_Encoder_t * encoder,
+                                          const char * bytes,
+                                          uint16_t numBytes,
+                                          _Bool flush,
+                                          FS_STM32F4xxUSARTCompress_Sink_t sink,
+                                          void * sinkCtx);
+
+void FS_STM32F4xxUSARTCompress_DecoderInit(FS_STM32F4xxUSARTCompress_Decoder_t * decoder,
+                                           char * window);
+
+void FS_STM32F4xxUSARTCompress_Decode(FS_STM32F4xxUSARTCompress_Decoder_t * decoder,
+                                      const char * bytes,
+                                      uint32_t numBytes,
+                                      FS_STM32F4xxUSARTCompress_ByteSink_t sink,
+                                      void * sinkCtx);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+#endif // FS_STM32F4XXUSARTCOMPRESS_H
@@ -0,0 +1,194 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_STM32F4xxUSARTPipeline.h
+ *
+ * @brief Chains of incremental processing stages on U(S)ART rx data.
+ *
+ *        A pipeline attached to a U(S)ART with FS_STM32F4xxUSART_SetRxPipeline
+ *        is given everything the U(S)ART receives, in the driver's service
+ *        context, and consumes it from the rx buffer - the pipeline takes the
+ *        place of the application's reads. Data is passed to the first stage
+ *        as spans pointing straight into the rx buffer, with no copying.
+ *
+ *        Each stage consumes spans and passes on spans of its own - parts of
+ *        its input, or data it has assembled - to the next with
+ *        FS_STM32F4xxUSARTPipeline_Emit, which calls the next stage's process
+ *        function directly. So a filter, de-framer, checksum and parser run
+ *        one after the other on the same bytes, and only a stage which has to
+ *        hold data across calls (a de-framer whose frame straddles two
+ *        service passes, say) copies anything. Stages report what they find -
+ *        complete messages, errors - with FS_STM32F4xxUSARTPipeline_Event.
+ *
+ *        Spans are only valid for the duration of the process call. Stages
+ *        run without the rx buffer's mutex held, so interrupts stay enabled
+ *        under the bare-metal OSAL, but nothing else may read from the
+ *        U(S)ART while a pipeline is attached, the stages included.
+ *        FS_STM32F4xxUSART_RxInject refuses data which would overwrite what
+ *        the stages are reading, and U(S)ARTs with adaptive rx, whose DMA
+ *        stream writes into the rx buffer directly, can't have a pipeline. Stages should be quick: the service function
+ *        moves no data for any U(S)ART while they run.
+ *
+ *        Requires FS_STM32F4XXUSART_ENABLE_RX_PIPELINE to be defined in
+ *        FS_STM32F4xxUSART_Conf.h.
+ *
+ * @author Andy Norris [andy@firmwaresavvy.com]
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_STM32F4XXUSARTPIPELINE_H
+#define FS_STM32F4XXUSARTPIPELINE_H
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// C standard library includes.
+#include <stdint.h>
+
+// FS library includes.
+#include "FS_STM32F4xxUSART.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PUBLIC DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+// Events reported by the line framer stage.
+#define FS_STM32F4XXUSARTPIPELINE_EVENT_LINE_TOO_LONG 0x0100
+
+/*------------------------------------------------------------------------------
+-------------------------- END PUBLIC DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+struct FS_STM32F4xxUSARTPipeline_s;
+struct FS_STM32F4xxUSARTPipeline_Stage_s;
+
+/*
+Process the next span of a stage's input. Called with spans in order, of any
+length from 1 byte up.
+*/
+typedef void(*FS_STM32F4xxUSARTPipeline_Process_t)(struct FS_STM32F4xxUSARTPipeline_Stage_s * stage,
+                                                   const char * data,
+                                                   uint16_t length);
+
+/*
+Receives the events of all of a pipeline's stages. The meaning of event, data
+and length is up to the stage reporting it; data is only valid for the
+duration of the call.
+*/
+typedef void(*FS_STM32F4xxUSARTPipeline_EventHandler_t)(void * ctx,
+                                                        struct FS_STM32F4xxUSARTPipeline_Stage_s * stage,
+                                                        uint16_t event,
+                                                        const void * data,
+                                                        uint16_t length);
+
+typedef struct FS_STM32F4xxUSARTPipeline_Stage_s
+{
+  // Set by the application.
+  FS_STM32F4xxUSARTPipeline_Process_t process;
+  void * ctx;
+
+  // Set by FS_STM32F4xxUSARTPipeline_Init. next is NULL for the last stage.
+  struct FS_STM32F4xxUSARTPipeline_Stage_s * next;
+  struct FS_STM32F4xxUSARTPipeline_s * pipeline;
+
+}FS_STM32F4xxUSARTPipeline_Stage_t;
+
+// Tagged so that FS_STM32F4xxUSART.h can refer to it without including this header.
+typedef struct FS_STM32F4xxUSARTPipeline_s
+{
+  FS_STM32F4xxUSARTPipeline_Stage_t * stages;
+  uint8_t numStages;
+
+  FS_STM32F4xxUSARTPipeline_EventHandler_t eventHandler;
+  void * eventCtx;
+
+  // Bytes fed into the first stage.
+  uint32_t bytesIn;
+
+}FS_STM32F4xxUSARTPipeline_t;
+
+/*
+Context for the line framer stage (FS_STM32F4xxUSARTPipeline_LineFramer),
+which passes on each '\n' terminated line, without the '\n' (empty lines are
+skipped, since empty spans are never passed on). A line lying
+wholly within one input span is passed on in place; one split across spans is
+assembled in the buffer first. Lines longer than the buffer are truncated to
+its size and reported with FS_STM32F4XXUSARTPIPELINE_EVENT_LINE_TOO_LONG
+(data NULL, length the number of bytes dropped, saturating).
+*/
+typedef struct
+{
+  char * buffer;
+  uint16_t size;
+
+  // Managed by the stage - start at 0.
+  uint16_t length;
+  uint16_t droppedBytes;
+
+}FS_STM32F4xxUSARTPipeline_LineFramer_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Chain the given stages, in array order. Each stage's process and ctx must
+already be set. eventHandler may be NULL. Returns false if there are no
+stages or one has no process function.
+*/
+_Bool FS_STM32F4xxUSARTPipeline_Init(FS_STM32F4xxUSARTPipeline_t * pipeline,
+                                     FS_STM32F4xxUSARTPipeline_Stage_t * stages,
+                                     uint8_t numStages,
+                                     FS_STM32F4xxUSARTPipeline_EventHandler_t eventHandler,
+                                     void * eventCtx);
+
+/*
+Feed a span into the first stage. Called by the driver for an attached
+pipeline, and usable directly to run a pipeline on data from elsewhere.
+*/
+void FS_STM32F4xxUSARTPipeline_Feed(FS_STM32F4xxUSARTPipeline_t * pipeline,
+                                    const char * data,
+                                    uint16_t length);
+
+// For use by stages: pass a span on to the next stage. Output from the last stage is dropped.
+void FS_STM32F4xxUSARTPipeline_Emit(FS_STM32F4xxUSARTPipeline_Stage_t * stage,
+                                    const char * data,
+                                    uint16_t length);
+
+// For use by stages: report an event to the pipeline's event handler.
+void FS_STM32F4xxUSARTPipeline_Event(FS_STM32F4xxUSARTPipeline_Stage_t * stage,
+                                     uint16_t event,
+                                     const void * data,
+                                     uint16_t length);
+
+/*
+Line framer stage, for a stage's process function with ctx pointing to an
+FS_STM32F4xxUSARTPipeline_LineFramer_t whose buffer and size are set.
+*/
+void FS_STM32F4xxUSARTPipeline_LineFramer(FS_STM32F4xxUSARTPipeline_Stage_t * stage,
+                                          const char * data,
+                                          uint16_t length);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+#endif // FS_STM32F4XXUSARTPIPELINE_H
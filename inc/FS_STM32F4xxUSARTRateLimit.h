@@ -0,0 +1,109 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_STM32F4xxUSARTRateLimit.h
+ *
+ * @brief Per-stream token bucket rate limiting for U(S)ART output.
+ *
+ *        Several producers sharing one U(S)ART each write through their own
+ *        logical stream. Each stream has a bucket holding up to 'burst'
+ *        messages which refills at 'messagesPerSecond'. Messages arriving to
+ *        an empty bucket are dropped and, if the stream is configured to
+ *        summarise, counted and reported as a single "N messages suppressed"
+ *        line ahead of the stream's next message to get through.
+ *
+ * @author Andy Norris [andy@firmwaresavvy.com]
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_STM32F4XXUSARTRATELIMIT_H
+#define FS_STM32F4XXUSARTRATELIMIT_H
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// FS library includes.
+#include "FS_STM32F4xxUSART.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef struct
+{
+  // Prefixed to the suppression summary. May be NULL.
+  const char * name;
+
+  // Sustained rate and bucket depth, both in messages.
+  uint16_t messagesPerSecond;
+  uint16_t burst;
+
+  // Report dropped messages with a summary line rather than dropping them silently.
+  _Bool summarise;
+
+  // Bucket state - managed by the module.
+  uint32_t credit;
+  uint32_t lastRefillTicks;
+
+  // Drops not yet reported, and all drops since initialisation.
+  uint32_t suppressed;
+  uint32_t dropped;
+
+}FS_STM32F4xxUSARTRateLimit_Stream_t;
+
+typedef struct
+{
+  // The stream all output is written to once it has passed the limiter.
+  FS_DT_IOStream_t * output;
+
+  // Application supplied stream table, indexed by stream ID.
+  FS_STM32F4xxUSARTRateLimit_Stream_t * streams;
+  uint8_t numStreams;
+
+}FS_STM32F4xxUSARTRateLimit_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Set up a limiter. The name, rate, burst and summarise members of each stream
+must be filled in beforehand - every bucket starts full.
+*/
+void FS_STM32F4xxUSARTRateLimit_Init(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                                     FS_DT_IOStream_t * output,
+                                     FS_STM32F4xxUSARTRateLimit_Stream_t * streams,
+                                     uint8_t numStreams);
+
+// As the FS_DT_IOStream_t write functions. Return 0 if the message was suppressed.
+uint16_t FS_STM32F4xxUSARTRateLimit_WriteBytes(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                                               uint8_t streamId,
+                                               const char * bytes,
+                                               uint16_t numBytes);
+
+uint16_t FS_STM32F4xxUSARTRateLimit_WriteLine(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                                              uint8_t streamId,
+                                              const char * line);
+
+// Total messages dropped on a stream since initialisation, including those already reported.
+uint32_t FS_STM32F4xxUSARTRateLimit_GetDropped(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                                               uint8_t streamId);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+#endif // FS_STM32F4XXUSARTRATELIMIT_H
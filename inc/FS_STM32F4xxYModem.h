@@ -0,0 +1,219 @@
+/**
+ *******************************************************************************
+ *
+ * @file  FS_STM32F4xxYModem.h
+ *
+ * @brief YMODEM (batch) and XMODEM-1K receiver for firmware images.
+ *
+ *        Runs over any FS_DT_IOStream_t, normally a U(S)ART of this driver.
+ *        Verified blocks (CRC-16) are received straight into a write-ahead
+ *        queue of 1 KB slots supplied by the application and handed to a
+ *        pluggable sink - a flash writer, say - from there. Nothing larger
+ *        than the queue is ever buffered.
+ *
+ *        A block is acknowledged as soon as it is queued, so the sender can
+ *        transmit the next block while the sink is still writing earlier
+ *        ones. Only when the queue is full is the acknowledgement held back
+ *        until the sink catches up. A queue depth of 1 gives the classic
+ *        lock-step behaviour.
+ *
+ *        The protocol side (FS_STM32F4xxYModem_Poll) and the sink side
+ *        (FS_STM32F4xxYModem_ServiceSink) may be called from the same loop
+ *        or from different tasks, e.g. so that a flash erase doesn't stall
+ *        the protocol.
+ *
+ *        A transfer starting with block 1 rather than a block 0 header is
+ *        taken as XMODEM-1K (or XMODEM-CRC): the sink is given no file name
+ *        or size and the session ends with the file.
+ *
+ * @author Andy Norris [andy@firmwaresavvy.com]
+ *
+ *******************************************************************************
+ */
+
+// Preprocessor guard.
+#ifndef FS_STM32F4XXYMODEM_H
+#define FS_STM32F4XXYMODEM_H
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// C standard library includes.
+#include <stdint.h>
+
+// FS library includes.
+#include "FS_DT_Conf.h"
+#include "FS_STM32F4xxOSAL.h"
+
+// Project must supply this header - any overrides of the settings below go in it.
+#include "FS_STM32F4xxUSART_Conf.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PUBLIC DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Defaults for the settings below may be overridden in FS_STM32F4xxUSART_Conf.h.
+*/
+
+// Interval between invitations ('C') to a sender to start.
+#ifndef FS_STM32F4XXYMODEM_START_INTERVAL_TICKS
+#define FS_STM32F4XXYMODEM_START_INTERVAL_TICKS ( 3 * FS_STM32F4XXOSAL_TICK_RATE_HZ )
+#endif
+
+// Longest gap allowed between two bytes of a block.
+#ifndef FS_STM32F4XXYMODEM_BYTE_TIMEOUT_TICKS
+#define FS_STM32F4XXYMODEM_BYTE_TIMEOUT_TICKS ( 1 * FS_STM32F4XXOSAL_TICK_RATE_HZ )
+#endif
+
+// Longest wait for the next block once a transfer has started.
+#ifndef FS_STM32F4XXYMODEM_BLOCK_TIMEOUT_TICKS
+#define FS_STM32F4XXYMODEM_BLOCK_TIMEOUT_TICKS ( 10 * FS_STM32F4XXOSAL_TICK_RATE_HZ )
+#endif
+
+// Consecutive errors/timeouts (or start invitations) before giving up.
+#ifndef FS_STM32F4XXYMODEM_MAX_ERRORS
+#define FS_STM32F4XXYMODEM_MAX_ERRORS 10
+#endif
+
+#define FS_STM32F4XXYMODEM_BLOCK_BYTES 1024
+
+/*------------------------------------------------------------------------------
+-------------------------- END PUBLIC DEFINITIONS ------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+---------------------- START PUBLIC TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef enum
+{
+  FS_STM32F4xxYModem_Status_Busy = 0,
+
+  // Every file has been received and written.
+  FS_STM32F4xxYModem_Status_Complete,
+
+  // The sender cancelled the transfer.
+  FS_STM32F4xxYModem_Status_Cancelled,
+
+  // Too many errors, a protocol violation or a sink failure. The sender has been cancelled.
+  FS_STM32F4xxYModem_Status_Failed
+
+}FS_STM32F4xxYModem_Status_e;
+
+/*
+Destination for received files. All functions return false on failure, which
+cancels the transfer.
+*/
+typedef struct
+{
+  /*
+  A file is starting. name is NULL and size 0 for XMODEM, otherwise size is
+  that sent by the sender (0 if it didn't send one). name is only valid for
+  the duration of the call.
+  */
+  _Bool(*begin)(void * ctx, const char * name, uint32_t size);
+
+  /*
+  Write a block at the given offset into the file. Blocks arrive in order. The
+  last is trimmed to the file size if known, otherwise includes the sender's
+  padding.
+  */
+  _Bool(*write)(void * ctx, uint32_t offset, const uint8_t * data, uint16_t length);
+
+  /*
+  The file is complete (success true), or the transfer has been abandoned, in
+  which case any blocks still queued have been discarded.
+  */
+  _Bool(*end)(void * ctx, _Bool success);
+
+  void * ctx;
+
+}FS_STM32F4xxYModem_Sink_t;
+
+// A write-ahead queue slot.
+typedef struct
+{
+  uint32_t offset;
+  uint16_t length;
+  uint8_t data[FS_STM32F4XXYMODEM_BLOCK_BYTES];
+
+}FS_STM32F4xxYModem_Block_t;
+
+typedef struct
+{
+  FS_DT_IOStream_t * stream;
+  FS_STM32F4xxYModem_Sink_t sink;
+
+  // Application supplied write-ahead queue.
+  FS_STM32F4xxYModem_Block_t * blocks;
+  uint8_t depth;
+
+  // Protocol and queue state - managed by the module.
+  volatile uint8_t queueHead;
+  uint8_t queueTail;
+  volatile uint8_t queueCount;
+  volatile _Bool sinkFailed;
+
+  volatile uint8_t state;
+  FS_STM32F4xxYModem_Status_e status;
+  _Bool batch;
+  _Bool inFile;
+  _Bool eotReceived;
+  _Bool started;
+  uint8_t expectedSeq;
+  uint8_t errors;
+  uint8_t cancels;
+
+  // The block being received - header and CRC here, data in a queue slot.
+  uint8_t header[3];
+  uint8_t crc[2];
+  uint16_t frameBytes;
+  uint16_t dataLength;
+
+  uint32_t fileSize;
+  uint32_t fileOffset;
+  FS_STM32F4xxOSAL_Ticks_t lastActivityTicks;
+
+}FS_STM32F4xxYModem_t;
+
+/*------------------------------------------------------------------------------
+----------------------- END PUBLIC TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Prepare to receive. Nothing is sent until the first call to Poll. Returns
+false if depth is 0 - the queue needs at least one block.
+*/
+_Bool FS_STM32F4xxYModem_Init(FS_STM32F4xxYModem_t * ym,
+                              FS_DT_IOStream_t * stream,
+                              const FS_STM32F4xxYModem_Sink_t * sink,
+                              FS_STM32F4xxYModem_Block_t * blocks,
+                              uint8_t depth);
+
+/*
+Run the protocol as far as the data received so far allows. Call repeatedly
+until the result is anything other than Busy.
+*/
+FS_STM32F4xxYModem_Status_e FS_STM32F4xxYModem_Poll(FS_STM32F4xxYModem_t * ym);
+
+// Hand the oldest queued block to the sink. Returns false if the queue was empty.
+_Bool FS_STM32F4xxYModem_ServiceSink(FS_STM32F4xxYModem_t * ym);
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+#endif // FS_STM32F4XXYMODEM_H
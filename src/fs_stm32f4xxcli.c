@@ -0,0 +1,454 @@
+/**
+ *******************************************************************************
+ *
+ * @file
+ *
+ * @brief Command line interpreter running on top of the U(S)ART driver.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_STM32F4xxCLI.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <string.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PRIVATE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+// FNV-1a parameters.
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+// Give up building the hash if a bucket can't be placed with any displacement up to this.
+#define MAX_DISPLACEMENT 0xFFFE
+
+/*------------------------------------------------------------------------------
+-------------------------- END PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+// Hashing.
+static uint32_t hashBytes(uint32_t hash, const char * data, uint16_t length);
+static uint32_t hashString(const char * str, uint32_t seed);
+static uint32_t hashToken(const FS_STM32F4xxCLI_Token_t * token, uint32_t seed);
+static _Bool placeBucket(FS_STM32F4xxCLI_t * cli, uint8_t bucket, uint16_t displacement);
+static const FS_STM32F4xxCLI_Command_t * lookup(FS_STM32F4xxCLI_t * cli,
+                                                const FS_STM32F4xxCLI_Token_t * token);
+
+// Tokenising.
+static uint8_t tokenise(const FS_STM32F4xxUSART_Span_t spans[2], FS_STM32F4xxCLI_Token_t * argv);
+static char charAt(const FS_STM32F4xxUSART_Span_t spans[2], uint16_t index);
+static _Bool isSeparator(char c);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+_Bool FS_STM32F4xxCLI_Init(FS_STM32F4xxCLI_t * cli,
+                           FS_STM32F4xxUSART_Port_e port,
+                           const FS_STM32F4xxCLI_Command_t * commands,
+                           uint8_t numCommands,
+                           FS_STM32F4xxCLI_Handler_t unknownCommandHandler,
+                           void * ctx)
+{
+  uint8_t bucketSize[FS_STM32F4XXCLI_HASH_BUCKETS];
+  _Bool bucketPlaced[FS_STM32F4XXCLI_HASH_BUCKETS];
+  uint8_t i, j, bucket, largest;
+  uint16_t displacement;
+
+  cli->port = port;
+  cli->commands = commands;
+  cli->numCommands = numCommands;
+  cli->unknownCommandHandler = unknownCommandHandler;
+  cli->ctx = ctx;
+
+  memset( cli->slot, 0, sizeof(cli->slot) );
+  memset( cli->displacement, 0, sizeof(cli->displacement) );
+
+  /*
+  Slots hold command index + 1. Duplicate names would always collide so would
+  otherwise only be discovered after trying every displacement.
+  */
+  if( ( numCommands > FS_STM32F4XXCLI_HASH_SLOTS ) || ( numCommands == 0xFF ) )
+  {
+    return false;
+  }
+
+  for(i = 0; i < numCommands; i++)
+  {
+    for(j = i + 1; j < numCommands; j++)
+    {
+      if( 0 == strcmp(commands[i].name, commands[j].name) )
+      {
+        return false;
+      }
+    }
+  }
+
+  // Distribute the names among the buckets.
+  memset( bucketSize, 0, sizeof(bucketSize) );
+  memset( bucketPlaced, 0, sizeof(bucketPlaced) );
+
+  for(i = 0; i < numCommands; i++)
+  {
+    bucketSize[hashString(commands[i].name, 0) % FS_STM32F4XXCLI_HASH_BUCKETS]++;
+  }
+
+  /*
+  Place the buckets largest first, finding for each a displacement which moves
+  all of its names into free slots. The small buckets left until last are easy
+  to fit into the gaps.
+  */
+  for(;;)
+  {
+    largest = 0;
+    bucket = 0;
+
+    for(i = 0; i < FS_STM32F4XXCLI_HASH_BUCKETS; i++)
+    {
+      if( !bucketPlaced[i] && ( bucketSize[i] > largest ) )
+      {
+        largest = bucketSize[i];
+        bucket = i;
+      }
+    }
+
+    // Every non-empty bucket has been placed.
+    if(0 == largest)
+    {
+      break;
+    }
+
+    for(displacement = 0; displacement <= MAX_DISPLACEMENT; displacement++)
+    {
+      if( placeBucket(cli, bucket, displacement) )
+      {
+        break;
+      }
+    }
+
+    if(displacement > MAX_DISPLACEMENT)
+    {
+      return false;
+    }
+
+    cli->displacement[bucket] = displacement;
+    bucketPlaced[bucket] = true;
+  }
+
+  return true;
+}
+
+uint16_t FS_STM32F4xxCLI_Poll(FS_STM32F4xxCLI_t * cli)
+{
+  FS_STM32F4xxUSART_Span_t spans[2];
+  FS_STM32F4xxCLI_Token_t argv[FS_STM32F4XXCLI_MAX_ARGS];
+  const FS_STM32F4xxCLI_Command_t * command;
+  uint16_t lineLength, linesHandled;
+  uint8_t argc;
+
+  linesHandled = 0;
+
+  while( 0 != ( lineLength = FS_STM32F4xxUSART_RxPeekLine(cli->port, spans) ) )
+  {
+    argc = tokenise(spans, argv);
+
+    // Blank lines are ignored.
+    if(argc)
+    {
+      command = lookup(cli, &( argv[0] ) );
+
+      if(NULL != command)
+      {
+        command->handler(argc, argv, cli->ctx);
+      }
+
+      else if(NULL != cli->unknownCommandHandler)
+      {
+        cli->unknownCommandHandler(argc, argv, cli->ctx);
+      }
+    }
+
+    // The tokens refer to the rx buffer so the line can only be dropped now.
+    FS_STM32F4xxUSART_RxConsume(cli->port, lineLength);
+    linesHandled++;
+  }
+
+  return linesHandled;
+}
+
+uint16_t FS_STM32F4xxCLI_TokenLength(const FS_STM32F4xxCLI_Token_t * token)
+{
+  return token->part[0].length + token->part[1].length;
+}
+
+_Bool FS_STM32F4xxCLI_TokenEquals(const FS_STM32F4xxCLI_Token_t * token, const char * str)
+{
+  size_t length;
+
+  length = strlen(str);
+
+  if( length != FS_STM32F4xxCLI_TokenLength(token) )
+  {
+    return false;
+  }
+
+  if( 0 != memcmp(token->part[0].data, str, token->part[0].length) )
+  {
+    return false;
+  }
+
+  // The second part is empty (and its data NULL) unless the token wraps.
+  return ( 0 == token->part[1].length ) ||
+         ( 0 == memcmp(token->part[1].data, &( str[token->part[0].length] ), token->part[1].length) );
+}
+
+uint16_t FS_STM32F4xxCLI_TokenCopy(const FS_STM32F4xxCLI_Token_t * token, char * buf, uint16_t bufLength)
+{
+  uint16_t length, firstLength;
+
+  if(0 == bufLength)
+  {
+    return 0;
+  }
+
+  // Leave room for the NULL terminator, truncating if necessary.
+  length = FS_STM32F4xxCLI_TokenLength(token);
+
+  if(length > ( bufLength - 1 ) )
+  {
+    length = bufLength - 1;
+  }
+
+  firstLength = ( length < token->part[0].length ) ? length : token->part[0].length;
+
+  memcpy(buf, token->part[0].data, firstLength);
+
+  if(length > firstLength)
+  {
+    memcpy( &( buf[firstLength] ), token->part[1].data, length - firstLength );
+  }
+
+  buf[length] = 0;
+
+  return length;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+// Continue an FNV-1a hash over a block of bytes.
+static uint32_t hashBytes(uint32_t hash, const char * data, uint16_t length)
+{
+  uint16_t i;
+
+  for(i = 0; i < length; i++)
+  {
+    hash ^= (uint8_t)data[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static uint32_t hashString(const char * str, uint32_t seed)
+{
+  return hashBytes( FNV_OFFSET_BASIS ^ seed, str, (uint16_t)strlen(str) );
+}
+
+// Must agree with hashString for a token containing the same bytes.
+static uint32_t hashToken(const FS_STM32F4xxCLI_Token_t * token, uint32_t seed)
+{
+  uint32_t hash;
+
+  hash = hashBytes( FNV_OFFSET_BASIS ^ seed, token->part[0].data, token->part[0].length );
+  return hashBytes( hash, token->part[1].data, token->part[1].length );
+}
+
+/*
+Attempt to move every name in a bucket into a free slot using the given
+displacement. On failure, any slots claimed during the attempt are released.
+*/
+static _Bool placeBucket(FS_STM32F4xxCLI_t * cli, uint8_t bucket, uint16_t displacement)
+{
+  uint8_t i;
+  uint32_t slot;
+  _Bool success;
+
+  success = true;
+
+  for(i = 0; i < cli->numCommands; i++)
+  {
+    if( bucket != ( hashString(cli->commands[i].name, 0) % FS_STM32F4XXCLI_HASH_BUCKETS ) )
+    {
+      continue;
+    }
+
+    slot = hashString(cli->commands[i].name, displacement + 1) & ( FS_STM32F4XXCLI_HASH_SLOTS - 1 );
+
+    if(cli->slot[slot])
+    {
+      success = false;
+      break;
+    }
+
+    cli->slot[slot] = i + 1;
+  }
+
+  if(!success)
+  {
+    for(i = 0; i < cli->numCommands; i++)
+    {
+      if( bucket != ( hashString(cli->commands[i].name, 0) % FS_STM32F4XXCLI_HASH_BUCKETS ) )
+      {
+        continue;
+      }
+
+      slot = hashString(cli->commands[i].name, displacement + 1) & ( FS_STM32F4XXCLI_HASH_SLOTS - 1 );
+
+      if( ( i + 1 ) == cli->slot[slot] )
+      {
+        cli->slot[slot] = 0;
+      }
+    }
+  }
+
+  return success;
+}
+
+/*
+Two hashes and a single comparison, however many commands there are. The
+comparison is still needed since arbitrary input can land on an occupied slot.
+*/
+static const FS_STM32F4xxCLI_Command_t * lookup(FS_STM32F4xxCLI_t * cli,
+                                                const FS_STM32F4xxCLI_Token_t * token)
+{
+  uint32_t bucket, slot;
+  const FS_STM32F4xxCLI_Command_t * command;
+
+  bucket = hashToken(token, 0) % FS_STM32F4XXCLI_HASH_BUCKETS;
+  slot = hashToken( token, cli->displacement[bucket] + 1 ) & ( FS_STM32F4XXCLI_HASH_SLOTS - 1 );
+
+  if(0 == cli->slot[slot])
+  {
+    return NULL;
+  }
+
+  command = &( cli->commands[cli->slot[slot] - 1] );
+
+  return FS_STM32F4xxCLI_TokenEquals(token, command->name) ? command : NULL;
+}
+
+/*
+Split a line into whitespace separated tokens. Any tokens beyond
+FS_STM32F4XXCLI_MAX_ARGS are ignored.
+*/
+static uint8_t tokenise(const FS_STM32F4xxUSART_Span_t spans[2], FS_STM32F4xxCLI_Token_t * argv)
+{
+  uint16_t i, start, length, lineLength, firstLength;
+  uint8_t argc;
+
+  lineLength = spans[0].length + spans[1].length;
+  firstLength = spans[0].length;
+  argc = 0;
+  i = 0;
+
+  while( ( i < lineLength ) && ( argc < FS_STM32F4XXCLI_MAX_ARGS ) )
+  {
+    // Skip leading separators.
+    while( ( i < lineLength ) && isSeparator( charAt(spans, i) ) )
+    {
+      i++;
+    }
+
+    if(i == lineLength)
+    {
+      break;
+    }
+
+    start = i;
+
+    while( ( i < lineLength ) && !isSeparator( charAt(spans, i) ) )
+    {
+      i++;
+    }
+
+    length = i - start;
+
+    // Describe the token, splitting it if it crosses from the first span to the second.
+    argv[argc].part[1].data = NULL;
+    argv[argc].part[1].length = 0;
+
+    if( ( start + length ) <= firstLength )
+    {
+      argv[argc].part[0].data = &( spans[0].data[start] );
+      argv[argc].part[0].length = length;
+    }
+
+    else if(start >= firstLength)
+    {
+      argv[argc].part[0].data = &( spans[1].data[start - firstLength] );
+      argv[argc].part[0].length = length;
+    }
+
+    else
+    {
+      argv[argc].part[0].data = &( spans[0].data[start] );
+      argv[argc].part[0].length = firstLength - start;
+      argv[argc].part[1].data = spans[1].data;
+      argv[argc].part[1].length = length - ( firstLength - start );
+    }
+
+    argc++;
+  }
+
+  return argc;
+}
+
+static char charAt(const FS_STM32F4xxUSART_Span_t spans[2], uint16_t index)
+{
+  if(index < spans[0].length)
+  {
+    return spans[0].data[index];
+  }
+
+  return spans[1].data[index - spans[0].length];
+}
+
+// Carriage returns are treated as whitespace so that CRLF line endings work too.
+static _Bool isSeparator(char c)
+{
+  return ( ' ' == c ) || ( '\t' == c ) || ( '\r' == c );
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
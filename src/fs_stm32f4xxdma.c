@@ -0,0 +1,384 @@
+/**
+ *******************************************************************************
+ *
+ * @file
+ *
+ * @brief DMA stream allocation shared between drivers.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_STM32F4xxDMA.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// FS library includes.
+#include "FS_STM32F4xxOSAL.h"
+
+// For FS_STM32F4XXUSART_ENABLE_RAMFUNC - the U(S)ART rx DMA interrupts pass through here.
+#include "FS_STM32F4xxUSART_Conf.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PRIVATE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+// Streams are numbered 0 to 15 - DMA1's then DMA2's.
+#define STREAMS_PER_CONTROLLER 8
+#define NUM_STREAMS ( 2 * STREAMS_PER_CONTROLLER )
+
+#define STREAM_DMA1(n) (n)
+#define STREAM_DMA2(n) ( STREAMS_PER_CONTROLLER + (n) )
+
+// Marks the unused alternative of a request with only one stream.
+#define STREAM_NONE 0xFF
+
+// Interrupt dispatch runs from SRAM along with the USART driver's handlers - see FS_STM32F4xxUSART.h.
+#if defined(FS_STM32F4XXUSART_ENABLE_RAMFUNC)
+#define RAMFUNC __attribute__((section(".ramfunc"), long_call))
+#else
+#define RAMFUNC
+#endif
+
+/*------------------------------------------------------------------------------
+-------------------------- END PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+--------------------- START PRIVATE TYPE DEFINITIONS ---------------------------
+------------------------------------------------------------------------------*/
+
+typedef struct
+{
+  DMA_Stream_TypeDef * stream;
+  IRQn_Type nvicIrqChannel;
+
+}DMAStream;
+
+// The streams able to serve a request, in order of preference, and the channel on each.
+typedef struct
+{
+  uint8_t streams[2];
+  uint32_t channels[2];
+
+}DMARequest;
+
+typedef struct
+{
+  _Bool claimed;
+  FS_STM32F4xxDMA_Handler_t handler;
+  void * ctx;
+
+}DMAOwner;
+
+/*------------------------------------------------------------------------------
+---------------------- END PRIVATE TYPE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+RAMFUNC static void streamIrqHandler(uint8_t index);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+static const DMAStream streamTable[NUM_STREAMS] = {
+  { DMA1_Stream0, DMA1_Stream0_IRQn },
+  { DMA1_Stream1, DMA1_Stream1_IRQn },
+  { DMA1_Stream2, DMA1_Stream2_IRQn },
+  { DMA1_Stream3, DMA1_Stream3_IRQn },
+  { DMA1_Stream4, DMA1_Stream4_IRQn },
+  { DMA1_Stream5, DMA1_Stream5_IRQn },
+  { DMA1_Stream6, DMA1_Stream6_IRQn },
+  { DMA1_Stream7, DMA1_Stream7_IRQn },
+  { DMA2_Stream0, DMA2_Stream0_IRQn },
+  { DMA2_Stream1, DMA2_Stream1_IRQn },
+  { DMA2_Stream2, DMA2_Stream2_IRQn },
+  { DMA2_Stream3, DMA2_Stream3_IRQn },
+  { DMA2_Stream4, DMA2_Stream4_IRQn },
+  { DMA2_Stream5, DMA2_Stream5_IRQn },
+  { DMA2_Stream6, DMA2_Stream6_IRQn },
+  { DMA2_Stream7, DMA2_Stream7_IRQn }
+};
+
+/*
+Stream/channel mapping from the reference manual (RM0090), indexed by
+FS_STM32F4xxDMA_Request_e. The preferred stream of each U(S)ART rx request is
+the one the USART driver has always used, and no two of those share a stream.
+*/
+static const DMARequest requestTable[FS_STM32F4xxDMA_NumRequests] = {
+  // U(S)ART rx.
+  { { STREAM_DMA2(5), STREAM_DMA2(2) }, { DMA_Channel_4, DMA_Channel_4 } },
+  { { STREAM_DMA1(5), STREAM_NONE },    { DMA_Channel_4, 0 } },
+  { { STREAM_DMA1(1), STREAM_NONE },    { DMA_Channel_4, 0 } },
+  { { STREAM_DMA1(2), STREAM_NONE },    { DMA_Channel_4, 0 } },
+  { { STREAM_DMA1(0), STREAM_NONE },    { DMA_Channel_4, 0 } },
+  { { STREAM_DMA2(1), STREAM_DMA2(2) }, { DMA_Channel_5, DMA_Channel_5 } },
+
+  // U(S)ART tx.
+  { { STREAM_DMA2(7), STREAM_NONE },    { DMA_Channel_4, 0 } },
+  { { STREAM_DMA1(6), STREAM_NONE },    { DMA_Channel_4, 0 } },
+  { { STREAM_DMA1(3), STREAM_DMA1(4) }, { DMA_Channel_4, DMA_Channel_7 } },
+  { { STREAM_DMA1(4), STREAM_NONE },    { DMA_Channel_4, 0 } },
+  { { STREAM_DMA1(7), STREAM_NONE },    { DMA_Channel_4, 0 } },
+  { { STREAM_DMA2(6), STREAM_DMA2(7) }, { DMA_Channel_5, DMA_Channel_5 } },
+
+  // I2C rx.
+  { { STREAM_DMA1(0), STREAM_DMA1(5) }, { DMA_Channel_1, DMA_Channel_1 } },
+  { { STREAM_DMA1(2), STREAM_DMA1(3) }, { DMA_Channel_7, DMA_Channel_7 } },
+  { { STREAM_DMA1(2), STREAM_NONE },    { DMA_Channel_3, 0 } },
+
+  // I2C tx.
+  { { STREAM_DMA1(6), STREAM_DMA1(7) }, { DMA_Channel_1, DMA_Channel_1 } },
+  { { STREAM_DMA1(7), STREAM_NONE },    { DMA_Channel_7, 0 } },
+  { { STREAM_DMA1(4), STREAM_NONE },    { DMA_Channel_3, 0 } }
+};
+
+// Bit position of each stream's flags within LISR/HISR.
+static const uint8_t flagShiftTable[] = { 0, 6, 16, 22 };
+
+static DMAOwner ownerList[NUM_STREAMS];
+
+/*------------------------------------------------------------------------------
+--------------------- END PRIVATE GLOBAL VARIABLES -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+_Bool FS_STM32F4xxDMA_Claim(FS_STM32F4xxDMA_Request_e request,
+                            FS_STM32F4xxDMA_Handler_t handler,
+                            void * ctx,
+                            FS_STM32F4xxDMA_Allocation_t * allocation)
+{
+  FS_STM32F4xxOSAL_CriticalState_t state;
+  NVIC_InitTypeDef nvicInitStruct;
+  uint8_t i, index;
+
+  if(request >= FS_STM32F4xxDMA_NumRequests)
+  {
+    return false;
+  }
+
+  index = STREAM_NONE;
+
+  state = FS_STM32F4xxOSAL_EnterCritical();
+
+  for(i = 0; i < 2; i++)
+  {
+    if( ( STREAM_NONE != requestTable[request].streams[i] ) &&
+        !ownerList[requestTable[request].streams[i]].claimed )
+    {
+      index = requestTable[request].streams[i];
+      ownerList[index].claimed = true;
+      ownerList[index].handler = handler;
+      ownerList[index].ctx = ctx;
+      break;
+    }
+  }
+
+  FS_STM32F4xxOSAL_ExitCritical(state);
+
+  if(STREAM_NONE == index)
+  {
+    return false;
+  }
+
+  allocation->stream = streamTable[index].stream;
+  allocation->channel = requestTable[request].channels[i];
+  allocation->streamIndex = index;
+
+  RCC_AHB1PeriphClockCmd( ( index < STREAMS_PER_CONTROLLER ) ? RCC_AHB1Periph_DMA1 : RCC_AHB1Periph_DMA2,
+                          ENABLE );
+
+  nvicInitStruct.NVIC_IRQChannel = streamTable[index].nvicIrqChannel;
+  nvicInitStruct.NVIC_IRQChannelPreemptionPriority = 8;
+  nvicInitStruct.NVIC_IRQChannelSubPriority = 1;
+  nvicInitStruct.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&nvicInitStruct);
+
+  return true;
+}
+
+void FS_STM32F4xxDMA_Release(FS_STM32F4xxDMA_Allocation_t * allocation)
+{
+  FS_STM32F4xxOSAL_CriticalState_t state;
+  NVIC_InitTypeDef nvicInitStruct;
+  uint8_t index;
+
+  if(NULL == allocation->stream)
+  {
+    return;
+  }
+
+  index = allocation->streamIndex;
+
+  nvicInitStruct.NVIC_IRQChannel = streamTable[index].nvicIrqChannel;
+  nvicInitStruct.NVIC_IRQChannelPreemptionPriority = 8;
+  nvicInitStruct.NVIC_IRQChannelSubPriority = 1;
+  nvicInitStruct.NVIC_IRQChannelCmd = DISABLE;
+  NVIC_Init(&nvicInitStruct);
+
+  state = FS_STM32F4xxOSAL_EnterCritical();
+  ownerList[index].claimed = false;
+  ownerList[index].handler = NULL;
+  ownerList[index].ctx = NULL;
+  FS_STM32F4xxOSAL_ExitCritical(state);
+
+  allocation->stream = NULL;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Clear the stream's flags and hand them to its owner. Flags are cleared even if
+the stream has no owner, so a stray interrupt can't keep firing.
+*/
+RAMFUNC static void streamIrqHandler(uint8_t index)
+{
+  DMA_TypeDef * dma;
+  volatile uint32_t * isr;
+  volatile uint32_t * ifcr;
+  uint8_t shift;
+  uint32_t flags;
+
+  dma = ( index < STREAMS_PER_CONTROLLER ) ? DMA1 : DMA2;
+
+  // Streams 0-3 of a controller report in LISR, 4-7 in HISR.
+  if( ( index % STREAMS_PER_CONTROLLER ) < 4 )
+  {
+    isr = &( dma->LISR );
+    ifcr = &( dma->LIFCR );
+  }
+
+  else
+  {
+    isr = &( dma->HISR );
+    ifcr = &( dma->HIFCR );
+  }
+
+  shift = flagShiftTable[index % 4];
+
+  flags = ( *isr >> shift ) & FS_STM32F4XXDMA_FLAG_ALL;
+  *ifcr = flags << shift;
+
+  if(NULL != ownerList[index].handler)
+  {
+    ownerList[index].handler(ownerList[index].ctx, flags);
+  }
+}
+
+RAMFUNC void DMA1_Stream0_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA1(0) );
+}
+
+RAMFUNC void DMA1_Stream1_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA1(1) );
+}
+
+RAMFUNC void DMA1_Stream2_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA1(2) );
+}
+
+RAMFUNC void DMA1_Stream3_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA1(3) );
+}
+
+RAMFUNC void DMA1_Stream4_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA1(4) );
+}
+
+RAMFUNC void DMA1_Stream5_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA1(5) );
+}
+
+RAMFUNC void DMA1_Stream6_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA1(6) );
+}
+
+RAMFUNC void DMA1_Stream7_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA1(7) );
+}
+
+RAMFUNC void DMA2_Stream0_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA2(0) );
+}
+
+RAMFUNC void DMA2_Stream1_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA2(1) );
+}
+
+RAMFUNC void DMA2_Stream2_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA2(2) );
+}
+
+RAMFUNC void DMA2_Stream3_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA2(3) );
+}
+
+RAMFUNC void DMA2_Stream4_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA2(4) );
+}
+
+RAMFUNC void DMA2_Stream5_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA2(5) );
+}
+
+RAMFUNC void DMA2_Stream6_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA2(6) );
+}
+
+RAMFUNC void DMA2_Stream7_IRQHandler(void)
+{
+  streamIrqHandler( STREAM_DMA2(7) );
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
@@ -0,0 +1,310 @@
+/**
+ *******************************************************************************
+ *
+ * @file
+ *
+ * @brief Thin operating system abstraction layer for the FS drivers.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_STM32F4xxOSAL.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(FS_STM32F4XXOSAL_BAREMETAL)
+// ST library includes.
+#include "stm32f4xx.h"
+#else
+// Free RTOS includes.
+#include "task.h"
+#endif
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+#if defined(FS_STM32F4XXOSAL_BAREMETAL)
+
+/*------------------------------------------------------------------------------
+-------------------- START PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+// Advanced by the application's SysTick handler.
+static volatile FS_STM32F4xxOSAL_Ticks_t tickCount;
+
+/*------------------------------------------------------------------------------
+--------------------- END PRIVATE GLOBAL VARIABLES -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PUBLIC FUNCTIONS (BARE METAL) ------------------------
+------------------------------------------------------------------------------*/
+
+_Bool FS_STM32F4xxOSAL_LockCreate(FS_STM32F4xxOSAL_Lock_t * lock)
+{
+  lock->savedPrimask = 0;
+  return true;
+}
+
+/*
+With no other tasks, the only contenders for a lock are interrupt handlers,
+so masking interrupts is sufficient and the lock can never time out.
+*/
+FS_STM32F4XXOSAL_RAMFUNC _Bool FS_STM32F4xxOSAL_LockTake(FS_STM32F4xxOSAL_Lock_t * lock, FS_STM32F4xxOSAL_Ticks_t timeout)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  lock->savedPrimask = primask;
+
+  return true;
+}
+
+FS_STM32F4XXOSAL_RAMFUNC void FS_STM32F4xxOSAL_LockGive(FS_STM32F4xxOSAL_Lock_t * lock)
+{
+  __set_PRIMASK(lock->savedPrimask);
+}
+
+_Bool FS_STM32F4xxOSAL_SignalCreate(FS_STM32F4xxOSAL_Signal_t * signal)
+{
+  signal->pending = 0;
+  return true;
+}
+
+void FS_STM32F4xxOSAL_SignalGive(FS_STM32F4xxOSAL_Signal_t * signal)
+{
+  signal->pending = 1;
+}
+
+FS_STM32F4XXOSAL_RAMFUNC void FS_STM32F4xxOSAL_SignalGiveFromISR(FS_STM32F4xxOSAL_Signal_t * signal)
+{
+  signal->pending = 1;
+}
+
+_Bool FS_STM32F4xxOSAL_SignalWait(FS_STM32F4xxOSAL_Signal_t * signal, FS_STM32F4xxOSAL_Ticks_t timeout)
+{
+  FS_STM32F4xxOSAL_Ticks_t start;
+  uint32_t primask;
+
+  start = tickCount;
+
+  for(;;)
+  {
+    /*
+    Check the flag with interrupts masked and sleep without unmasking them.
+    WFI still wakes for a pending interrupt, so one arriving between the
+    check and the sleep can't be missed.
+    */
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if(signal->pending)
+    {
+      signal->pending = 0;
+      __set_PRIMASK(primask);
+      return true;
+    }
+
+    if( ( FS_STM32F4XXOSAL_WAIT_FOREVER != timeout ) &&
+        ( ( tickCount - start ) >= timeout ) )
+    {
+      __set_PRIMASK(primask);
+      return false;
+    }
+
+    __WFI();
+    __set_PRIMASK(primask);
+  }
+}
+
+_Bool FS_STM32F4xxOSAL_EventsCreate(FS_STM32F4xxOSAL_Events_t * events)
+{
+  events->bits = 0;
+  return true;
+}
+
+void FS_STM32F4xxOSAL_EventsSet(FS_STM32F4xxOSAL_Events_t * events, uint32_t bits)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  events->bits |= bits;
+  __set_PRIMASK(primask);
+}
+
+void FS_STM32F4xxOSAL_EventsClear(FS_STM32F4xxOSAL_Events_t * events, uint32_t bits)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  events->bits &= ~bits;
+  __set_PRIMASK(primask);
+}
+
+// As SignalWait, but the flags are left set.
+uint32_t FS_STM32F4xxOSAL_EventsWait(FS_STM32F4xxOSAL_Events_t * events, uint32_t bits, FS_STM32F4xxOSAL_Ticks_t timeout)
+{
+  FS_STM32F4xxOSAL_Ticks_t start;
+  uint32_t primask, set;
+
+  start = tickCount;
+
+  for(;;)
+  {
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    set = events->bits & bits;
+
+    if( set ||
+        ( ( FS_STM32F4XXOSAL_WAIT_FOREVER != timeout ) && ( ( tickCount - start ) >= timeout ) ) )
+    {
+      __set_PRIMASK(primask);
+      return set;
+    }
+
+    __WFI();
+    __set_PRIMASK(primask);
+  }
+}
+
+FS_STM32F4xxOSAL_Ticks_t FS_STM32F4xxOSAL_GetTicks(void)
+{
+  return tickCount;
+}
+
+void FS_STM32F4xxOSAL_TickIncrement(void)
+{
+  tickCount++;
+}
+
+FS_STM32F4XXOSAL_RAMFUNC FS_STM32F4xxOSAL_CriticalState_t FS_STM32F4xxOSAL_EnterCritical(void)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  return primask;
+}
+
+FS_STM32F4XXOSAL_RAMFUNC void FS_STM32F4xxOSAL_ExitCritical(FS_STM32F4xxOSAL_CriticalState_t state)
+{
+  __set_PRIMASK(state);
+}
+
+/*------------------------------------------------------------------------------
+-------------------- END PUBLIC FUNCTIONS (BARE METAL) -------------------------
+------------------------------------------------------------------------------*/
+
+#else
+
+/*------------------------------------------------------------------------------
+-------------------- START PUBLIC FUNCTIONS (FREERTOS) -------------------------
+------------------------------------------------------------------------------*/
+
+_Bool FS_STM32F4xxOSAL_LockCreate(FS_STM32F4xxOSAL_Lock_t * lock)
+{
+  lock->mutex = xSemaphoreCreateMutex();
+  return ( NULL != lock->mutex );
+}
+
+FS_STM32F4XXOSAL_RAMFUNC _Bool FS_STM32F4xxOSAL_LockTake(FS_STM32F4xxOSAL_Lock_t * lock, FS_STM32F4xxOSAL_Ticks_t timeout)
+{
+  return ( pdTRUE == xSemaphoreTake( lock->mutex, (TickType_t)timeout ) );
+}
+
+FS_STM32F4XXOSAL_RAMFUNC void FS_STM32F4xxOSAL_LockGive(FS_STM32F4xxOSAL_Lock_t * lock)
+{
+  xSemaphoreGive(lock->mutex);
+}
+
+_Bool FS_STM32F4xxOSAL_SignalCreate(FS_STM32F4xxOSAL_Signal_t * signal)
+{
+  signal->semaphore = xSemaphoreCreateBinary();
+  return ( NULL != signal->semaphore );
+}
+
+void FS_STM32F4xxOSAL_SignalGive(FS_STM32F4xxOSAL_Signal_t * signal)
+{
+  xSemaphoreGive(signal->semaphore);
+}
+
+FS_STM32F4XXOSAL_RAMFUNC void FS_STM32F4xxOSAL_SignalGiveFromISR(FS_STM32F4xxOSAL_Signal_t * signal)
+{
+  BaseType_t higherPriorityTaskWoken;
+
+  higherPriorityTaskWoken = pdFALSE;
+  xSemaphoreGiveFromISR(signal->semaphore, &higherPriorityTaskWoken);
+  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+_Bool FS_STM32F4xxOSAL_SignalWait(FS_STM32F4xxOSAL_Signal_t * signal, FS_STM32F4xxOSAL_Ticks_t timeout)
+{
+  return ( pdTRUE == xSemaphoreTake( signal->semaphore,
+                                     ( FS_STM32F4XXOSAL_WAIT_FOREVER == timeout ) ?
+                                     portMAX_DELAY : (TickType_t)timeout ) );
+}
+
+_Bool FS_STM32F4xxOSAL_EventsCreate(FS_STM32F4xxOSAL_Events_t * events)
+{
+  events->group = xEventGroupCreate();
+  return ( NULL != events->group );
+}
+
+void FS_STM32F4xxOSAL_EventsSet(FS_STM32F4xxOSAL_Events_t * events, uint32_t bits)
+{
+  xEventGroupSetBits(events->group, (EventBits_t)bits);
+}
+
+void FS_STM32F4xxOSAL_EventsClear(FS_STM32F4xxOSAL_Events_t * events, uint32_t bits)
+{
+  xEventGroupClearBits(events->group, (EventBits_t)bits);
+}
+
+uint32_t FS_STM32F4xxOSAL_EventsWait(FS_STM32F4xxOSAL_Events_t * events, uint32_t bits, FS_STM32F4xxOSAL_Ticks_t timeout)
+{
+  // Wait for any of the bits, leaving them set.
+  return (uint32_t)xEventGroupWaitBits( events->group,
+                                        (EventBits_t)bits,
+                                        pdFALSE,
+                                        pdFALSE,
+                                        ( FS_STM32F4XXOSAL_WAIT_FOREVER == timeout ) ?
+                                        portMAX_DELAY : (TickType_t)timeout ) & bits;
+}
+
+FS_STM32F4xxOSAL_Ticks_t FS_STM32F4xxOSAL_GetTicks(void)
+{
+  return (FS_STM32F4xxOSAL_Ticks_t)xTaskGetTickCount();
+}
+
+FS_STM32F4XXOSAL_RAMFUNC FS_STM32F4xxOSAL_CriticalState_t FS_STM32F4xxOSAL_EnterCritical(void)
+{
+  // FreeRTOS tracks nesting itself.
+  taskENTER_CRITICAL();
+  return 0;
+}
+
+FS_STM32F4XXOSAL_RAMFUNC void FS_STM32F4xxOSAL_ExitCritical(FS_STM32F4xxOSAL_CriticalState_t state)
+{
+  taskEXIT_CRITICAL();
+}
+
+/*------------------------------------------------------------------------------
+--------------------- END PUBLIC FUNCTIONS (FREERTOS) --------------------------
+------------------------------------------------------------------------------*/
+
+#endif
@@ -0,0 +1,553 @@
+/**
+ *******************************************************************************
+ *
+ * @file
+ *
+ * @brief Request/response RPC layer over a framed stream.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_STM32F4xxRPC.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stddef.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PRIVATE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+// SLIP special characters.
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+// Frame types.
+#define TYPE_REQUEST 0
+#define TYPE_RESPONSE 1
+
+// Bytes read from the stream at a time.
+#define RX_CHUNK_BYTES 32
+
+/*------------------------------------------------------------------------------
+-------------------------- END PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static _Bool sendFrame(FS_STM32F4xxRPC_t * rpc,
+                       uint8_t type,
+                       uint16_t id,
+                       uint8_t code,
+                       const uint8_t * data,
+                       uint16_t length);
+static uint16_t encodeBytes(uint8_t * dest, const uint8_t * src, uint16_t length);
+static void receiveByte(FS_STM32F4xxRPC_t * rpc, uint8_t byte);
+static void handleFrame(FS_STM32F4xxRPC_t * rpc);
+static void expireRequests(FS_STM32F4xxRPC_t * rpc);
+static FS_STM32F4xxRPC_Pending_t * findPending(FS_STM32F4xxRPC_t * rpc, uint16_t id);
+static uint16_t crc16(uint16_t crc, const uint8_t * data, uint16_t length);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+// CRC-16/XMODEM (polynomial 0x1021), a nibble at a time.
+static const uint16_t crcNibbleTable[16] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/*------------------------------------------------------------------------------
+--------------------- END PRIVATE GLOBAL VARIABLES -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+_Bool FS_STM32F4xxRPC_Init(FS_STM32F4xxRPC_t * rpc,
+                           FS_DT_IOStream_t * stream,
+                           FS_STM32F4xxRPC_RequestHandler_t requestHandler,
+                           void * handlerCtx)
+{
+  uint8_t i;
+
+  rpc->stream = stream;
+  rpc->requestHandler = requestHandler;
+  rpc->handlerCtx = handlerCtx;
+  rpc->nextId = 1;
+
+  for(i = 0; i < FS_STM32F4XXRPC_MAX_PENDING; i++)
+  {
+    rpc->pending[i].id = 0;
+  }
+
+  rpc->rxLength = 0;
+  rpc->rxEscape = false;
+  rpc->rxOversize = false;
+
+  rpc->stats.crcErrors = 0;
+  rpc->stats.oversizeFrames = 0;
+  rpc->stats.unmatchedResponses = 0;
+  rpc->stats.timeouts = 0;
+
+  return FS_STM32F4xxOSAL_LockCreate( &( rpc->lock ) );
+}
+
+uint16_t FS_STM32F4xxRPC_Call(FS_STM32F4xxRPC_t * rpc,
+                              uint8_t method,
+                              const uint8_t * data,
+                              uint16_t length,
+                              FS_STM32F4xxOSAL_Ticks_t timeoutTicks,
+                              FS_STM32F4xxRPC_Callback_t callback,
+                              void * ctx)
+{
+  FS_STM32F4xxRPC_Pending_t * entry;
+  uint16_t id;
+
+  if(length > FS_STM32F4XXRPC_MAX_PAYLOAD_BYTES)
+  {
+    return 0;
+  }
+
+  if( !FS_STM32F4xxOSAL_LockTake( &( rpc->lock ), FS_STM32F4XXRPC_LOCK_TIMEOUT_TICKS ) )
+  {
+    return 0;
+  }
+
+  id = 0;
+  entry = findPending(rpc, 0);
+
+  if(NULL != entry)
+  {
+    // Skip IDs still in use after wrapping, and 0, which marks a free entry.
+    do
+    {
+      id = rpc->nextId++;
+
+    }while( ( 0 == id ) || ( NULL != findPending(rpc, id) ) );
+
+    /*
+    Register the request before sending it - the response may be handled by
+    another task before sendFrame returns.
+    */
+    entry->id = id;
+    entry->sentTicks = FS_STM32F4xxOSAL_GetTicks();
+    entry->timeoutTicks = timeoutTicks;
+    entry->callback = callback;
+    entry->ctx = ctx;
+
+    if( !sendFrame(rpc, TYPE_REQUEST, id, method, data, length) )
+    {
+      entry->id = 0;
+      id = 0;
+    }
+  }
+
+  FS_STM32F4xxOSAL_LockGive( &( rpc->lock ) );
+
+  return id;
+}
+
+_Bool FS_STM32F4xxRPC_Respond(FS_STM32F4xxRPC_t * rpc,
+                              uint16_t id,
+                              uint8_t status,
+                              const uint8_t * data,
+                              uint16_t length)
+{
+  _Bool retVal;
+
+  if(length > FS_STM32F4XXRPC_MAX_PAYLOAD_BYTES)
+  {
+    return false;
+  }
+
+  if( !FS_STM32F4xxOSAL_LockTake( &( rpc->lock ), FS_STM32F4XXRPC_LOCK_TIMEOUT_TICKS ) )
+  {
+    return false;
+  }
+
+  retVal = sendFrame(rpc, TYPE_RESPONSE, id, status, data, length);
+
+  FS_STM32F4xxOSAL_LockGive( &( rpc->lock ) );
+
+  return retVal;
+}
+
+_Bool FS_STM32F4xxRPC_Cancel(FS_STM32F4xxRPC_t * rpc, uint16_t id)
+{
+  FS_STM32F4xxRPC_Pending_t * entry;
+  FS_STM32F4xxRPC_Callback_t callback;
+  void * ctx;
+
+  if( ( 0 == id ) ||
+      !FS_STM32F4xxOSAL_LockTake( &( rpc->lock ), FS_STM32F4XXRPC_LOCK_TIMEOUT_TICKS ) )
+  {
+    return false;
+  }
+
+  callback = NULL;
+  ctx = NULL;
+  entry = findPending(rpc, id);
+
+  if(NULL != entry)
+  {
+    callback = entry->callback;
+    ctx = entry->ctx;
+    entry->id = 0;
+  }
+
+  FS_STM32F4xxOSAL_LockGive( &( rpc->lock ) );
+
+  if(NULL == entry)
+  {
+    return false;
+  }
+
+  if(NULL != callback)
+  {
+    callback(ctx, FS_STM32F4xxRPC_Result_Cancelled, 0, NULL, 0);
+  }
+
+  return true;
+}
+
+uint8_t FS_STM32F4xxRPC_PendingCount(FS_STM32F4xxRPC_t * rpc)
+{
+  uint8_t i, count;
+
+  count = 0;
+
+  for(i = 0; i < FS_STM32F4XXRPC_MAX_PENDING; i++)
+  {
+    if(rpc->pending[i].id)
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+void FS_STM32F4xxRPC_Poll(FS_STM32F4xxRPC_t * rpc)
+{
+  uint8_t chunk[RX_CHUNK_BYTES];
+  uint16_t received, i;
+
+  while( 0 != ( received = rpc->stream->readBytes( (char *)chunk, sizeof(chunk) ) ) )
+  {
+    for(i = 0; i < received; i++)
+    {
+      receiveByte(rpc, chunk[i]);
+    }
+  }
+
+  expireRequests(rpc);
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Encode a frame into txFrame and hand it to the stream in a single write so that
+frames from different tasks can't interleave. Called with the lock held.
+*/
+static _Bool sendFrame(FS_STM32F4xxRPC_t * rpc,
+                       uint8_t type,
+                       uint16_t id,
+                       uint8_t code,
+                       const uint8_t * data,
+                       uint16_t length)
+{
+  uint8_t header[FS_STM32F4XXRPC_HEADER_BYTES];
+  uint8_t trailer[FS_STM32F4XXRPC_CRC_BYTES];
+  uint16_t crc, encodedLength;
+
+  header[0] = type;
+  header[1] = (uint8_t)id;
+  header[2] = (uint8_t)( id >> 8 );
+  header[3] = code;
+
+  crc = crc16(0, header, sizeof(header) );
+  crc = crc16(crc, data, length);
+
+  trailer[0] = (uint8_t)crc;
+  trailer[1] = (uint8_t)( crc >> 8 );
+
+  // The leading END flushes any noise the receiver has accumulated.
+  encodedLength = 0;
+  rpc->txFrame[encodedLength++] = SLIP_END;
+  encodedLength += encodeBytes( &( rpc->txFrame[encodedLength] ), header, sizeof(header) );
+  encodedLength += encodeBytes( &( rpc->txFrame[encodedLength] ), data, length );
+  encodedLength += encodeBytes( &( rpc->txFrame[encodedLength] ), trailer, sizeof(trailer) );
+  rpc->txFrame[encodedLength++] = SLIP_END;
+
+  return ( encodedLength == rpc->stream->writeBytes( (const char *)rpc->txFrame, encodedLength ) );
+}
+
+static uint16_t encodeBytes(uint8_t * dest, const uint8_t * src, uint16_t length)
+{
+  uint16_t encodedLength;
+
+  encodedLength = 0;
+
+  while(length--)
+  {
+    if(SLIP_END == *src)
+    {
+      dest[encodedLength++] = SLIP_ESC;
+      dest[encodedLength++] = SLIP_ESC_END;
+    }
+
+    else if(SLIP_ESC == *src)
+    {
+      dest[encodedLength++] = SLIP_ESC;
+      dest[encodedLength++] = SLIP_ESC_ESC;
+    }
+
+    else
+    {
+      dest[encodedLength++] = *src;
+    }
+
+    src++;
+  }
+
+  return encodedLength;
+}
+
+static void receiveByte(FS_STM32F4xxRPC_t * rpc, uint8_t byte)
+{
+  if(SLIP_END == byte)
+  {
+    if(rpc->rxOversize)
+    {
+      rpc->stats.oversizeFrames++;
+    }
+
+    // Back to back ENDs delimit empty frames, which are simply ignored.
+    else if(rpc->rxLength)
+    {
+      handleFrame(rpc);
+    }
+
+    rpc->rxLength = 0;
+    rpc->rxEscape = false;
+    rpc->rxOversize = false;
+    return;
+  }
+
+  if(SLIP_ESC == byte)
+  {
+    rpc->rxEscape = true;
+    return;
+  }
+
+  if(rpc->rxEscape)
+  {
+    rpc->rxEscape = false;
+
+    if(SLIP_ESC_END == byte)
+    {
+      byte = SLIP_END;
+    }
+
+    else if(SLIP_ESC_ESC == byte)
+    {
+      byte = SLIP_ESC;
+    }
+
+    // Any other escaped byte is a protocol error, which the CRC will catch.
+  }
+
+  if(rpc->rxLength < FS_STM32F4XXRPC_MAX_FRAME_BYTES)
+  {
+    rpc->rxFrame[rpc->rxLength++] = byte;
+  }
+
+  else
+  {
+    rpc->rxOversize = true;
+  }
+}
+
+static void handleFrame(FS_STM32F4xxRPC_t * rpc)
+{
+  FS_STM32F4xxRPC_Pending_t * entry;
+  FS_STM32F4xxRPC_Callback_t callback;
+  void * ctx;
+  const uint8_t * payload;
+  uint16_t id, payloadLength, crc;
+
+  if( rpc->rxLength < ( FS_STM32F4XXRPC_HEADER_BYTES + FS_STM32F4XXRPC_CRC_BYTES ) )
+  {
+    rpc->stats.crcErrors++;
+    return;
+  }
+
+  payloadLength = rpc->rxLength - FS_STM32F4XXRPC_HEADER_BYTES - FS_STM32F4XXRPC_CRC_BYTES;
+  crc = (uint16_t)( rpc->rxFrame[rpc->rxLength - 2] | ( (uint16_t)rpc->rxFrame[rpc->rxLength - 1] << 8 ) );
+
+  if( crc != crc16( 0, rpc->rxFrame, rpc->rxLength - FS_STM32F4XXRPC_CRC_BYTES ) )
+  {
+    rpc->stats.crcErrors++;
+    return;
+  }
+
+  id = (uint16_t)( rpc->rxFrame[1] | ( (uint16_t)rpc->rxFrame[2] << 8 ) );
+  payload = &( rpc->rxFrame[FS_STM32F4XXRPC_HEADER_BYTES] );
+
+  if(TYPE_REQUEST == rpc->rxFrame[0])
+  {
+    if(NULL != rpc->requestHandler)
+    {
+      rpc->requestHandler(rpc, id, rpc->rxFrame[3], payload, payloadLength, rpc->handlerCtx);
+    }
+
+    else
+    {
+      FS_STM32F4xxRPC_Respond(rpc, id, FS_STM32F4XXRPC_STATUS_UNSUPPORTED, NULL, 0);
+    }
+
+    return;
+  }
+
+  if(TYPE_RESPONSE != rpc->rxFrame[0])
+  {
+    return;
+  }
+
+  // Claim the entry under the lock, but run the callback without it so that it can issue further calls.
+  callback = NULL;
+  ctx = NULL;
+  entry = NULL;
+
+  if( FS_STM32F4xxOSAL_LockTake( &( rpc->lock ), FS_STM32F4XXRPC_LOCK_TIMEOUT_TICKS ) )
+  {
+    entry = ( 0 != id ) ? findPending(rpc, id) : NULL;
+
+    if(NULL != entry)
+    {
+      callback = entry->callback;
+      ctx = entry->ctx;
+      entry->id = 0;
+    }
+
+    FS_STM32F4xxOSAL_LockGive( &( rpc->lock ) );
+  }
+
+  if(NULL == entry)
+  {
+    rpc->stats.unmatchedResponses++;
+    return;
+  }
+
+  if(NULL != callback)
+  {
+    callback(ctx, FS_STM32F4xxRPC_Result_Ok, rpc->rxFrame[3], payload, payloadLength);
+  }
+}
+
+static void expireRequests(FS_STM32F4xxRPC_t * rpc)
+{
+  FS_STM32F4xxRPC_Callback_t callback;
+  void * ctx;
+  FS_STM32F4xxOSAL_Ticks_t now;
+  uint8_t i;
+
+  for(i = 0; i < FS_STM32F4XXRPC_MAX_PENDING; i++)
+  {
+    if(0 == rpc->pending[i].id)
+    {
+      continue;
+    }
+
+    callback = NULL;
+    ctx = NULL;
+
+    if( !FS_STM32F4xxOSAL_LockTake( &( rpc->lock ), FS_STM32F4XXRPC_LOCK_TIMEOUT_TICKS ) )
+    {
+      return;
+    }
+
+    // Checked again now that the lock is held - another task may have completed or replaced it.
+    now = FS_STM32F4xxOSAL_GetTicks();
+
+    if( rpc->pending[i].id &&
+        ( ( now - rpc->pending[i].sentTicks ) >= rpc->pending[i].timeoutTicks ) )
+    {
+      callback = rpc->pending[i].callback;
+      ctx = rpc->pending[i].ctx;
+      rpc->pending[i].id = 0;
+      rpc->stats.timeouts++;
+    }
+
+    FS_STM32F4xxOSAL_LockGive( &( rpc->lock ) );
+
+    if(NULL != callback)
+    {
+      callback(ctx, FS_STM32F4xxRPC_Result_Timeout, 0, NULL, 0);
+    }
+  }
+}
+
+// Pass an ID of 0 to find a free entry.
+static FS_STM32F4xxRPC_Pending_t * findPending(FS_STM32F4xxRPC_t * rpc, uint16_t id)
+{
+  uint8_t i;
+
+  for(i = 0; i < FS_STM32F4XXRPC_MAX_PENDING; i++)
+  {
+    if(id == rpc->pending[i].id)
+    {
+      return &( rpc->pending[i] );
+    }
+  }
+
+  return NULL;
+}
+
+static uint16_t crc16(uint16_t crc, const uint8_t * data, uint16_t length)
+{
+  while(length--)
+  {
+    crc = (uint16_t)( crc << 4 ) ^ crcNibbleTable[( crc >> 12 ) ^ ( *data >> 4 )];
+    crc = (uint16_t)( crc << 4 ) ^ crcNibbleTable[( crc >> 12 ) ^ ( *data & 0x0F )];
+    data++;
+  }
+
+  return crc;
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
@@ -3,7 +3,8 @@
  *
  * @file
  *
- * @brief STM32F4xx USART driver for use with FreeRTOS.
+ * @brief STM32F4xx USART driver for use with FreeRTOS or bare metal (see
+ *        FS_STM32F4xxOSAL.h).
  *
  *******************************************************************************
  */
@@ -17,18 +18,57 @@
 
 // C standard library includes.
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
-// Free RTOS includes.
-#include "FreeRTOS.h"
-#include "semphr.h"
-#include "portable.h"
+// FS library includes.
+#include "FS_STM32F4xxOSAL.h"
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+#include "FS_STM32F4xxUSARTCompress.h"
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_CAPTURE)
+#include "FS_STM32F4xxUSARTCapture.h"
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_PIPELINE)
+#include "FS_STM32F4xxUSARTPipeline.h"
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+#include "FS_STM32F4xxDMA.h"
+#endif
 
 /*------------------------------------------------------------------------------
 ------------------------------- END INCLUDES -----------------------------------
 ------------------------------------------------------------------------------*/
 
 
+/*------------------------------------------------------------------------------
+------------------------- START PRIVATE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Hot path functions - see FS_STM32F4XXUSART_ENABLE_RAMFUNC in the header. The
+attribute must appear on both prototype and definition. long_call is needed
+because SRAM is out of branch range of flash.
+*/
+#if defined(FS_STM32F4XXUSART_ENABLE_RAMFUNC)
+#define RAMFUNC __attribute__((section(".ramfunc"), long_call))
+#else
+#define RAMFUNC
+#endif
+
+// For word and halfword access to byte buffers without breaking aliasing rules.
+typedef uint32_t __attribute__((may_alias)) AliasedWord;
+typedef uint16_t __attribute__((may_alias)) AliasedHalfWord;
+
+/*------------------------------------------------------------------------------
+-------------------------- END PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+
 /*------------------------------------------------------------------------------
 --------------------- START PRIVATE TYPE DEFINITIONS ---------------------------
 ------------------------------------------------------------------------------*/
@@ -47,7 +87,11 @@
  */
 typedef struct
 {
-  //The buffer's offset from the base of the module's master buffer.
+  /*
+  The buffer's offset from the base of the module's master buffer. All offsets
+  and counts in this struct are in bytes, except for the buffers of a 9-bit
+  U(S)ART, where they are in 16-bit elements of the master buffer's word view.
+  */
   uint16_t base;
 
   // Buffer length in bytes.
@@ -73,11 +117,66 @@ typedef struct
   uint16_t highWater;
 
   // Mutex to manage concurrent buffer access by different tasks.
-  SemaphoreHandle_t mutex;
+  FS_STM32F4xxOSAL_Lock_t mutex;
 
 }USARTBuffer;
 
 
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+// How received bytes get from the data register into the rx buffer.
+typedef enum
+{
+  USART_RX_MODE_RXNE = 0,
+  USART_RX_MODE_DMA
+
+}USARTRxMode;
+#endif
+
+
+#if defined(FS_STM32F4XXUSART_ENABLE_BAUD_CHECK)
+typedef enum
+{
+  USART_BAUD_CHECK_IDLE = 0,
+  USART_BAUD_CHECK_RUNNING,
+  USART_BAUD_CHECK_DONE
+
+}USARTBaudCheckState;
+
+// A timer input capture channel on a U(S)ART rx pin, to time its edges for a baud rate check.
+typedef struct
+{
+  // The pin, as in FS_STM32F4xxMuxablePin_t.
+  uint32_t portRCCMask;
+  uint8_t pinSource;
+
+  TIM_TypeDef * timer;
+  uint32_t timerRCCMask;
+  _Bool timerOnAPB2;
+
+  // 0xFFFF for a 16-bit timer, 0xFFFFFFFF for a 32-bit one.
+  uint32_t counterMask;
+
+  // TIM_Channel_x and the pin's alternate function to connect it.
+  uint16_t channel;
+  uint8_t af;
+
+}USARTBaudCheckCapture;
+#endif
+
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_BROADCAST)
+// A shared block queued for transmission on one U(S)ART.
+typedef struct
+{
+  FS_STM32F4xxUSART_SharedBlock_t * block;
+
+  // Bytes in the tx buffer to send before the block, i.e. those written ahead of it.
+  uint16_t gap;
+
+}USARTTxShared;
+#endif
+
+
 /**
  *******************************************************************************
  *
@@ -108,6 +207,126 @@ typedef struct
   // Receive buffer control/metadata struct.
   USARTBuffer rxBuffer;
 
+  // Nine data bits per frame, held in 16-bit buffer elements.
+  _Bool nineBit;
+
+  /*
+  Line waiting. The signal is given by the service task when a '\n' arrives or
+  the rx line goes idle (flagged by the interrupt handler), and rx silence is
+  timed from the last reception for the partial line timeout (0 if disabled).
+  */
+  FS_STM32F4xxOSAL_Signal_t lineSignal;
+  FS_STM32F4xxOSAL_Ticks_t partialLineTimeoutTicks;
+  volatile FS_STM32F4xxOSAL_Ticks_t lastRxTicks;
+  volatile _Bool rxIdle;
+
+  // FS_STM32F4XXUSART_ERROR_... flags latched since last read, by the interrupt handler and service path.
+  volatile uint8_t errors;
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+  /*
+  Compressor sitting between the write functions and the tx buffer.
+  NULL if tx data for this U(S)ART is sent uncompressed.
+  */
+  FS_STM32F4xxUSARTCompress_Encoder_t * txEncoder;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+  // Rx mode switching enabled, current mode and the DMA stream claimed for it.
+  _Bool adaptiveRx;
+  USARTRxMode rxMode;
+  FS_STM32F4xxDMA_Allocation_t rxDma;
+
+  // Rx rate measurement.
+  uint32_t rxWindowBytes;
+  FS_STM32F4xxOSAL_Ticks_t rxWindowStartTicks;
+
+  /*
+  Half and full transfer interrupts since the last rxDmaUpdate, and how many
+  more of them there have been than the stream's movement accounts for.
+  */
+  volatile uint8_t rxDmaBoundaries;
+  int8_t rxDmaBoundaryExcess;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_CAPTURE)
+  // Records all received data. NULL if not capturing.
+  FS_STM32F4xxUSARTCapture_t * rxCapture;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+  /*
+  Tx pacing. Each byte sent (at timer count txLastUs) holds the next back for
+  txDelayUs: its own time on the line plus the gap after it.
+  */
+  _Bool txPaced;
+  uint16_t txByteGapUs;
+  uint16_t txFrameGapUs;
+  char txFrameEnd;
+  uint32_t txCharUs;
+  uint32_t txLastUs;
+  uint32_t txDelayUs;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_BAUD_CHECK)
+  /*
+  Baud rate check. Times are in DWT cycles. Edges are timed from the start bit
+  of their character, which is known once an edge has followed a character
+  time of idle line (synced), after which the first edge at least a character
+  time after one start bit is the next start bit.
+  */
+  uint32_t baudRate;
+  uint8_t wordBits;
+  FS_STM32F4xxMuxablePin_t rxd;
+  volatile USARTBaudCheckState baudCheckState;
+  _Bool baudCheckSynced;
+  uint32_t baudCheckClockHz;
+  uint32_t baudCheckBitCycles;
+  uint32_t baudCheckCharCycles;
+  uint32_t baudCheckLastEdge;
+  uint32_t baudCheckCharStart;
+  uint32_t baudCheckCycles;
+  uint32_t baudCheckBits;
+  uint16_t baudCheckEdges;
+
+  // The timer channel capturing the edges and core clock cycles per timer tick, or NULL if timed by EXTI interrupt.
+  const USARTBaudCheckCapture * baudCheckCapture;
+  uint32_t baudCheckTickCycles;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION)
+  // Rx fault injection, its pseudo-random state and the BRR value for the configured baud rate.
+  _Bool rxFaultsEnabled;
+  FS_STM32F4xxUSART_RxFaults_t rxFaults;
+  FS_STM32F4xxUSART_RxFaultStats_t rxFaultStats;
+  uint32_t rxFaultRandom;
+  uint16_t baseBrr;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_PIPELINE)
+  // Consumes all received data in the service context. NULL if none.
+  FS_STM32F4xxUSARTPipeline_t * volatile rxPipeline;
+
+  // Set, under the rx buffer's mutex, while the stages are reading the buffer.
+  _Bool rxPipelineBusy;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_BROADCAST)
+  /*
+  Shared blocks queued for transmission, interleaved with the tx buffer's
+  contents according to their gaps. Protected by the tx buffer's mutex.
+  */
+  USARTTxShared txShared[FS_STM32F4XXUSART_TX_BROADCAST_DEPTH];
+  uint8_t txSharedHead;
+  uint8_t txSharedCount;
+
+  // Bytes of the first queued block already sent.
+  uint16_t txSharedOffset;
+
+  // Sum of the queued blocks' gaps.
+  uint16_t txSharedGapTotal;
+#endif
+
 }USART;
 
 
@@ -134,21 +353,21 @@ static uint16_t usart1_readLine(char * buf);
 static uint16_t usart1_readLineTruncate(char * buf, uint16_t maxLen);
 
 static uint16_t usart2_writeBytes(const char * bytes, uint16_t numBytes);
-static uint16_t usart2_writeLine(const char * line);Init functions.
+static uint16_t usart2_writeLine(const char * line);
 static uint16_t usart2_rxBytesAvailable(void);
 static uint16_t usart2_readBytes(char * buf, uint16_t numBytes);
 static uint16_t usart2_readLine(char * buf);
 static uint16_t usart2_readLineTruncate(char * buf, uint16_t maxLen);
 
 static uint16_t usart3_writeBytes(const char * bytes, uint16_t numBytes);
-static uint16_t usart3_writeLine(const charInit functions. * line);
+static uint16_t usart3_writeLine(const char * line);
 static uint16_t usart3_rxBytesAvailable(void);
 static uint16_t usart3_readBytes(char * buf, uint16_t numBytes);
 static uint16_t usart3_readLine(char * buf);
 static uint16_t usart3_readLineTruncate(char * buf, uint16_t maxLen);
 
 static uint16_t uart4_writeBytes(const char * bytes, uint16_t numBytes);
-static uint16_t uart4_writeLine(const char * line);Init functions.
+static uint16_t uart4_writeLine(const char * line);
 static uint16_t uart4_rxBytesAvailable(void);
 static uint16_t uart4_readBytes(char * buf, uint16_t numBytes);
 static uint16_t uart4_readLine(char * buf);
@@ -175,14 +394,88 @@ static uint16_t rxBytesAvailable(USART * usart);
 static uint16_t readBytes(USART * usart, char * buf, uint16_t numBytes);
 static uint16_t readLine(USART * usart, char * buf);
 static uint16_t readLineTruncate(USART * usart, char * buf, uint16_t maxLen);
+static uint16_t rxLineLength(USART * usart, uint16_t * contentLength);
+static uint32_t selectReady(uint32_t conditions);
+static void latchError(USART * usart, uint8_t flags);
+
+static _Bool txCompressedWriteFits(USART * usart, uint32_t numBytes);
+static uint16_t txBufferWrite(USART * usart, const char * bytes, uint16_t numBytes, _Bool flush);
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+static void compressedTxSink(void * ctx, const char * bytes, uint16_t numBytes);
+#endif
 
 // Buffer functions.
 static void bufferInit(USARTBuffer * buf);
-static void bufferPush(USARTBuffer * buf, char data);
-static _Bool bufferPop(USARTBuffer * buf, char * data);
+RAMFUNC static void bufferPush(USARTBuffer * buf, char data);
+RAMFUNC static _Bool bufferPop(USARTBuffer * buf, char * data);
+RAMFUNC static _Bool bufferTake(USARTBuffer * buf, char * data);
+static void bufferWriteBlock(USARTBuffer * buf, const char * bytes, uint16_t numBytes);
+static _Bool bufferFindByte(USARTBuffer * buf, char byte, uint16_t * index);
+static void copyBytes(char * dest, const char * src, uint16_t numBytes);
+static void bufferCopyOut(USARTBuffer * buf, char * dest, uint16_t numBytes);
+static void bufferDiscard(USARTBuffer * buf, uint16_t numBytes);
+
+// 16-bit element buffer functions for 9-bit U(S)ARTs.
+static void bufferInitWords(USARTBuffer * buf);
+RAMFUNC static _Bool bufferPushWord(USARTBuffer * buf, uint16_t data);
+RAMFUNC static _Bool bufferPopWord(USARTBuffer * buf, uint16_t * data);
 
 // Task main loop.
 static void mainLoop(void * params);
+RAMFUNC static void servicePass(void);
+RAMFUNC static _Bool serviceUsart(USART * usart);
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_BROADCAST)
+// Broadcast writes.
+RAMFUNC static _Bool txPop(USART * usart, char * data);
+static _Bool txSharedQueue(USART * usart, FS_STM32F4xxUSART_SharedBlock_t * block);
+RAMFUNC static void sharedBlockRelease(FS_STM32F4xxUSART_SharedBlock_t * block);
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_PIPELINE)
+static void rxPipelineRun(USART * usart);
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION)
+// Fault injection.
+static _Bool rxFaultInject(USART * usart, uint16_t * word);
+static _Bool rxFaultRoll(USART * usart, uint16_t probability);
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_BAUD_CHECK)
+// Baud rate checks.
+static const USARTBaudCheckCapture * baudCheckCaptureFind(USART * usart);
+static void baudCheckCaptureStart(USART * usart, const RCC_ClocksTypeDef * clocks);
+static void baudCheckStop(USART * usart);
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+// Tx pacing.
+static uint32_t txCharTimeUs(USART_InitTypeDef * stInitStruct);
+static void txPacingTimerStart(void);
+RAMFUNC static _Bool txPacingReady(USART * usart);
+RAMFUNC static _Bool txPacingArm(uint32_t deadline);
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+// Adaptive rx mode.
+static void adaptRxMode(USART * usart);
+static void enterRxDmaMode(USART * usart);
+static void exitRxDmaMode(USART * usart);
+static uint16_t rxDmaUpdate(USART * usart, FS_STM32F4xxOSAL_Ticks_t lockTimeout);
+static void bufferRotateToBase(USARTBuffer * buf);
+static void reverseBytes(char * bytes, uint16_t numBytes);
+RAMFUNC static void rxDmaIrqHandler(void * ctx, uint32_t flags);
+#endif
+
+// Interrupt handling.
+RAMFUNC static void usartIrqHandler(USART * usart);
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+RAMFUNC static void cycleStatsAdd(FS_STM32F4xxUSART_CycleStats_t * stats, uint32_t cycles);
+static void cycleStatsReset(FS_STM32F4xxUSART_CycleStats_t * stats);
+#endif
 
 /*------------------------------------------------------------------------------
 -------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
@@ -197,23 +490,93 @@ static void mainLoop(void * params);
 Master buffer from which memory is allocated for all input/output buffers
 in this driver. This is the main determinant of RAM usage for this module.
 Length set by application in FS_STM32F4xxUSART_Conf.h.
+
+The buffers of 9-bit U(S)ARTs are allocated at even offsets and accessed
+through masterWords, hence the alignment.
 */
-static char masterBuffer[FS_STM32F4XXUSART_MASTER_BUFFER_LENGTH_BYTES];
+static char masterBuffer[FS_STM32F4XXUSART_MASTER_BUFFER_LENGTH_BYTES] __attribute__((aligned(4)));
 uint16_t masterBufferAllocatedBytes;
 
+static AliasedHalfWord * const masterWords = (AliasedHalfWord *)masterBuffer;
+
 /*
 List to hold control/management details of all U(S)ART peripherals.
 */
-static USART usartList[6];Init functions.
+static USART usartList[6];
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+/*
+Compressor state for each U(S)ART. The history windows themselves are
+allocated from the master buffer only for U(S)ARTs which use compression.
+*/
+static FS_STM32F4xxUSARTCompress_Encoder_t txEncoderList[6];
+#endif
 
 /*
-Interrupt synchronisation semaphore. The driver operates in such a
+Interrupt synchronisation signal. The driver operates in such a
 way that the task is blocked under normal conditions. An event on
 any of the U(S)ARTs will fire an interrupt which will cause the
-semaphore to be given, hence unblocking the task. Effectively, the
+signal to be given, hence unblocking the task. Effectively, the
 task is asleep until an event occurs.
 */
-SemaphoreHandle_t irqSyncSemaphore;
+static FS_STM32F4xxOSAL_Signal_t irqSyncSignal;
+
+// Set by the service path as U(S)ARTs become readable, writable or have errors, to wake FS_STM32F4xxUSART_Select.
+static FS_STM32F4xxOSAL_Events_t selectEvents;
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+static FS_STM32F4xxUSART_TimingStats_t timingStats;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+/*
+Activity counters, the tick count they were last reset at and whether any
+U(S)ART has moved data in the current service pass.
+*/
+static FS_STM32F4xxUSART_ActivityStats_t activityStats;
+static FS_STM32F4xxOSAL_Ticks_t activityStartTicks;
+static _Bool activityPassUseful;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+/*
+The pacing timer, started by the first paced U(S)ART, and the single wake-up
+shared by all of them - the earliest deadline asked for. Each U(S)ART asks
+again on the service pass it brings about if it still has to wait.
+*/
+static _Bool txPacingTimerStarted;
+static volatile _Bool txPacingArmed;
+static volatile uint32_t txPacingDeadline;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_BAUD_CHECK)
+/*
+Timer capture channels on the U(S)ART rx pins, in order of preference for each
+pin - 32-bit timers first. The other rx pins (PC11, PD2, PD6, PD9 and PG9)
+have none.
+*/
+static const USARTBaudCheckCapture baudCheckCaptureTable[] = {
+  // USART1 rx.
+  { RCC_AHB1Periph_GPIOA, GPIO_PinSource10, TIM1, RCC_APB2Periph_TIM1, true,  0xFFFF,     TIM_Channel_3, GPIO_AF_TIM1 },
+  { RCC_AHB1Periph_GPIOB, GPIO_PinSource7,  TIM4, RCC_APB1Periph_TIM4, false, 0xFFFF,     TIM_Channel_2, GPIO_AF_TIM4 },
+
+  // USART2 rx.
+  { RCC_AHB1Periph_GPIOA, GPIO_PinSource3,  TIM2, RCC_APB1Periph_TIM2, false, 0xFFFFFFFF, TIM_Channel_4, GPIO_AF_TIM2 },
+  { RCC_AHB1Periph_GPIOA, GPIO_PinSource3,  TIM5, RCC_APB1Periph_TIM5, false, 0xFFFFFFFF, TIM_Channel_4, GPIO_AF_TIM5 },
+  { RCC_AHB1Periph_GPIOA, GPIO_PinSource3,  TIM9, RCC_APB2Periph_TIM9, true,  0xFFFF,     TIM_Channel_2, GPIO_AF_TIM9 },
+
+  // USART3 rx.
+  { RCC_AHB1Periph_GPIOB, GPIO_PinSource11, TIM2, RCC_APB1Periph_TIM2, false, 0xFFFFFFFF, TIM_Channel_4, GPIO_AF_TIM2 },
+
+  // UART4 rx.
+  { RCC_AHB1Periph_GPIOA, GPIO_PinSource1,  TIM2, RCC_APB1Periph_TIM2, false, 0xFFFFFFFF, TIM_Channel_2, GPIO_AF_TIM2 },
+  { RCC_AHB1Periph_GPIOA, GPIO_PinSource1,  TIM5, RCC_APB1Periph_TIM5, false, 0xFFFFFFFF, TIM_Channel_2, GPIO_AF_TIM5 },
+
+  // USART6 rx.
+  { RCC_AHB1Periph_GPIOC, GPIO_PinSource7,  TIM3, RCC_APB1Periph_TIM3, false, 0xFFFF,     TIM_Channel_2, GPIO_AF_TIM3 },
+  { RCC_AHB1Periph_GPIOC, GPIO_PinSource7,  TIM8, RCC_APB2Periph_TIM8, true,  0xFFFF,     TIM_Channel_2, GPIO_AF_TIM8 }
+};
+#endif
 
 static const uint32_t periphClkCmdTable[] = {
                                               RCC_APB2Periph_USART1,
@@ -258,6 +621,7 @@ void FS_STM32F4xxUSART_InitReturnsStructInit(FS_STM32F4xxUSART_InitReturnsStruct
 {
   returnsStruct->success = false;
   returnsStruct->mainLoop = NULL;
+  returnsStruct->service = NULL;
 }
 
 FS_STM32F4xxUSART_InitReturnsStruct_t FS_STM32F4xxUSART_Init(FS_STM32F4xxUSART_InitStruct_t * initStruct)
@@ -266,8 +630,32 @@ FS_STM32F4xxUSART_InitReturnsStruct_t FS_STM32F4xxUSART_Init(FS_STM32F4xxUSART_I
 
   FS_STM32F4xxUSART_InitReturnsStructInit(&returns);
 
-  // This semaphore will cause the task to block until any U(S)ART interrupt occurs.
-  irqSyncSemaphore = xSemaphoreCreateBinary();
+  // This signal will cause the task to block until any U(S)ART interrupt occurs.
+  if( !FS_STM32F4xxOSAL_SignalCreate(&irqSyncSignal) )
+  {
+    return returns;
+  }
+
+  if( !FS_STM32F4xxOSAL_EventsCreate(&selectEvents) )
+  {
+    return returns;
+  }
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS) || defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  // Start the cycle counter, if the application or a debugger hasn't already.
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+  cycleStatsReset( &( timingStats.irq ) );
+  cycleStatsReset( &( timingStats.service ) );
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  memset( &activityStats, 0, sizeof(activityStats) );
+  activityStartTicks = FS_STM32F4xxOSAL_GetTicks();
+#endif
 
   /*
   Initialise the specified peripherals. Note that in the device, the lowest-numbered
@@ -368,1132 +756,3368 @@ FS_STM32F4xxUSART_InitReturnsStruct_t FS_STM32F4xxUSART_Init(FS_STM32F4xxUSART_I
 
 
   returns.mainLoop = mainLoop;
+  returns.service = servicePass;
   returns.success =  true;
   return returns;
 }
 
-void FS_STM32F4xxUSART_PeriphInitStructInit(FS_STM32F4xxUSART_PeriphInitStruct_t * initStruct)
+uint16_t FS_STM32F4xxUSART_RxPeekLine(FS_STM32F4xxUSART_Port_e port, FS_STM32F4xxUSART_Span_t spans[2])
 {
-  initStruct->initialise = false;
-  initStruct->peripheral = NULL;
+  USARTBuffer * buf;
+  uint16_t i, lineLength, bytesAfterHead;
 
-  initStruct->txd.pinMask = 0;
-  initStruct->txd.port = NULL;
-  initStruct->txd.pinSource = 0;
-  initStruct->txd.portRCCMask = 0;
+  spans[0].data = NULL;
+  spans[0].length = 0;
+  spans[1].data = NULL;
+  spans[1].length = 0;
 
-  initStruct->rxd.pinMask = 0;
-  initStruct->rxd.port = NULL;
-  initStruct->rxd.pinSource = 0;
-  initStruct->rxd.portRCCMask = 0;
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || usartList[port].nineBit )
+  {
+    return 0;
+  }
 
-  initStruct->cts.pinMask = 0;
-  initStruct->cts.port = NULL;
-  initStruct->cts.pinSource = 0;
-  initStruct->cts.portRCCMask = 0;
+  buf = &( usartList[port].rxBuffer );
+  lineLength = 0;
 
-  initStruct->rts.pinMask = 0;
-  initStruct->rts.port = NULL;
-  initStruct->rts.pinSource = 0;
-  initStruct->rts.portRCCMask = 0;
+  if( FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    // i is the number of bytes in the line, excluding any terminator.
+    lineLength = rxLineLength( &( usartList[port] ), &i );
 
-  initStruct->sclk.pinMask = 0;
-  initStruct->sclk.port = NULL;
-  initStruct->sclk.pinSource = 0;
-  initStruct->sclk.portRCCMask = 0;
+    if(lineLength)
+    {
+      bytesAfterHead = buf->base + buf->length - buf->head;
 
-  initStruct->txBufferSizeBytes = 0;
-  initStruct->rxBufferSizeBytes = 0;
+      spans[0].data = &( masterBuffer[buf->head] );
 
-  USART_StructInit( &( initStruct->stInitStruct ) );
-}
+      if(i <= bytesAfterHead)
+      {
+        spans[0].length = i;
+      }
 
-/*------------------------------------------------------------------------------
-------------------------- END PUBLIC FUNCTIONS ---------------------------------
-------------------------------------------------------------------------------*/
+      else
+      {
+        spans[0].length = bytesAfterHead;
+        spans[1].data = &( masterBuffer[buf->base] );
+        spans[1].length = i - bytesAfterHead;
+      }
+    }
 
+    FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
+  }
 
-/*------------------------------------------------------------------------------
------------------------ START PRIVATE FUNCTIONS --------------------------------
-------------------------------------------------------------------------------*/
+  return lineLength;
+}
 
-// Init an individual peripheral instance.
-static _Bool initUsart(uint8_t listIndex, FS_STM32F4xxUSART_PeriphInitStruct_t * initStruct)
+uint16_t FS_STM32F4xxUSART_RxConsume(FS_STM32F4xxUSART_Port_e port, uint16_t numBytes)
 {
-  GPIO_InitTypeDef gpioInitStruct;
-  NVIC_InitTypeDef nvicInitStruct;
-  /*
-  Firstly, check if enough memory remains in the master buffer to
-  satisfy the allocation requirements. If not, go no further.
-  */
-  if( ( initStruct->rxBufferSizeBytes + initStruct->txBufferSizeBytes ) >
-      ( FS_STM32F4XXUSART_MASTER_BUFFER_LENGTH_BYTES - masterBufferAllocatedBytes ) )
+  USARTBuffer * buf;
+
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || usartList[port].nineBit )
   {
-    return false;
+    return 0;
   }
 
-  // Copy the pertinent information into the USART list.
-  usartList[listIndex].enabled = true;
-  usartList[listIndex].peripheral = initStruct->peripheral;
-  usartList[listIndex].txBuffer.length = initStruct->txBufferSizeBytes;
-  usartList[listIndex].rxBuffer.length = initStruct->rxBufferSizeBytes;
-
-  // Init the buffers.
-  bufferInit( &( usartList[listIndex].txBuffer ) );
-  bufferInit( &( usartList[listIndex].rxBuffer ) );
-
-  // Start clocking the appropriate port blocks and change the pin functions:
-
-  // Set up a standard init struct to use for each pin.
-  GPIO_StructInit(&gpioInitStruct);
-  gpioInitStruct.GPIO_Mode = GPIO_Mode_AF;
-  gpioInitStruct.GPIO_OType = GPIO_OType_PP;
-  gpioInitStruct.GPIO_Speed = GPIO_Speed_2MHz;
-  gpioInitStruct.GPIO_PuPd = GPIO_PuPd_UP;
-
-  // Tx pin:
+  buf = &( usartList[port].rxBuffer );
 
-  // Ensure the port block is being clocked.
-  RCC_AHB1PeriphClockCmd(initStruct->txd.portRCCMask, ENABLE);
+  if( FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    if(numBytes > buf->fillLevel)
+    {
+      numBytes = buf->fillLevel;
+    }
 
-  // Init the pin.
-  gpioInitStruct.GPIO_Pin = initStruct->txd.pinMask;
-  GPIO_Init(initStruct->txd.port, &gpioInitStruct);
+    bufferDiscard(buf, numBytes);
 
-  // Set the pin's alternate function appropriately.
-  GPIO_PinAFConfig(initStruct->txd.port, initStruct->txd.pinSource, afMaskTable[listIndex]);
+    FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
+    return numBytes;
+  }
 
-  // Rx pin:
+  // Could not get the mutex - nothing consumed.
+  else
+  {
+    return 0;
+  }
+}
 
-  // Ensure the port block is being clocked.
-  RCC_AHB1PeriphClockCmd(initStruct->rxd.portRCCMask, ENABLE);
+_Bool FS_STM32F4xxUSART_RxWaitLine(FS_STM32F4xxUSART_Port_e port, FS_STM32F4xxOSAL_Ticks_t timeout)
+{
+  USART * usart;
+  FS_STM32F4xxOSAL_Ticks_t start, elapsed, wait, partialLineWait, sinceRx;
+  uint16_t lineLength, contentLength;
 
-  // Init the pin.
-  gpioInitStruct.GPIO_Pin = initStruct->rxd.pinMask;
-  GPIO_Init(initStruct->rxd.port, &gpioInitStruct);
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || usartList[port].nineBit )
+  {
+    return false;
+  }
 
-  // Set the pin's alternate function appropriately.
-  GPIO_PinAFConfig(initStruct->rxd.port, initStruct->rxd.pinSource, afMaskTable[listIndex]);
+  usart = &( usartList[port] );
+  start = FS_STM32F4xxOSAL_GetTicks();
 
-  // Determine if synchronous mode is to be used. If so, set up the clock pin:
-  if(NULL != initStruct->sclk.port)
+  for(;;)
   {
-    // Ensure the port block is being clocked.
-    RCC_AHB1PeriphClockCmd(initStruct->sclk.portRCCMask, ENABLE);
+    lineLength = 0;
+    partialLineWait = FS_STM32F4XXOSAL_WAIT_FOREVER;
 
-    // Init the pin.
-    gpioInitStruct.GPIO_Pin = initStruct->sclk.pinMask;
-    GPIO_Init(initStruct->sclk.port, &gpioInitStruct);
+    if( FS_STM32F4xxOSAL_LockTake( &( usart->rxBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+    {
+      lineLength = rxLineLength(usart, &contentLength);
 
-    // Set the pin's alternate function appropriately.
-    GPIO_PinAFConfig(initStruct->sclk.port, initStruct->sclk.pinSource, afMaskTable[listIndex]);
-  }
+      /*
+      A partial line will become readable without anything further being
+      received - wake up for it. Ticks have moved on since rxLineLength looked,
+      so the timeout may have expired meanwhile: check again straight away.
+      */
+      if( !lineLength && usart->rxBuffer.fillLevel && usart->partialLineTimeoutTicks )
+      {
+        sinceRx = FS_STM32F4xxOSAL_GetTicks() - usart->lastRxTicks;
+        partialLineWait = ( sinceRx < usart->partialLineTimeoutTicks ) ?
+                          usart->partialLineTimeoutTicks - sinceRx : 0;
+      }
 
-  // Determine if any hardware flow control functionality is required. If so set up the appropriate pin(s):
+      FS_STM32F4xxOSAL_LockGive( &( usart->rxBuffer.mutex ) );
+    }
 
+    if(lineLength)
+    {
+      return true;
+    }
 
-  if( ( USART_HardwareFlowControl_CTS == initStruct->stInitStruct.USART_HardwareFlowControl ) ||
-      ( USART_HardwareFlowControl_RTS_CTS == initStruct->stInitStruct.USART_HardwareFlowControl ) )
-  {
-    // Ensure the port block is being clocked.
-    RCC_AHB1PeriphClockCmd(initStruct->cts.portRCCMask, ENABLE);
+    if(FS_STM32F4XXOSAL_WAIT_FOREVER == timeout)
+    {
+      wait = FS_STM32F4XXOSAL_WAIT_FOREVER;
+    }
 
-    // Init the pin.
-    gpioInitStruct.GPIO_Pin = initStruct->cts.pinMask;
-    GPIO_Init(initStruct->cts.port, &gpioInitStruct);
+    else
+    {
+      elapsed = FS_STM32F4xxOSAL_GetTicks() - start;
 
-    // Set the pin's alternate function appropriately.
-    GPIO_PinAFConfig(initStruct->cts.port, initStruct->cts.pinSource, afMaskTable[listIndex]);
-  }
+      if(elapsed >= timeout)
+      {
+        return false;
+      }
 
-  if( ( USART_HardwareFlowControl_RTS == initStruct->stInitStruct.USART_HardwareFlowControl ) ||
-      ( USART_HardwareFlowControl_RTS_CTS== initStruct->stInitStruct.USART_HardwareFlowControl ) )
-  {
-    // Ensure the port block is being clocked.
-    RCC_AHB1PeriphClockCmd(initStruct->rts.portRCCMask, ENABLE);
+      wait = timeout - elapsed;
+    }
 
-    // Init the pin.
-    gpioInitStruct.GPIO_Pin = initStruct->rts.pinMask;
-    GPIO_Init(initStruct->rts.port, &gpioInitStruct);
+    if(partialLineWait < wait)
+    {
+      wait = partialLineWait;
+    }
 
-    // Set the pin's alternate function appropriately.
-    GPIO_PinAFConfig(initStruct->rts.port, initStruct->rts.pinSource, afMaskTable[listIndex]);
+    // Woken for every '\n' and at the end of every burst - check again either way.
+    FS_STM32F4xxOSAL_SignalWait( &( usart->lineSignal ), wait );
   }
+}
 
-  // Enable the clock to the U(S)ART in question.
-  if( ( listIndex >= 1 ) || ( listIndex <= 4 ) )
+_Bool FS_STM32F4xxUSART_SetRxPipeline(FS_STM32F4xxUSART_Port_e port, struct FS_STM32F4xxUSARTPipeline_s * pipeline)
+{
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || usartList[port].nineBit )
   {
-    RCC_APB1PeriphClockCmd(periphClkCmdTable[listIndex], ENABLE);
+    return false;
   }
 
-  else
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_PIPELINE)
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+  // A DMA stream would go on writing into the buffer under the stages.
+  if(usartList[port].adaptiveRx)
   {
-    RCC_APB2PeriphClockCmd(periphClkCmdTable[listIndex], ENABLE);
+    return false;
   }
+#endif
 
-  // If synchronous mode has been requested and the peripheral is capable of it, set up the clock.
-  USART_ClockInit( initStruct->peripheral, &( initStruct->stClkInitStruct ) );
+  // A single pointer write, so safe against the driver task reading it.
+  usartList[port].rxPipeline = pipeline;
+  return true;
+#else
+  return false;
+#endif
+}
 
-  // Initialise the U(S)ART peripheral and enable it.
-  USART_Init( initStruct->peripheral, &( initStruct->stInitStruct ) );
-  USART_Cmd(initStruct->peripheral, ENABLE);
+uint32_t FS_STM32F4xxUSART_Select(uint32_t conditions, FS_STM32F4xxOSAL_Ticks_t timeout)
+{
+  FS_STM32F4xxOSAL_Ticks_t start, elapsed;
+  uint32_t ready;
 
-  // Enable the peripheral's channel in the interrupt controlller.
-  nvicInitStruct.NVIC_IRQChannel = initStruct->nvicIrqChannel;
-  nvicInitStruct.NVIC_IRQChannelPreemptionPriority = 8;
-  nvicInitStruct.NVIC_IRQChannelSubPriority = 1;
-  nvicInitStruct.NVIC_IRQChannelCmd = ENABLE;
-  NVIC_Init(&nvicInitStruct);
+  start = FS_STM32F4xxOSAL_GetTicks();
 
-  // Enable the rx interrupt only - the tx interrupt will be enabled by the write functions.
-  USART_ITConfig(initStruct->peripheral, USART_IT_RXNE, ENABLE);
+  for(;;)
+  {
+    /*
+    Clear the flags before looking at the buffers, so that any change from
+    here on leaves its flag set and the wait below returns straight away.
+    */
+    FS_STM32F4xxOSAL_EventsClear(&selectEvents, conditions);
 
-  return true;
+    ready = selectReady(conditions);
+
+    if(ready)
+    {
+      return ready;
+    }
+
+    if(FS_STM32F4XXOSAL_WAIT_FOREVER == timeout)
+    {
+      FS_STM32F4xxOSAL_EventsWait(&selectEvents, conditions, FS_STM32F4XXOSAL_WAIT_FOREVER);
+    }
+
+    else
+    {
+      elapsed = FS_STM32F4xxOSAL_GetTicks() - start;
+
+      if(elapsed >= timeout)
+      {
+        return 0;
+      }
+
+      FS_STM32F4xxOSAL_EventsWait(&selectEvents, conditions, timeout - elapsed);
+    }
+  }
 }
 
-// Redirection functions for peripheral instances.
-static uint16_t usart1_writeBytes(const char * bytes, uint16_t numBytes)
+uint8_t FS_STM32F4xxUSART_GetErrors(FS_STM32F4xxUSART_Port_e port)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[0].enabled)
-  {
-    return writeBytes( &( usartList[0] ), bytes, numBytes );
-  }
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+  uint8_t errors;
 
-  else
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled )
   {
     return 0;
   }
+
+  // The interrupt handler sets flags too.
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+  errors = usartList[port].errors;
+  usartList[port].errors = 0;
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+
+  return errors;
 }
 
-static uint16_t usart1_writeLine(const char * line)
+uint16_t FS_STM32F4xxUSART_WriteWords(FS_STM32F4xxUSART_Port_e port, const uint16_t * words, uint16_t numWords)
 {
-  if(usartList[0].enabled)
+  USART * usart;
+  uint16_t i;
+
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || !usartList[port].nineBit )
   {
-    return writeLine( &( usartList[0] ), line );
+    return 0;
   }
 
-  else
+  usart = &( usartList[port] );
+
+  // As with writeBytes, refuse anything which would overwhelm the buffer.
+  if(numWords > usart->txBuffer.length)
   {
     return 0;
   }
-}
 
-static uint16_t usart1_rxBytesAvailable(void)
-{
-  if(usartList[0].enabled)
+  if( FS_STM32F4xxOSAL_LockTake( &( usart->txBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
-    return rxBytesAvailable( &( usartList[0] ) );
+    for(i = 0; i < numWords; i++)
+    {
+      masterWords[usart->txBuffer.tail] = words[i] & 0x01FF;
+
+      // Wrap if necessary.
+      if( ( usart->txBuffer.base + usart->txBuffer.length ) == ( usart->txBuffer.tail + 1 ) )
+      {
+        usart->txBuffer.tail = usart->txBuffer.base;
+      }
+
+      else
+      {
+        usart->txBuffer.tail++;
+      }
+    }
+
+    // As bufferWriteBlock - data loss leaves the buffer full.
+    if( ( usart->txBuffer.fillLevel + numWords ) <= usart->txBuffer.length )
+    {
+      usart->txBuffer.fillLevel += numWords;
+    }
+
+    else
+    {
+      usart->txBuffer.fillLevel = usart->txBuffer.length;
+    }
+
+    if(usart->txBuffer.highWater < usart->txBuffer.fillLevel)
+    {
+      usart->txBuffer.highWater = usart->txBuffer.fillLevel;
+    }
+
+    FS_STM32F4xxOSAL_LockGive( &( usart->txBuffer.mutex ) );
+
+    // Trigger an interrupt when the tx buffer is empty to cause the main task to unblock.
+    USART_ITConfig(usart->peripheral, USART_IT_TXE, ENABLE);
+
+    return numWords;
   }
 
+  // Mutex timed out.
   else
   {
     return 0;
   }
-
 }
 
-static uint16_t usart1_readBytes(char * buf, uint16_t numBytes)
+uint16_t FS_STM32F4xxUSART_ReadWords(FS_STM32F4xxUSART_Port_e port, uint16_t * buf, uint16_t numWords)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[0].enabled)
-  {
-    return readBytes( &( usartList[0] ), buf, numBytes );
-  }
+  USARTBuffer * rxBuffer;
+  uint16_t i;
 
-  else
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || !usartList[port].nineBit )
   {
     return 0;
   }
-}
 
-static uint16_t usart1_readLine(char * buf)
-{
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[0].enabled)
+  rxBuffer = &( usartList[port].rxBuffer );
+
+  if( FS_STM32F4xxOSAL_LockTake( &( rxBuffer->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
-    return readLine( &( usartList[0] ), buf );
+    // Copy the requested number of words, or whatever is available if fewer.
+    if(numWords > rxBuffer->fillLevel)
+    {
+      numWords = rxBuffer->fillLevel;
+    }
+
+    for(i = 0; i < numWords; i++)
+    {
+      buf[i] = masterWords[rxBuffer->head];
+
+      // Wrap if necessary.
+      if( ( rxBuffer->base + rxBuffer->length ) == ( rxBuffer->head + 1 ) )
+      {
+        rxBuffer->head = rxBuffer->base;
+      }
+
+      else
+      {
+        rxBuffer->head++;
+      }
+    }
+
+    rxBuffer->fillLevel -= numWords;
+
+    FS_STM32F4xxOSAL_LockGive( &( rxBuffer->mutex ) );
+    return numWords;
   }
 
+  // Could not get the mutex - no words read.
   else
   {
     return 0;
   }
 }
 
-static uint16_t usart1_readLineTruncate(char * buf, uint16_t maxLen)
+uint16_t FS_STM32F4xxUSART_RxWordsAvailable(FS_STM32F4xxUSART_Port_e port)
 {
-  if(usartList[0].enabled)
+  USARTBuffer * rxBuffer;
+  uint16_t retVal;
+
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || !usartList[port].nineBit )
   {
-    return readLineTruncate( &( usartList[0] ), buf, maxLen );
+    return 0;
   }
 
-  else
+  rxBuffer = &( usartList[port].rxBuffer );
+  retVal = 0;
+
+  if( FS_STM32F4xxOSAL_LockTake( &( rxBuffer->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
-    return 0;
+    retVal = rxBuffer->fillLevel;
+    FS_STM32F4xxOSAL_LockGive( &( rxBuffer->mutex ) );
   }
+
+  return retVal;
 }
 
-static uint16_t usart2_writeBytes(const char * bytes, uint16_t numBytes)
+uint16_t FS_STM32F4xxUSART_RxInject(FS_STM32F4xxUSART_Port_e port, const char * bytes, uint16_t numBytes)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[1].enabled)
-  {
-    return writeBytes( &( usartList[1] ), bytes, numBytes );
-  }
+  USART * usart;
 
-  else
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || usartList[port].nineBit )
   {
     return 0;
   }
-}
 
-static uint16_t usart2_writeLine(const char * line)
-{
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[1].enabled)
+  usart = &( usartList[port] );
+
+  if(numBytes > usart->rxBuffer.length)
   {
-    return writeLine( &( usartList[1] ), line );
+    return 0;
   }
 
-  else
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+  // The DMA stream owns the tail while it's running.
+  if(USART_RX_MODE_DMA == usart->rxMode)
   {
     return 0;
   }
-}
+#endif
 
-static uint16_t usart2_rxBytesAvailable(void)
-{
-  if(usartList[1].enabled)
+  if( FS_STM32F4xxOSAL_LockTake( &( usart->rxBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
-    return rxBytesAvailable( &( usartList[1] ) );
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_PIPELINE)
+    // Overwriting the oldest data would change it under the pipeline's stages - try again later.
+    if( usart->rxPipelineBusy &&
+        ( numBytes > ( usart->rxBuffer.length - usart->rxBuffer.fillLevel ) ) )
+    {
+      FS_STM32F4xxOSAL_LockGive( &( usart->rxBuffer.mutex ) );
+      return 0;
+    }
+#endif
+
+    // Timestamp before the data goes in, as the service pass does.
+    usart->lastRxTicks = FS_STM32F4xxOSAL_GetTicks();
+    bufferWriteBlock( &( usart->rxBuffer ), bytes, numBytes );
+    FS_STM32F4xxOSAL_LockGive( &( usart->rxBuffer.mutex ) );
+
+    /*
+    Wake readers as the service pass does for received data. Each injection
+    ends a burst, as the line going idle would, so line waiters always check
+    again.
+    */
+    FS_STM32F4xxOSAL_SignalGive( &( usart->lineSignal ) );
+
+    FS_STM32F4xxOSAL_EventsSet( &selectEvents,
+                                FS_STM32F4XXUSART_SELECT_READABLE(port) |
+                                ( usart->errors ? FS_STM32F4XXUSART_SELECT_ERROR(port) : 0 ) );
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_PIPELINE)
+    // The service pass feeds the pipeline.
+    if(NULL != usart->rxPipeline)
+    {
+      FS_STM32F4xxOSAL_SignalGive(&irqSyncSignal);
+    }
+#endif
+
+    return numBytes;
   }
 
+  // Could not get the mutex - nothing written.
   else
   {
     return 0;
   }
 }
 
-static uint16_t usart2_readBytes(char * buf, uint16_t numBytes)
+uint16_t FS_STM32F4xxUSART_RxBufferLength(FS_STM32F4xxUSART_Port_e port)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[1].enabled)
-  {
-    return readBytes( &( usartList[1] ), buf, numBytes );
-  }
-
-  else
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || usartList[port].nineBit )
   {
     return 0;
   }
+
+  return usartList[port].rxBuffer.length;
 }
 
-static uint16_t usart2_readLine(char * buf)
+_Bool FS_STM32F4xxUSART_SetRxCapture(FS_STM32F4xxUSART_Port_e port, struct FS_STM32F4xxUSARTCapture_s * capture)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[1].enabled)
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled || usartList[port].nineBit )
   {
-    return readLine( &( usartList[1] ), buf );
+    return false;
   }
 
-  else
-  {
-    return 0;
-  }
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_CAPTURE)
+  // A single pointer write, so safe against the driver task reading it.
+  usartList[port].rxCapture = capture;
+  return true;
+#else
+  return false;
+#endif
 }
 
-static uint16_t usart2_readLineTruncate(char * buf, uint16_t maxLen)
+uint8_t FS_STM32F4xxUSART_Broadcast(FS_STM32F4xxUSART_SharedBlock_t * block,
+                                    const FS_STM32F4xxUSART_Port_e * ports,
+                                    uint8_t numPorts)
 {
-  if(usartList[1].enabled)
-  {
-    return readLineTruncate( &( usartList[1] ), buf, maxLen );
-  }
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_BROADCAST)
+  uint8_t i, queued;
+  USART * usart;
 
-  else
+  if(0 == block->length)
   {
     return 0;
   }
-}
 
-static uint16_t usart3_writeBytes(const char * bytes, uint16_t numBytes)
-{
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[2].enabled)
+  /*
+  Hold a reference of our own while queueing, so that the block can't be
+  released by a U(S)ART which finishes sending it before the rest have it.
+  */
+  block->refCount = 1;
+  queued = 0;
+
+  for(i = 0; i < numPorts; i++)
   {
-    return writeBytes( &( usartList[2] ), bytes, numBytes );
+    if(ports[i] >= FS_STM32F4xxUSART_NumPorts)
+    {
+      continue;
+    }
+
+    usart = &( usartList[ports[i]] );
+
+    if( !usart->enabled || usart->nineBit )
+    {
+      continue;
+    }
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+    // The block would bypass the compressor and corrupt its output.
+    if(NULL != usart->txEncoder)
+    {
+      continue;
+    }
+#endif
+
+    if( txSharedQueue(usart, block) )
+    {
+      queued++;
+
+      // Trigger an interrupt when the data register is empty to cause the main task to unblock.
+      USART_ITConfig(usart->peripheral, USART_IT_TXE, ENABLE);
+    }
   }
 
-  else
+  // Queued nowhere - the block is still the caller's.
+  if(0 == queued)
   {
+    block->refCount = 0;
     return 0;
   }
+
+  sharedBlockRelease(block);
+  return queued;
+
+#else
+  return 0;
+#endif
 }
 
-static uint16_t usart3_writeLine(const char * line)
+_Bool FS_STM32F4xxUSART_BaudCheckStart(FS_STM32F4xxUSART_Port_e port)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[2].enabled)
-  {
-    return writeLine( &( usartList[2] ), line );
-  }
+#if defined(FS_STM32F4XXUSART_ENABLE_BAUD_CHECK)
+  USART * usart;
+  EXTI_InitTypeDef extiInitStruct;
+  RCC_ClocksTypeDef clocks;
+  uint8_t portSource;
 
-  else
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled )
   {
-    return 0;
+    return false;
   }
-}
 
-static uint16_t usart3_rxBytesAvailable(void)
-{
-  if(usartList[2].enabled)
+  usart = &( usartList[port] );
+
+  if( ( USART_BAUD_CHECK_RUNNING == usart->baudCheckState ) || ( 0 == usart->rxd.portRCCMask ) )
   {
-    return rxBytesAvailable( &( usartList[2] ) ) ;
+    return false;
   }
 
-  else
+  usart->baudCheckCapture = baudCheckCaptureFind(usart);
+
+  // Without a capture channel edges are timed late, by as much as the EXTI interrupt's latency.
+  if( ( NULL == usart->baudCheckCapture ) && ( usart->baudRate > FS_STM32F4XXUSART_BAUD_CHECK_EXTI_MAX_BAUD ) )
   {
-    return 0;
+    return false;
   }
-}
 
-static uint16_t usart3_readBytes(char * buf, uint16_t numBytes)
-{
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[2].enabled)
+  // Start the cycle counter, if the application or a debugger hasn't already.
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  /*
+  Every edge of a character comes within 1 + wordBits bits of its start bit,
+  and the next start bit no sooner than half a stop bit after that.
+  */
+  RCC_GetClocksFreq(&clocks);
+  usart->baudCheckClockHz = clocks.HCLK_Frequency;
+  usart->baudCheckBitCycles = clocks.HCLK_Frequency / usart->baudRate;
+  usart->baudCheckCharCycles = ( ( ( 2 * ( 1 + usart->wordBits ) ) + 1 ) * usart->baudCheckBitCycles ) / 2;
+
+  usart->baudCheckSynced = false;
+  usart->baudCheckLastEdge = DWT->CYCCNT;
+  usart->baudCheckCycles = 0;
+  usart->baudCheckBits = 0;
+  usart->baudCheckEdges = 0;
+  usart->baudCheckState = USART_BAUD_CHECK_RUNNING;
+
+  if(usart->baudCheckCapture)
   {
-    return readBytes( &( usartList[2] ), buf, numBytes );
+    baudCheckCaptureStart(usart, &clocks);
+    return true;
   }
 
-  else
+  // The GPIO port's number, from its clock enable bit (RCC_AHB1Periph_GPIOx is 1 << x).
+  for(portSource = 0; !( usart->rxd.portRCCMask & ( (uint32_t)1 << portSource ) ); portSource++)
   {
-    return 0;
   }
+
+  RCC_APB2PeriphClockCmd(RCC_APB2Periph_SYSCFG, ENABLE);
+  SYSCFG_EXTILineConfig(portSource, usart->rxd.pinSource);
+
+  extiInitStruct.EXTI_Line = (uint32_t)1 << usart->rxd.pinSource;
+  extiInitStruct.EXTI_Mode = EXTI_Mode_Interrupt;
+  extiInitStruct.EXTI_Trigger = EXTI_Trigger_Rising_Falling;
+  extiInitStruct.EXTI_LineCmd = ENABLE;
+  EXTI->PR = extiInitStruct.EXTI_Line;
+  EXTI_Init(&extiInitStruct);
+
+  return true;
+#else
+  return false;
+#endif
 }
 
-static uint16_t usart3_readLine(char * buf)
+void FS_STM32F4xxUSART_BaudCheckEdge(FS_STM32F4xxUSART_Port_e port)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[2].enabled)
+#if defined(FS_STM32F4XXUSART_ENABLE_BAUD_CHECK)
+  USART * usart;
+  const USARTBaudCheckCapture * capture;
+  TIM_TypeDef * timer;
+  uint32_t now, sinceStart, captured, ticks;
+  uint16_t sr, channelIndex;
+  _Bool lost;
+
+  // Timestamp first, to keep the handler's own latency out of the measurement as far as possible.
+  now = DWT->CYCCNT;
+
+  if(port >= FS_STM32F4xxUSART_NumPorts)
   {
-    return readLine( &( usartList[2] ), buf );
+    return;
   }
 
+  usart = &( usartList[port] );
+  capture = usart->baudCheckCapture;
+  lost = false;
+
+  if(capture)
+  {
+    timer = capture->timer;
+    channelIndex = capture->channel >> 2;
+    sr = (uint16_t)timer->SR;
+
+    if( 0 == ( sr & ( TIM_SR_CC1IF << channelIndex ) ) )
+    {
+      return;
+    }
+
+    /*
+    The edge came when it was captured: as many timer ticks ago as the counter
+    has advanced since. Reading the capture clears its flag. Overcapture means
+    another edge came and went before this one was read.
+    */
+    captured = ( &( timer->CCR1 ) )[channelIndex];
+    ticks = ( timer->CNT - captured ) & capture->counterMask;
+    now = DWT->CYCCNT - ( ticks * usart->baudCheckTickCycles );
+
+    if( sr & ( TIM_SR_CC1OF << channelIndex ) )
+    {
+      timer->SR = (uint16_t)~( TIM_SR_CC1OF << channelIndex );
+      lost = true;
+    }
+  }
+
+  else
+  {
+    EXTI->PR = (uint32_t)1 << usart->rxd.pinSource;
+  }
+
+  if(USART_BAUD_CHECK_RUNNING != usart->baudCheckState)
+  {
+    return;
+  }
+
+  // Which character a lost edge belonged to is unknown - find a start bit afresh.
+  if(lost)
+  {
+    usart->baudCheckSynced = false;
+  }
+
+  // The line is high when idle, so an edge after a character time of silence is a start bit.
+  else if(!usart->baudCheckSynced)
+  {
+    if( ( now - usart->baudCheckLastEdge ) >= usart->baudCheckCharCycles )
+    {
+      usart->baudCheckSynced = true;
+      usart->baudCheckCharStart = now;
+    }
+  }
+
+  else
+  {
+    sinceStart = now - usart->baudCheckCharStart;
+
+    if(sinceStart >= usart->baudCheckCharCycles)
+    {
+      usart->baudCheckCharStart = now;
+    }
+
+    // Within a character, a whole number of (peer's) bits after the start bit.
+    else
+    {
+      usart->baudCheckCycles += sinceStart;
+      usart->baudCheckBits += ( sinceStart + ( usart->baudCheckBitCycles / 2 ) ) / usart->baudCheckBitCycles;
+    }
+  }
+
+  usart->baudCheckLastEdge = now;
+
+  if(++( usart->baudCheckEdges ) >= FS_STM32F4XXUSART_BAUD_CHECK_EDGES)
+  {
+    baudCheckStop(usart);
+    usart->baudCheckState = USART_BAUD_CHECK_DONE;
+  }
+#endif
+}
+
+_Bool FS_STM32F4xxUSART_BaudCheckResult(FS_STM32F4xxUSART_Port_e port, FS_STM32F4xxUSART_BaudCheck_t * result)
+{
+#if defined(FS_STM32F4XXUSART_ENABLE_BAUD_CHECK)
+  USART * usart;
+
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || ( USART_BAUD_CHECK_DONE != usartList[port].baudCheckState ) )
+  {
+    return false;
+  }
+
+  usart = &( usartList[port] );
+
+  result->configuredBaud = usart->baudRate;
+  result->bitsMeasured = usart->baudCheckBits;
+  result->measuredBaud = 0;
+  result->deviationPpm = 0;
+
+  if(usart->baudCheckBits)
+  {
+    result->measuredBaud = (uint32_t)( ( ( (uint64_t)usart->baudCheckClockHz * usart->baudCheckBits ) +
+                                         ( usart->baudCheckCycles / 2 ) ) / usart->baudCheckCycles );
+    // From the cycle counts rather than measuredBaud, which is too coarse at low rates.
+    result->deviationPpm = (int32_t)( (int64_t)( ( (uint64_t)usart->baudCheckClockHz * usart->baudCheckBits * 1000000u ) /
+                                                 ( (uint64_t)usart->baudCheckCycles * usart->baudRate ) ) - 1000000 );
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+_Bool FS_STM32F4xxUSART_GetActivityStats(FS_STM32F4xxUSART_ActivityStats_t * stats, _Bool reset)
+{
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+  FS_STM32F4xxOSAL_Ticks_t now;
+
+  now = FS_STM32F4xxOSAL_GetTicks();
+
+  // Take a consistent copy - the interrupt handlers update the counters too.
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+
+  *stats = activityStats;
+  stats->elapsedTicks = now - activityStartTicks;
+
+  if(reset)
+  {
+    memset( &activityStats, 0, sizeof(activityStats) );
+    activityStartTicks = now;
+  }
+
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+  return true;
+#else
+  return false;
+#endif
+}
+
+_Bool FS_STM32F4xxUSART_SetRxFaults(FS_STM32F4xxUSART_Port_e port, const FS_STM32F4xxUSART_RxFaults_t * faults)
+{
+#if defined(FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION)
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+  USART * usart;
+
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled )
+  {
+    return false;
+  }
+
+  usart = &( usartList[port] );
+
+  // Keep the service function from seeing a half-written configuration.
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+
+  usart->rxFaultsEnabled = false;
+
+  if(NULL != faults)
+  {
+    usart->rxFaults = *faults;
+    usart->rxFaultRandom = faults->seed ? faults->seed : 1;
+    memset( &( usart->rxFaultStats ), 0, sizeof(usart->rxFaultStats) );
+    usart->rxFaultsEnabled = true;
+  }
+
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+_Bool FS_STM32F4xxUSART_GetRxFaultStats(FS_STM32F4xxUSART_Port_e port, FS_STM32F4xxUSART_RxFaultStats_t * stats)
+{
+#if defined(FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION)
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled )
+  {
+    return false;
+  }
+
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+  *stats = usartList[port].rxFaultStats;
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+_Bool FS_STM32F4xxUSART_SetBaudSkew(FS_STM32F4xxUSART_Port_e port, int32_t ppm)
+{
+#if defined(FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION)
+  USART_TypeDef * peripheral;
+  uint32_t divider;
+  _Bool over8;
+
+  if( ( port >= FS_STM32F4xxUSART_NumPorts ) || !usartList[port].enabled ||
+      ( ppm > 100000 ) || ( ppm < -100000 ) )
+  {
+    return false;
+  }
+
+  peripheral = usartList[port].peripheral;
+  over8 = ( 0 != ( peripheral->CR1 & USART_CR1_OVER8 ) );
+
+  // USARTDIV in 1/16ths, or in 1/8ths when oversampling by 8 (BRR bit 3 is then unused).
+  divider = usartList[port].baseBrr;
+
+  if(over8)
+  {
+    divider = ( ( divider >> 4 ) << 3 ) | ( divider & 0x7 );
+  }
+
+  // A rate ppm faster needs a divider 1 + ppm/10^6 times smaller.
+  divider = (uint32_t)( ( ( (uint64_t)divider * 1000000u ) + ( ( 1000000 + ppm ) / 2 ) ) /
+                        (uint32_t)( 1000000 + ppm ) );
+
+  if(over8)
+  {
+    divider = ( ( divider >> 3 ) << 4 ) | ( divider & 0x7 );
+  }
+
+  peripheral->BRR = (uint16_t)divider;
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+_Bool FS_STM32F4xxUSART_GetTimingStats(FS_STM32F4xxUSART_TimingStats_t * stats, _Bool reset)
+{
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+
+  // Take a consistent copy - the handlers update these from interrupt context.
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+
+  *stats = timingStats;
+
+  if(reset)
+  {
+    cycleStatsReset( &( timingStats.irq ) );
+    cycleStatsReset( &( timingStats.service ) );
+  }
+
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void FS_STM32F4xxUSART_PeriphInitStructInit(FS_STM32F4xxUSART_PeriphInitStruct_t * initStruct)
+{
+  initStruct->initialise = false;
+  initStruct->peripheral = NULL;
+
+  initStruct->txd.pinMask = 0;
+  initStruct->txd.port = NULL;
+  initStruct->txd.pinSource = 0;
+  initStruct->txd.portRCCMask = 0;
+
+  initStruct->rxd.pinMask = 0;
+  initStruct->rxd.port = NULL;
+  initStruct->rxd.pinSource = 0;
+  initStruct->rxd.portRCCMask = 0;
+
+  initStruct->cts.pinMask = 0;
+  initStruct->cts.port = NULL;
+  initStruct->cts.pinSource = 0;
+  initStruct->cts.portRCCMask = 0;
+
+  initStruct->rts.pinMask = 0;
+  initStruct->rts.port = NULL;
+  initStruct->rts.pinSource = 0;
+  initStruct->rts.portRCCMask = 0;
+
+  initStruct->sclk.pinMask = 0;
+  initStruct->sclk.port = NULL;
+  initStruct->sclk.pinSource = 0;
+  initStruct->sclk.portRCCMask = 0;
+
+  initStruct->txBufferSizeBytes = 0;
+  initStruct->rxBufferSizeBytes = 0;
+
+  initStruct->compressTx = false;
+  initStruct->adaptiveRx = false;
+  initStruct->partialLineTimeoutTicks = 0;
+
+  initStruct->txByteGapUs = 0;
+  initStruct->txFrameGapUs = 0;
+  initStruct->txFrameEnd = '\n';
+
+  USART_StructInit( &( initStruct->stInitStruct ) );
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+// Init an individual peripheral instance.
+static _Bool initUsart(uint8_t listIndex, FS_STM32F4xxUSART_PeriphInitStruct_t * initStruct)
+{
+  GPIO_InitTypeDef gpioInitStruct;
+  NVIC_InitTypeDef nvicInitStruct;
+  uint32_t requiredBytes;
+  _Bool nineBit;
+
+  requiredBytes = initStruct->rxBufferSizeBytes + initStruct->txBufferSizeBytes;
+
+  /*
+  Nine data bits only if the ninth bit isn't taken by parity. Such a U(S)ART
+  needs room to align its buffers, and neither compression nor DMA reception
+  (both byte-oriented) is available for it.
+  */
+  nineBit = ( USART_WordLength_9b == initStruct->stInitStruct.USART_WordLength ) &&
+            ( USART_Parity_No == initStruct->stInitStruct.USART_Parity );
+
+  if(nineBit)
+  {
+    if(initStruct->compressTx || initStruct->adaptiveRx || initStruct->partialLineTimeoutTicks)
+    {
+      return false;
+    }
+
+    requiredBytes += 1;
+  }
+
+  // Compression needs room for its history window as well as the buffers.
+  if(initStruct->compressTx)
+  {
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+    requiredBytes += FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES;
+#else
+    return false;
+#endif
+  }
+
+#if !defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+  if(initStruct->txByteGapUs || initStruct->txFrameGapUs)
+  {
+    return false;
+  }
+#endif
+
+  /*
+  Firstly, check if enough memory remains in the master buffer to
+  satisfy the allocation requirements. If not, go no further.
+  */
+  if( requiredBytes >
+      (uint32_t)( FS_STM32F4XXUSART_MASTER_BUFFER_LENGTH_BYTES - masterBufferAllocatedBytes ) )
+  {
+    return false;
+  }
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+  /*
+  Claim the rx DMA stream before anything is committed, so that a clash with
+  another driver's stream leaves the port untouched. The stream itself is
+  only set up on demand.
+
+  A port being re-initialised may still be receiving by DMA, and the stream
+  must be stopped before it is released - it would otherwise go on writing
+  into the old rx buffer. If it won't stop, the port is left as it is.
+  */
+  if( usartList[listIndex].enabled && ( USART_RX_MODE_DMA == usartList[listIndex].rxMode ) )
+  {
+    exitRxDmaMode( &( usartList[listIndex] ) );
+
+    if(USART_RX_MODE_DMA == usartList[listIndex].rxMode)
+    {
+      return false;
+    }
+  }
+
+  FS_STM32F4xxDMA_Release( &( usartList[listIndex].rxDma ) );
+
+  if( initStruct->adaptiveRx &&
+      !FS_STM32F4xxDMA_Claim( (FS_STM32F4xxDMA_Request_e)( FS_STM32F4xxDMA_Request_USART1_Rx + listIndex ),
+                              rxDmaIrqHandler,
+                              &( usartList[listIndex] ),
+                              &( usartList[listIndex].rxDma ) ) )
+  {
+    return false;
+  }
+#else
+  if(initStruct->adaptiveRx)
+  {
+    return false;
+  }
+#endif
+
+  if( !FS_STM32F4xxOSAL_SignalCreate( &( usartList[listIndex].lineSignal ) ) )
+  {
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+    FS_STM32F4xxDMA_Release( &( usartList[listIndex].rxDma ) );
+#endif
+    return false;
+  }
+
+  // Copy the pertinent information into the USART list.
+  usartList[listIndex].enabled = true;
+  usartList[listIndex].peripheral = initStruct->peripheral;
+  usartList[listIndex].nineBit = nineBit;
+  usartList[listIndex].partialLineTimeoutTicks = initStruct->partialLineTimeoutTicks;
+  usartList[listIndex].lastRxTicks = FS_STM32F4xxOSAL_GetTicks();
+  usartList[listIndex].rxIdle = false;
+  usartList[listIndex].errors = 0;
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_CAPTURE)
+  usartList[listIndex].rxCapture = NULL;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_PIPELINE)
+  usartList[listIndex].rxPipeline = NULL;
+  usartList[listIndex].rxPipelineBusy = false;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION)
+  usartList[listIndex].rxFaultsEnabled = false;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_BAUD_CHECK)
+  usartList[listIndex].baudRate = initStruct->stInitStruct.USART_BaudRate;
+  usartList[listIndex].wordBits = ( USART_WordLength_9b == initStruct->stInitStruct.USART_WordLength ) ? 9 : 8;
+  // A check still running on the old pin would go on taking its interrupts.
+  if(USART_BAUD_CHECK_RUNNING == usartList[listIndex].baudCheckState)
+  {
+    baudCheckStop( &( usartList[listIndex] ) );
+  }
+
+  usartList[listIndex].rxd = initStruct->rxd;
+  usartList[listIndex].baudCheckState = USART_BAUD_CHECK_IDLE;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+  usartList[listIndex].txPaced = initStruct->txByteGapUs || initStruct->txFrameGapUs;
+  usartList[listIndex].txByteGapUs = initStruct->txByteGapUs;
+  usartList[listIndex].txFrameGapUs = initStruct->txFrameGapUs;
+  usartList[listIndex].txFrameEnd = initStruct->txFrameEnd;
+  usartList[listIndex].txCharUs = txCharTimeUs( &( initStruct->stInitStruct ) );
+  usartList[listIndex].txLastUs = 0;
+  usartList[listIndex].txDelayUs = 0;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_BROADCAST)
+  usartList[listIndex].txSharedHead = 0;
+  usartList[listIndex].txSharedCount = 0;
+  usartList[listIndex].txSharedOffset = 0;
+  usartList[listIndex].txSharedGapTotal = 0;
+#endif
+
+  // Init the buffers.
+  if(nineBit)
+  {
+    usartList[listIndex].txBuffer.length = initStruct->txBufferSizeBytes / 2;
+    usartList[listIndex].rxBuffer.length = initStruct->rxBufferSizeBytes / 2;
+    bufferInitWords( &( usartList[listIndex].txBuffer ) );
+    bufferInitWords( &( usartList[listIndex].rxBuffer ) );
+  }
+
+  else
+  {
+    usartList[listIndex].txBuffer.length = initStruct->txBufferSizeBytes;
+    usartList[listIndex].rxBuffer.length = initStruct->rxBufferSizeBytes;
+    bufferInit( &( usartList[listIndex].txBuffer ) );
+    bufferInit( &( usartList[listIndex].rxBuffer ) );
+  }
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+  usartList[listIndex].txEncoder = NULL;
+
+  if(initStruct->compressTx)
+  {
+    FS_STM32F4xxUSARTCompress_EncoderInit( &( txEncoderList[listIndex] ),
+                                           &( masterBuffer[masterBufferAllocatedBytes] ) );
+    masterBufferAllocatedBytes += FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES;
+    usartList[listIndex].txEncoder = &( txEncoderList[listIndex] );
+  }
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+  // All U(S)ARTs start out in per-byte mode.
+  usartList[listIndex].adaptiveRx = initStruct->adaptiveRx;
+  usartList[listIndex].rxMode = USART_RX_MODE_RXNE;
+  usartList[listIndex].rxWindowBytes = 0;
+  usartList[listIndex].rxWindowStartTicks = FS_STM32F4xxOSAL_GetTicks();
+#endif
+
+  // Start clocking the appropriate port blocks and change the pin functions:
+
+  // Set up a standard init struct to use for each pin.
+  GPIO_StructInit(&gpioInitStruct);
+  gpioInitStruct.GPIO_Mode = GPIO_Mode_AF;
+  gpioInitStruct.GPIO_OType = GPIO_OType_PP;
+  gpioInitStruct.GPIO_Speed = GPIO_Speed_2MHz;
+  gpioInitStruct.GPIO_PuPd = GPIO_PuPd_UP;
+
+  // Tx pin:
+
+  // Ensure the port block is being clocked.
+  RCC_AHB1PeriphClockCmd(initStruct->txd.portRCCMask, ENABLE);
+
+  // Init the pin.
+  gpioInitStruct.GPIO_Pin = initStruct->txd.pinMask;
+  GPIO_Init(initStruct->txd.port, &gpioInitStruct);
+
+  // Set the pin's alternate function appropriately.
+  GPIO_PinAFConfig(initStruct->txd.port, initStruct->txd.pinSource, afMaskTable[listIndex]);
+
+  // Rx pin:
+
+  // Ensure the port block is being clocked.
+  RCC_AHB1PeriphClockCmd(initStruct->rxd.portRCCMask, ENABLE);
+
+  // Init the pin.
+  gpioInitStruct.GPIO_Pin = initStruct->rxd.pinMask;
+  GPIO_Init(initStruct->rxd.port, &gpioInitStruct);
+
+  // Set the pin's alternate function appropriately.
+  GPIO_PinAFConfig(initStruct->rxd.port, initStruct->rxd.pinSource, afMaskTable[listIndex]);
+
+  // Determine if synchronous mode is to be used. If so, set up the clock pin:
+  if(NULL != initStruct->sclk.port)
+  {
+    // Ensure the port block is being clocked.
+    RCC_AHB1PeriphClockCmd(initStruct->sclk.portRCCMask, ENABLE);
+
+    // Init the pin.
+    gpioInitStruct.GPIO_Pin = initStruct->sclk.pinMask;
+    GPIO_Init(initStruct->sclk.port, &gpioInitStruct);
+
+    // Set the pin's alternate function appropriately.
+    GPIO_PinAFConfig(initStruct->sclk.port, initStruct->sclk.pinSource, afMaskTable[listIndex]);
+  }
+
+  // Determine if any hardware flow control functionality is required. If so set up the appropriate pin(s):
+
+
+  if( ( USART_HardwareFlowControl_CTS == initStruct->stInitStruct.USART_HardwareFlowControl ) ||
+      ( USART_HardwareFlowControl_RTS_CTS == initStruct->stInitStruct.USART_HardwareFlowControl ) )
+  {
+    // Ensure the port block is being clocked.
+    RCC_AHB1PeriphClockCmd(initStruct->cts.portRCCMask, ENABLE);
+
+    // Init the pin.
+    gpioInitStruct.GPIO_Pin = initStruct->cts.pinMask;
+    GPIO_Init(initStruct->cts.port, &gpioInitStruct);
+
+    // Set the pin's alternate function appropriately.
+    GPIO_PinAFConfig(initStruct->cts.port, initStruct->cts.pinSource, afMaskTable[listIndex]);
+  }
+
+  if( ( USART_HardwareFlowControl_RTS == initStruct->stInitStruct.USART_HardwareFlowControl ) ||
+      ( USART_HardwareFlowControl_RTS_CTS== initStruct->stInitStruct.USART_HardwareFlowControl ) )
+  {
+    // Ensure the port block is being clocked.
+    RCC_AHB1PeriphClockCmd(initStruct->rts.portRCCMask, ENABLE);
+
+    // Init the pin.
+    gpioInitStruct.GPIO_Pin = initStruct->rts.pinMask;
+    GPIO_Init(initStruct->rts.port, &gpioInitStruct);
+
+    // Set the pin's alternate function appropriately.
+    GPIO_PinAFConfig(initStruct->rts.port, initStruct->rts.pinSource, afMaskTable[listIndex]);
+  }
+
+  // Enable the clock to the U(S)ART in question.
+  if( ( listIndex >= 1 ) || ( listIndex <= 4 ) )
+  {
+    RCC_APB1PeriphClockCmd(periphClkCmdTable[listIndex], ENABLE);
+  }
+
+  else
+  {
+    RCC_APB2PeriphClockCmd(periphClkCmdTable[listIndex], ENABLE);
+  }
+
+  // If synchronous mode has been requested and the peripheral is capable of it, set up the clock.
+  USART_ClockInit( initStruct->peripheral, &( initStruct->stClkInitStruct ) );
+
+  // Initialise the U(S)ART peripheral and enable it.
+  USART_Init( initStruct->peripheral, &( initStruct->stInitStruct ) );
+  USART_Cmd(initStruct->peripheral, ENABLE);
+
+#if defined(FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION)
+  usartList[listIndex].baseBrr = initStruct->peripheral->BRR;
+#endif
+
+  // Enable the peripheral's channel in the interrupt controlller.
+  nvicInitStruct.NVIC_IRQChannel = initStruct->nvicIrqChannel;
+  nvicInitStruct.NVIC_IRQChannelPreemptionPriority = 8;
+  nvicInitStruct.NVIC_IRQChannelSubPriority = 1;
+  nvicInitStruct.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&nvicInitStruct);
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+  if(usartList[listIndex].txPaced)
+  {
+    txPacingTimerStart();
+  }
+#endif
+
+  // Enable the rx interrupt only - the tx interrupt will be enabled by the write functions.
+  USART_ITConfig(initStruct->peripheral, USART_IT_RXNE, ENABLE);
+
+  // The partial line timeout starts when the line goes idle.
+  if(initStruct->partialLineTimeoutTicks)
+  {
+    USART_ITConfig(initStruct->peripheral, USART_IT_IDLE, ENABLE);
+  }
+
+  return true;
+}
+
+// Redirection functions for peripheral instances.
+static uint16_t usart1_writeBytes(const char * bytes, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[0].enabled)
+  {
+    return writeBytes( &( usartList[0] ), bytes, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart1_writeLine(const char * line)
+{
+  if(usartList[0].enabled)
+  {
+    return writeLine( &( usartList[0] ), line );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart1_rxBytesAvailable(void)
+{
+  if(usartList[0].enabled)
+  {
+    return rxBytesAvailable( &( usartList[0] ) );
+  }
+
+  else
+  {
+    return 0;
+  }
+
+}
+
+static uint16_t usart1_readBytes(char * buf, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[0].enabled)
+  {
+    return readBytes( &( usartList[0] ), buf, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart1_readLine(char * buf)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[0].enabled)
+  {
+    return readLine( &( usartList[0] ), buf );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart1_readLineTruncate(char * buf, uint16_t maxLen)
+{
+  if(usartList[0].enabled)
+  {
+    return readLineTruncate( &( usartList[0] ), buf, maxLen );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart2_writeBytes(const char * bytes, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[1].enabled)
+  {
+    return writeBytes( &( usartList[1] ), bytes, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart2_writeLine(const char * line)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[1].enabled)
+  {
+    return writeLine( &( usartList[1] ), line );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart2_rxBytesAvailable(void)
+{
+  if(usartList[1].enabled)
+  {
+    return rxBytesAvailable( &( usartList[1] ) );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart2_readBytes(char * buf, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[1].enabled)
+  {
+    return readBytes( &( usartList[1] ), buf, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart2_readLine(char * buf)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[1].enabled)
+  {
+    return readLine( &( usartList[1] ), buf );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart2_readLineTruncate(char * buf, uint16_t maxLen)
+{
+  if(usartList[1].enabled)
+  {
+    return readLineTruncate( &( usartList[1] ), buf, maxLen );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart3_writeBytes(const char * bytes, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[2].enabled)
+  {
+    return writeBytes( &( usartList[2] ), bytes, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart3_writeLine(const char * line)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[2].enabled)
+  {
+    return writeLine( &( usartList[2] ), line );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart3_rxBytesAvailable(void)
+{
+  if(usartList[2].enabled)
+  {
+    return rxBytesAvailable( &( usartList[2] ) ) ;
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart3_readBytes(char * buf, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[2].enabled)
+  {
+    return readBytes( &( usartList[2] ), buf, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart3_readLine(char * buf)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[2].enabled)
+  {
+    return readLine( &( usartList[2] ), buf );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart3_readLineTruncate(char * buf, uint16_t maxLen)
+{
+  if(usartList[2].enabled)
+  {
+    return readLineTruncate( &( usartList[2] ), buf, maxLen );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart4_writeBytes(const char * bytes, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[3].enabled)
+  {
+    return writeBytes( &( usartList[3] ), bytes, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart4_writeLine(const char * line)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[3].enabled)
+  {
+    return writeLine( &( usartList[3] ), line );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart4_rxBytesAvailable(void)
+{
+  if(usartList[3].enabled)
+  {
+    return rxBytesAvailable( &( usartList[3] ) );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart4_readBytes(char * buf, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[3].enabled)
+  {
+    return readBytes( &( usartList[3] ), buf, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart4_readLine(char * buf)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[3].enabled)
+  {
+    return readLine( &( usartList[3] ), buf );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart4_readLineTruncate(char * buf, uint16_t maxLen)
+{
+  if(usartList[3].enabled)
+  {
+    return readLineTruncate( &( usartList[3] ), buf, maxLen );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart5_writeBytes(const char * bytes, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[4].enabled)
+  {
+    return writeBytes( &( usartList[4] ), bytes, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart5_writeLine(const char * line)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[4].enabled)
+  {
+    return writeLine( &( usartList[4] ), line );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart5_rxBytesAvailable(void)
+{
+  if(usartList[4].enabled)
+  {
+    return rxBytesAvailable( &( usartList[4] ) );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+
+static uint16_t uart5_readBytes(char * buf, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[4].enabled)
+  {
+    return readBytes( &( usartList[4] ), buf, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart5_readLine(char * buf)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[4].enabled)
+  {
+    return readLine( &( usartList[4] ), buf );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t uart5_readLineTruncate(char * buf, uint16_t maxLen)
+{
+  if(usartList[4].enabled)
+  {
+    return readLineTruncate( &( usartList[4] ), buf, maxLen );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart6_writeBytes(const char * bytes, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[5].enabled)
+  {
+    return writeBytes( &( usartList[5] ), bytes, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart6_writeLine(const char * line)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[5].enabled)
+  {
+    return writeLine( &( usartList[5] ), line );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart6_rxBytesAvailable(void)
+{
+  if(usartList[5].enabled)
+  {
+    return rxBytesAvailable( &( usartList[5] ) );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+
+static uint16_t usart6_readBytes(char * buf, uint16_t numBytes)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[5].enabled)
+  {
+    return readBytes( &( usartList[5] ), buf, numBytes );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart6_readLine(char * buf)
+{
+  // Redirect to implementation function if peripheral enabled.
+  if(usartList[5].enabled)
+  {
+    return readLine( &( usartList[5] ), buf );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t usart6_readLineTruncate(char * buf, uint16_t maxLen)
+{
+  if(usartList[5].enabled)
+  {
+    return readLineTruncate( &( usartList[5] ), buf, maxLen );
+  }
+
+  else
+  {
+    return 0;
+  }
+}
+
+// Implementation of FS_DT_USARTDriver_t.
+static uint16_t writeBytes(USART * usart, const char * bytes, uint16_t numBytes)
+{
+  // 9-bit U(S)ARTs are accessed with the word functions only.
+  if(usart->nineBit)
+  {
+    return 0;
+  }
+
+  // Check that the number of bytes to write won't overwhelm the buffer.
+  if(numBytes > usart->txBuffer.length)
+  {
+    return 0;
+  }
+
+  // Get the buffer's mutex.
+  if( FS_STM32F4xxOSAL_LockTake( &( usart->txBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    if( !txCompressedWriteFits(usart, numBytes) )
+    {
+      FS_STM32F4xxOSAL_LockGive( &( usart->txBuffer.mutex ) );
+      return 0;
+    }
+
+    txBufferWrite(usart, bytes, numBytes, true);
+
+    // Give the mutex back.
+    FS_STM32F4xxOSAL_LockGive( &( usart->txBuffer.mutex ) );
+
+    // Trigger an interrupt when the tx buffer is empty to cause the main task to unblock.
+    USART_ITConfig(usart->peripheral, USART_IT_TXE, ENABLE);
+
+    return numBytes;
+  }
+
+  // Mutex timed out.
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t writeLine(USART * usart, const char * line)
+{
+  size_t length;
+
+  // 9-bit U(S)ARTs are accessed with the word functions only.
+  if(usart->nineBit)
+  {
+    return 0;
+  }
+
+  /*
+  The line goes out with a '\n' appended, so check that the line and its
+  terminator together will not overwhelm the buffer.
+  */
+  length = strlen(line);
+
+  if( ( length + 1 ) > usart->txBuffer.length )
+  {
+    return 0;
+  }
+
+  /*
+  Write the line and its terminator under a single hold of the mutex so that
+  other tasks' output can't end up in the middle of the line.
+  */
+  if( FS_STM32F4xxOSAL_LockTake( &( usart->txBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    if( !txCompressedWriteFits( usart, (uint32_t)length + 1 ) )
+    {
+      FS_STM32F4xxOSAL_LockGive( &( usart->txBuffer.mutex ) );
+      return 0;
+    }
+
+    // One compressed group sequence and terminator for both.
+    txBufferWrite(usart, line, (uint16_t)length, false);
+    txBufferWrite(usart, "\n", 1, true);
+
+    // Give the mutex back.
+    FS_STM32F4xxOSAL_LockGive( &( usart->txBuffer.mutex ) );
+
+    // Trigger an interrupt when the tx buffer is empty to cause the main task to unblock.
+    USART_ITConfig(usart->peripheral, USART_IT_TXE, ENABLE);
+
+    return (uint16_t)( length + 1 );
+  }
+
+  // Mutex timed out - indicate to the caller.
+  else
+  {
+    return 0;
+  }
+}
+
+static uint16_t rxBytesAvailable(USART * usart)
+{
+  uint16_t retVal;
+
+  // 9-bit U(S)ARTs are accessed with the word functions only.
+  if(usart->nineBit)
+  {
+    return 0;
+  }
+
+  retVal = 0;
+
+  if( FS_STM32F4xxOSAL_LockTake( &( usart->rxBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    retVal = usart->rxBuffer.fillLevel;
+    FS_STM32F4xxOSAL_LockGive( &( usart->rxBuffer.mutex ) );
+  }
+
+  return retVal;
+}
+
+static uint16_t readBytes(USART * usart, char * buf, uint16_t numBytes)
+{
+  uint16_t bytesToRead, bytesBeforeBufferEnd, bufferAfterHead, secondBlockLength;
+
+  // 9-bit U(S)ARTs are accessed with the word functions only.
+  if(usart->nineBit)
+  {
+    return 0;
+  }
+
+  if( FS_STM32F4xxOSAL_LockTake( &( usart->rxBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    // If there at least the requested number of bytes are available, we will copy the requested number.
+    if(usart->rxBuffer.fillLevel >= numBytes)
+    {
+      bytesToRead = numBytes;
+    }
+
+    // Otherwise we'll copy whatever is available.
+    else
+    {
+      bytesToRead = usart->rxBuffer.fillLevel;
+    }
+
+    /*
+    Determine if the bytes to copy are in one contiguous block or if we need to
+    copy one block from the end of the buffer and then another from the start.
+    */
+    bufferAfterHead = usart->rxBuffer.base + usart->rxBuffer.length - usart->rxBuffer.head;
+
+    if(bytesToRead <= bufferAfterHead)
+    {
+      copyBytes(buf, &( masterBuffer[usart->rxBuffer.head] ), bytesToRead);
+
+      // Wrap the head pointer if necessary.
+      if(bytesToRead == bufferAfterHead)
+      {
+        usart->rxBuffer.head = usart->rxBuffer.base;
+      }
+
+      else
+      {
+        usart->rxBuffer.head += bytesToRead;
+      }
+    }
+
+    else
+    {
+      bytesBeforeBufferEnd = usart->rxBuffer.base + usart->rxBuffer.length - usart->rxBuffer.head;
+      secondBlockLength = bytesToRead - bytesBeforeBufferEnd;
+
+      copyBytes( buf, &( masterBuffer[usart->rxBuffer.head] ), bytesBeforeBufferEnd);
+      copyBytes( &( buf[bytesBeforeBufferEnd] ),
+              &( masterBuffer[usart->rxBuffer.base] ),
+              secondBlockLength );
+
+      usart->rxBuffer.head = usart->rxBuffer.base + secondBlockLength;
+    }
+
+    usart->rxBuffer.fillLevel -= bytesToRead;
+
+    // Release the buffer's mutex.
+    FS_STM32F4xxOSAL_LockGive( &( usart->rxBuffer.mutex ) );
+
+    return bytesToRead;
+  }
+
+  // Could not get the mutex - no bytes read.
+  else
+  {
+    return 0;
+  }
+}
+
+/*
+Read the first line in the rx buffer into buf as a string, without its '\n',
+and remove it from the buffer. buf must be able to hold the rx buffer's length
+plus a terminator. Returns the length of the string (so 0 for an empty line as
+well as for no line).
+*/
+static uint16_t readLine(USART * usart, char * buf)
+{
+  uint16_t lineLength, contentLength;
+
+  // 9-bit U(S)ARTs are accessed with the word functions only.
+  if(usart->nineBit)
+  {
+    return 0;
+  }
+
+  if( FS_STM32F4xxOSAL_LockTake( &( usart->rxBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    lineLength = rxLineLength(usart, &contentLength);
+
+    if(lineLength)
+    {
+      bufferCopyOut( &( usart->rxBuffer ), buf, contentLength );
+
+      // Append a NULL terminator so that the target buffer contains a string.
+      buf[contentLength] = 0;
+
+      // The line ending goes too.
+      bufferDiscard( &( usart->rxBuffer ), lineLength );
+    }
+
+    FS_STM32F4xxOSAL_LockGive( &( usart->rxBuffer.mutex ) );
+    return contentLength;
+  }
+
+  // Could not take the semaphore - no bytes read.
+  else
+  {
+    return 0;
+  }
+}
+
+/*
+As readLine, but copy at most maxLen bytes of the line (buf must hold maxLen
+plus a terminator). The rest of the line is still removed from the buffer.
+*/
+static uint16_t readLineTruncate(USART * usart, char * buf, uint16_t maxLen)
+{
+  uint16_t lineLength, contentLength;
+
+  // 9-bit U(S)ARTs are accessed with the word functions only.
+  if(usart->nineBit)
+  {
+    return 0;
+  }
+
+  if( FS_STM32F4xxOSAL_LockTake( &( usart->rxBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    lineLength = rxLineLength(usart, &contentLength);
+
+    if(lineLength)
+    {
+      if(contentLength > maxLen)
+      {
+        contentLength = maxLen;
+      }
+
+      bufferCopyOut( &( usart->rxBuffer ), buf, contentLength );
+
+      // Append a NULL terminator so that the target buffer contains a string.
+      buf[contentLength] = 0;
+
+      // Purge the whole line, including anything truncated.
+      bufferDiscard( &( usart->rxBuffer ), lineLength );
+    }
+
+    FS_STM32F4xxOSAL_LockGive( &( usart->rxBuffer.mutex ) );
+    return contentLength;
+  }
+
+  // Could not take the semaphore - no bytes read.
   else
   {
     return 0;
   }
-}
+}
+
+/*
+Length of the first line in the rx buffer including its '\n', and in
+contentLength excluding it, or 0 for both if no line can be read yet. With no
+line ending received, the whole contents count as a line if the buffer is full,
+since no line could ever complete, or if the partial line timeout has expired.
+The caller must hold the rx buffer's mutex.
+*/
+static uint16_t rxLineLength(USART * usart, uint16_t * contentLength)
+{
+  USARTBuffer * buf;
+  uint16_t i;
+
+  buf = &( usart->rxBuffer );
+
+  if( bufferFindByte(buf, '\n', &i) )
+  {
+    *contentLength = i;
+    return i + 1;
+  }
+
+  if( buf->fillLevel &&
+      ( ( buf->fillLevel == buf->length ) ||
+        ( usart->partialLineTimeoutTicks &&
+          ( ( FS_STM32F4xxOSAL_GetTicks() - usart->lastRxTicks ) >= usart->partialLineTimeoutTicks ) ) ) )
+  {
+    *contentLength = buf->fillLevel;
+    return buf->fillLevel;
+  }
+
+  *contentLength = 0;
+  return 0;
+}
+
+/*
+Which of the given select conditions currently hold. Fill levels are read
+without the buffers' mutexes - a stale value only delays or repeats a wake-up.
+*/
+static uint32_t selectReady(uint32_t conditions)
+{
+  USART * usart;
+  uint32_t ready;
+  uint16_t writableSpace;
+  uint8_t port;
+
+  ready = 0;
+
+  for(port = 0; port < FS_STM32F4xxUSART_NumPorts; port++)
+  {
+    usart = &( usartList[port] );
+
+    if( !usart->enabled )
+    {
+      continue;
+    }
+
+    if( usart->rxBuffer.fillLevel )
+    {
+      ready |= FS_STM32F4XXUSART_SELECT_READABLE(port);
+    }
+
+    writableSpace = FS_STM32F4XXUSART_SELECT_WRITABLE_BYTES;
+
+    if(writableSpace > usart->txBuffer.length)
+    {
+      writableSpace = usart->txBuffer.length;
+    }
+
+    if( ( usart->txBuffer.length - usart->txBuffer.fillLevel ) >= writableSpace )
+    {
+      ready |= FS_STM32F4XXUSART_SELECT_WRITABLE(port);
+    }
+
+    if(usart->errors)
+    {
+      ready |= FS_STM32F4XXUSART_SELECT_ERROR(port);
+    }
+  }
+
+  return ready & conditions;
+}
+
+// Record FS_STM32F4XXUSART_ERROR_* flags from task context - the interrupt handler sets flags too.
+static void latchError(USART * usart, uint8_t flags)
+{
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+  usart->errors |= flags;
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+}
+
+/*
+Check that numBytes written to a compressing U(S)ART will fit in its tx
+buffer's free space, taking the worst-case encoded size. Uncompressed writes
+are always let through (bufferWriteBlock keeps the newest data), but a
+compressed stream with bytes missing can't be decoded from that point on, so
+compressed writes which might not fit are refused before the encoder sees
+them. The caller must hold the tx buffer's mutex.
+*/
+static _Bool txCompressedWriteFits(USART * usart, uint32_t numBytes)
+{
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+  if( ( NULL != usart->txEncoder ) &&
+      ( FS_STM32F4XXUSARTCOMPRESS_MAX_ENCODED_BYTES(numBytes) >
+        (uint32_t)( usart->txBuffer.length - usart->txBuffer.fillLevel ) ) )
+  {
+    return false;
+  }
+#else
+  (void)usart;
+  (void)numBytes;
+#endif
+
+  return true;
+}
+
+/*
+Insert bytes destined for the wire into a U(S)ART's tx buffer, compressing
+them first if the U(S)ART has been set up to do so. Without flush, compressed
+output may be held back for the next call, which must follow under the same
+hold of the tx buffer's mutex. The caller must hold the mutex.
+*/
+static uint16_t txBufferWrite(USART * usart, const char * bytes, uint16_t numBytes, _Bool flush)
+{
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+  if(NULL != usart->txEncoder)
+  {
+    return FS_STM32F4xxUSARTCompress_Encode( usart->txEncoder,
+                                             bytes,
+                                             numBytes,
+                                             flush,
+                                             compressedTxSink,
+                                             &( usart->txBuffer ) );
+  }
+#endif
+
+  bufferWriteBlock( &( usart->txBuffer ), bytes, numBytes );
+  return numBytes;
+}
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_COMPRESSION)
+// Receives compressor output and places it in the tx buffer passed as ctx.
+static void compressedTxSink(void * ctx, const char * bytes, uint16_t numBytes)
+{
+  bufferWriteBlock( (USARTBuffer *)ctx, bytes, numBytes );
+}
+#endif
+
+static void mainLoop(void * params)
+{
+  while(true)
+  {
+    // Block until there's work to do.
+    if( FS_STM32F4xxOSAL_SignalWait( &irqSyncSignal, FS_STM32F4XXOSAL_WAIT_FOREVER ) )
+    {
+      servicePass();
+    }
+  }
+}
+
+/*
+Service every enabled U(S)ART once. Used by mainLoop, and called directly by
+bare-metal applications which have no task to run mainLoop in. Checks the
+peripherals' flags itself so is also safe to call when nothing has signalled.
+*/
+RAMFUNC static void servicePass(void)
+{
+  static uint8_t startIndex = 0;
+  uint8_t i;
+  _Bool quotaReached;
+  USART * usart;
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS) || defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  uint32_t startCycles;
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+#endif
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  uint32_t passCycles;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS) || defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  startCycles = DWT->CYCCNT;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  activityPassUseful = false;
+#endif
+
+  quotaReached = false;
+
+  /*
+  Start from a different U(S)ART on each pass so that a flood on one can
+  only ever delay the others by its quota, whichever position it has in
+  the list.
+  */
+  for(i = 0; i < 6; i++)
+  {
+    usart = &( usartList[( startIndex + i ) % 6] );
+
+    if(usart->enabled)
+    {
+      if( serviceUsart(usart) )
+      {
+        quotaReached = true;
+      }
+    }
+  }
+
+  startIndex = ( startIndex + 1 ) % 6;
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+  // Interrupt handlers update the other set of stats.
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+  cycleStatsAdd( &( timingStats.service ), DWT->CYCCNT - startCycles );
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  passCycles = DWT->CYCCNT - startCycles;
+
+  // Interrupt handlers update the interrupt counts alongside.
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+
+  activityStats.passes++;
+
+  if(!activityPassUseful)
+  {
+    activityStats.idlePasses++;
+  }
+
+  activityStats.serviceCycles += passCycles;
+
+  if(passCycles > activityStats.maxPassCycles)
+  {
+    activityStats.maxPassCycles = passCycles;
+  }
+
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+#endif
+
+  /*
+  A U(S)ART with work left over after using its quota may not interrupt
+  again (e.g. a full tx buffer waiting on an already-empty data register),
+  so make sure another pass happens.
+  */
+  if(quotaReached)
+  {
+    FS_STM32F4xxOSAL_SignalGive(&irqSyncSignal);
+  }
+}
+
+/*
+Move up to FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES bytes in each direction
+between a U(S)ART and its buffers. Returns true if either direction used its
+whole quota, i.e. there may be more to do.
+*/
+RAMFUNC static _Bool serviceUsart(USART * usart)
+{
+  uint16_t quota, word;
+  char data;
+  _Bool quotaReached, popped, lineEnded;
+  uint32_t selectFlags;
+  uint8_t port;
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+  uint16_t received;
+#endif
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_CAPTURE)
+  FS_STM32F4xxUSARTCapture_t * capture;
+  char rxChunk[FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES];
+#endif
+
+  quotaReached = false;
+  port = (uint8_t)( usart - usartList );
+  selectFlags = 0;
+
+  // Transmit for as long as the data register is free and there's data to send.
+  for(quota = FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES; quota; quota--)
+  {
+    if( SET != USART_GetFlagStatus(usart->peripheral, USART_FLAG_TXE) )
+    {
+      break;
+    }
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+    // The pacing timer will bring about another pass once the gap has passed.
+    if( usart->txPaced && !txPacingReady(usart) )
+    {
+      break;
+    }
+#endif
+
+    if(usart->nineBit)
+    {
+      popped = bufferPopWord( &( usart->txBuffer ), &word );
+    }
+
+    else
+    {
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_BROADCAST)
+      popped = txPop(usart, &data);
+#else
+      popped = bufferPop( &( usart->txBuffer ), &data );
+#endif
+      word = (uint16_t)data & 0x00FF;
+    }
+
+    if(popped)
+    {
+      USART_SendData(usart->peripheral, word);
+      USART_ITConfig(usart->peripheral, USART_IT_TXE, ENABLE);
+      selectFlags |= FS_STM32F4XXUSART_SELECT_WRITABLE(port);
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+      activityStats.ports[port].bytesSent++;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+      /*
+      Paced bytes are only sent with the line idle, so each goes straight to
+      the shift register and its time on the line starts now.
+      */
+      if(usart->txPaced)
+      {
+        usart->txLastUs = FS_STM32F4XXUSART_TX_PACING_TIM->CNT;
+        usart->txDelayUs = usart->txCharUs +
+                           ( ( !usart->nineBit && ( (char)word == usart->txFrameEnd ) ) ?
+                             usart->txFrameGapUs : usart->txByteGapUs );
+      }
+#endif
+    }
+
+    else
+    {
+      // If no data to send, prevent any further tx interrupts.
+      USART_ITConfig(usart->peripheral, USART_IT_TXE, DISABLE);
+      break;
+    }
+  }
 
-static uint16_t usart3_readLineTruncate(char * buf, uint16_t maxLen)
-{
-  if(usartList[2].enabled)
+  if(0 == quota)
   {
-    return readLineTruncate( &( usartList[2] ), buf, maxLen );
+    quotaReached = true;
   }
 
-  else
+  lineEnded = false;
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+  /*
+  In DMA mode, the data is already in the buffer and just needs accounting for.
+  Line waiters are woken by the idle interrupt at the end of each burst rather
+  than by scanning for line endings.
+  */
+  if(USART_RX_MODE_DMA == usart->rxMode)
   {
-    return 0;
+    received = rxDmaUpdate(usart, FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS);
+    usart->rxWindowBytes += received;
+
+    if(received)
+    {
+      usart->lastRxTicks = FS_STM32F4xxOSAL_GetTicks();
+      selectFlags |= FS_STM32F4XXUSART_SELECT_READABLE(port);
+    }
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+    activityStats.ports[port].bytesReceived += received;
+#endif
   }
-}
 
-static uint16_t uart4_writeBytes(const char * bytes, uint16_t numBytes)
-{
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[3].enabled)
+  else
+#endif
   {
-    return writeBytes( &( usartList[3] ), bytes, numBytes );
+    // Receive whatever has arrived, up to the quota.
+    for(quota = FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES; quota; quota--)
+    {
+      if( SET != USART_GetFlagStatus(usart->peripheral, USART_FLAG_RXNE) )
+      {
+        break;
+      }
+
+      // Timestamp before the data goes in, so no reader sees new data with an old time.
+      if(FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES == quota)
+      {
+        usart->lastRxTicks = FS_STM32F4xxOSAL_GetTicks();
+      }
+
+      word = USART_ReceiveData(usart->peripheral);
+      selectFlags |= FS_STM32F4XXUSART_SELECT_READABLE(port);
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+      activityStats.ports[port].bytesReceived++;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_CAPTURE)
+      // As received - ahead of any injected fault.
+      rxChunk[FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES - quota] = (char)word;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION)
+      if( usart->rxFaultsEnabled && !rxFaultInject(usart, &word) )
+      {
+        continue;
+      }
+#endif
+
+      if( usart->rxBuffer.fillLevel == usart->rxBuffer.length )
+      {
+        latchError(usart, FS_STM32F4XXUSART_ERROR_RX_BUFFER_OVERFLOW);
+      }
+
+      if(usart->nineBit)
+      {
+        // A word which can't be stored is lost, just as one arriving to a full buffer.
+        if( !bufferPushWord( &( usart->rxBuffer ), word & 0x01FF ) )
+        {
+          latchError(usart, FS_STM32F4XXUSART_ERROR_RX_BUFFER_OVERFLOW);
+        }
+      }
+
+      else
+      {
+        bufferPush( &( usart->rxBuffer), (char)word );
+
+        if('\n' == (char)word)
+        {
+          lineEnded = true;
+        }
+      }
+    }
+
+    if(0 == quota)
+    {
+      quotaReached = true;
+    }
+
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_CAPTURE)
+    // Everything received this pass goes into one record.
+    capture = usart->rxCapture;
+
+    if( ( NULL != capture ) && ( quota < FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES ) )
+    {
+      FS_STM32F4xxUSARTCapture_Record( capture, rxChunk, FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES - quota );
+    }
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+    usart->rxWindowBytes += FS_STM32F4XXUSART_SERVICE_QUOTA_BYTES - quota;
+#endif
+
+    // Re-enable rx interrupts.
+    USART_ITConfig(usart->peripheral, USART_IT_RXNE, ENABLE);
+
+    // The interrupt handler may have masked the idle interrupt until the data register was read.
+    if(usart->partialLineTimeoutTicks)
+    {
+      USART_ITConfig(usart->peripheral, USART_IT_IDLE, ENABLE);
+    }
   }
 
-  else
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_PIPELINE)
+  rxPipelineRun(usart);
+#endif
+
+  // Wake any task waiting for a line to check again.
+  if( lineEnded || usart->rxIdle )
   {
-    return 0;
+    usart->rxIdle = false;
+    FS_STM32F4xxOSAL_SignalGive( &( usart->lineSignal ) );
   }
-}
 
-static uint16_t uart4_writeLine(const char * line)
-{
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[3].enabled)
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  // Data moved in either direction.
+  if(selectFlags)
   {
-    return writeLine( &( usartList[3] ), line );
+    activityStats.ports[port].usefulPasses++;
+    activityPassUseful = true;
   }
+#endif
 
-  else
+  // And any task selecting on this U(S)ART.
+  if(usart->errors)
   {
-    return 0;
+    selectFlags |= FS_STM32F4XXUSART_SELECT_ERROR(port);
   }
-}
 
-static uint16_t uart4_rxBytesAvailable(void)
-{
-  if(usartList[3].enabled)
+  if(selectFlags)
   {
-    return rxBytesAvailable( &( usartList[3] ) );
+    FS_STM32F4xxOSAL_EventsSet(&selectEvents, selectFlags);
   }
 
-  else
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+  if(usart->adaptiveRx)
   {
-    return 0;
+    adaptRxMode(usart);
   }
+#endif
+
+  return quotaReached;
 }
 
-static uint16_t uart4_readBytes(char * buf, uint16_t numBytes)
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_PIPELINE)
+/*
+Feed everything in the rx buffer to the attached pipeline, in place, and
+consume it. The stages run from a snapshot of the buffer taken under its
+mutex, but without holding it - on bare metal the mutex masks interrupts.
+Only this task receives into the buffer (SetRxPipeline refuses adaptive rx
+ports, whose DMA stream writes into it directly), and RxInject refuses
+anything that would overwrite the snapshot, so the data can't change under the
+stages.
+*/
+static void rxPipelineRun(USART * usart)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[3].enabled)
+  FS_STM32F4xxUSARTPipeline_t * pipeline;
+  USARTBuffer * buf;
+  uint16_t head, fillLevel, bytesAfterHead;
+
+  pipeline = usart->rxPipeline;
+  buf = &( usart->rxBuffer );
+
+  if( ( NULL == pipeline ) || ( 0 == buf->fillLevel ) )
   {
-    return readBytes( &( usartList[3] ), buf, numBytes );
+    return;
   }
 
-  else
+  if( !FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
-    return 0;
+    return;
   }
-}
 
-static uint16_t uart4_readLine(char * buf)
-{
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[3].enabled)
+  head = buf->head;
+  fillLevel = buf->fillLevel;
+  usart->rxPipelineBusy = true;
+
+  FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
+
+  bytesAfterHead = buf->base + buf->length - head;
+
+  // In two parts if the data wraps around the end of the buffer.
+  if(fillLevel <= bytesAfterHead)
   {
-    return readLine( &( usartList[3] ), buf );
+    FS_STM32F4xxUSARTPipeline_Feed( pipeline, &( masterBuffer[head] ), fillLevel );
   }
 
   else
   {
-    return 0;
+    FS_STM32F4xxUSARTPipeline_Feed( pipeline, &( masterBuffer[head] ), bytesAfterHead );
+    FS_STM32F4xxUSARTPipeline_Feed( pipeline, &( masterBuffer[buf->base] ), fillLevel - bytesAfterHead );
   }
+
+  // The data has been fed, so must be consumed whatever the wait.
+  FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXOSAL_WAIT_FOREVER );
+  bufferDiscard(buf, fillLevel);
+  usart->rxPipelineBusy = false;
+  FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
 }
+#endif
 
-static uint16_t uart4_readLineTruncate(char * buf, uint16_t maxLen)
+#if defined(FS_STM32F4XXUSART_ENABLE_FAULT_INJECTION)
+/*
+Apply the configured faults to a received byte. Returns false if the byte is
+to be lost.
+*/
+static _Bool rxFaultInject(USART * usart, uint16_t * word)
 {
-  if(usartList[3].enabled)
+  if( rxFaultRoll(usart, usart->rxFaults.drop) )
   {
-    return readLineTruncate( &( usartList[3] ), buf, maxLen );
+    usart->rxFaultStats.drops++;
+    return false;
   }
 
-  else
+  if( rxFaultRoll(usart, usart->rxFaults.overrun) )
   {
-    return 0;
+    usart->rxFaultStats.overruns++;
+    latchError(usart, FS_STM32F4XXUSART_ERROR_OVERRUN);
+    return false;
   }
-}
 
-static uint16_t uart5_writeBytes(const char * bytes, uint16_t numBytes)
-{
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[4].enabled)
+  if( rxFaultRoll(usart, usart->rxFaults.framingError) )
   {
-    return writeBytes( &( usartList[4] ), bytes, numBytes );
+    usart->rxFaultStats.framingErrors++;
+    latchError(usart, FS_STM32F4XXUSART_ERROR_FRAMING);
   }
 
-  else
+  if( rxFaultRoll(usart, usart->rxFaults.noise) )
   {
-    return 0;
+    usart->rxFaultStats.noiseErrors++;
+    latchError(usart, FS_STM32F4XXUSART_ERROR_NOISE);
   }
-}
 
-static uint16_t uart5_writeLine(const char * line)
-{
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[4].enabled)
+  if( rxFaultRoll(usart, usart->rxFaults.bitFlip) )
   {
-    return writeLine( &( usartList[4] ), line );
+    usart->rxFaultStats.bitFlips++;
+    *word ^= (uint16_t)( 1u << ( usart->rxFaultRandom % ( usart->nineBit ? 9 : 8 ) ) );
   }
 
-  else
-  {
-    return 0;
-  }
+  return true;
 }
 
-static uint16_t uart5_rxBytesAvailable(void)
+// Whether a fault of the given probability (in 1/65536ths) occurs, stepping the xorshift32 sequence.
+static _Bool rxFaultRoll(USART * usart, uint16_t probability)
 {
-  if(usartList[4].enabled)
-  {
-    return rxBytesAvailable( &( usartList[4] ) );
-  }
+  uint32_t x;
 
-  else
+  if(0 == probability)
   {
-    return 0;
+    return false;
   }
-}
 
+  x = usart->rxFaultRandom;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  usart->rxFaultRandom = x;
 
-static uint16_t uart5_readBytes(char * buf, uint16_t numBytes)
+  return ( x >> 16 ) < probability;
+}
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_BAUD_CHECK)
+/*
+The first capture channel on the port's rx pin whose timer is free: neither
+the tx pacing timer nor one another port's check is using. NULL if none.
+*/
+static const USARTBaudCheckCapture * baudCheckCaptureFind(USART * usart)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[4].enabled)
-  {
-    return readBytes( &( usartList[4] ), buf, numBytes );
-  }
+  const USARTBaudCheckCapture * capture;
+  uint8_t i, j;
+  _Bool inUse;
 
-  else
+  for(i = 0; i < ( sizeof(baudCheckCaptureTable) / sizeof(baudCheckCaptureTable[0]) ); i++)
   {
-    return 0;
+    capture = &( baudCheckCaptureTable[i] );
+
+    if( ( capture->portRCCMask != usart->rxd.portRCCMask ) || ( capture->pinSource != usart->rxd.pinSource ) )
+    {
+      continue;
+    }
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+    if(FS_STM32F4XXUSART_TX_PACING_TIM == capture->timer)
+    {
+      continue;
+    }
+#endif
+
+    inUse = false;
+
+    for(j = 0; j < FS_STM32F4xxUSART_NumPorts; j++)
+    {
+      if( ( &( usartList[j] ) != usart ) &&
+          ( USART_BAUD_CHECK_RUNNING == usartList[j].baudCheckState ) &&
+          usartList[j].baudCheckCapture &&
+          ( usartList[j].baudCheckCapture->timer == capture->timer ) )
+      {
+        inUse = true;
+      }
+    }
+
+    if(!inUse)
+    {
+      return capture;
+    }
   }
+
+  return NULL;
 }
 
-static uint16_t uart5_readLine(char * buf)
+/*
+Run the timer free at its full clock rate, capturing both edges on the rx pin,
+and hand the pin over to it from the U(S)ART.
+*/
+static void baudCheckCaptureStart(USART * usart, const RCC_ClocksTypeDef * clocks)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[4].enabled)
+  const USARTBaudCheckCapture * capture;
+  TIM_TimeBaseInitTypeDef timInitStruct;
+  TIM_ICInitTypeDef icInitStruct;
+  uint32_t timerClockHz;
+  uint16_t channelIndex;
+
+  capture = usart->baudCheckCapture;
+  channelIndex = capture->channel >> 2;
+
+  if(capture->timerOnAPB2)
   {
-    return readLine( &( usartList[4] ), buf );
+    RCC_APB2PeriphClockCmd(capture->timerRCCMask, ENABLE);
+    timerClockHz = clocks->PCLK2_Frequency;
   }
 
   else
   {
-    return 0;
+    RCC_APB1PeriphClockCmd(capture->timerRCCMask, ENABLE);
+    timerClockHz = clocks->PCLK1_Frequency;
   }
-}
 
-static uint16_t uart5_readLineTruncate(char * buf, uint16_t maxLen)
-{
-  if(usartList[4].enabled)
+  // Timers are clocked at twice their APB clock unless its prescaler is 1.
+  if(timerClockHz != clocks->HCLK_Frequency)
   {
-    return readLineTruncate( &( usartList[4] ), buf, maxLen );
+    timerClockHz *= 2;
   }
 
-  else
-  {
-    return 0;
-  }
+  usart->baudCheckTickCycles = clocks->HCLK_Frequency / timerClockHz;
+
+  TIM_TimeBaseStructInit(&timInitStruct);
+  timInitStruct.TIM_Prescaler = 0;
+  timInitStruct.TIM_Period = capture->counterMask;
+  timInitStruct.TIM_CounterMode = TIM_CounterMode_Up;
+  TIM_TimeBaseInit(capture->timer, &timInitStruct);
+
+  TIM_ICStructInit(&icInitStruct);
+  icInitStruct.TIM_Channel = capture->channel;
+  icInitStruct.TIM_ICPolarity = TIM_ICPolarity_BothEdge;
+  icInitStruct.TIM_ICSelection = TIM_ICSelection_DirectTI;
+  icInitStruct.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+  icInitStruct.TIM_ICFilter = 0;
+  TIM_ICInit(capture->timer, &icInitStruct);
+
+  capture->timer->SR = (uint16_t)~( ( TIM_SR_CC1IF | TIM_SR_CC1OF ) << channelIndex );
+  capture->timer->DIER |= (uint16_t)( TIM_DIER_CC1IE << channelIndex );
+  TIM_Cmd(capture->timer, ENABLE);
+
+  GPIO_PinAFConfig(usart->rxd.port, usart->rxd.pinSource, capture->af);
 }
 
-static uint16_t usart6_writeBytes(const char * bytes, uint16_t numBytes)
+// Stop timing edges, giving the rx pin back to the U(S)ART if a timer had it.
+static void baudCheckStop(USART * usart)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[5].enabled)
+  const USARTBaudCheckCapture * capture;
+
+  capture = usart->baudCheckCapture;
+
+  if(capture)
   {
-    return writeBytes( &( usartList[5] ), bytes, numBytes );
+    capture->timer->DIER &= (uint16_t)~( TIM_DIER_CC1IE << ( capture->channel >> 2 ) );
+    TIM_Cmd(capture->timer, DISABLE);
+    GPIO_PinAFConfig(usart->rxd.port, usart->rxd.pinSource, afMaskTable[usart - usartList]);
   }
 
   else
   {
-    return 0;
+    EXTI->IMR &= ~( (uint32_t)1 << usart->rxd.pinSource );
   }
 }
+#endif
 
-static uint16_t usart6_writeLine(const char * line)
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+// Time on the line of one character - start, data, parity and stop bits - in microseconds, rounded up.
+static uint32_t txCharTimeUs(USART_InitTypeDef * stInitStruct)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[5].enabled)
-  {
-    return writeLine( &( usartList[5] ), line );
-  }
+  uint32_t halfBits;
 
-  else
+  // Start bit plus 8 or 9 data bits (parity included), in half bits to allow for 0.5 and 1.5 stop bits.
+  halfBits = ( USART_WordLength_9b == stInitStruct->USART_WordLength ) ? 20 : 18;
+
+  switch(stInitStruct->USART_StopBits)
   {
-    return 0;
+    case USART_StopBits_0_5:
+      halfBits += 1;
+      break;
+
+    case USART_StopBits_2:
+      halfBits += 4;
+      break;
+
+    case USART_StopBits_1_5:
+      halfBits += 3;
+      break;
+
+    default:
+      halfBits += 2;
+      break;
   }
+
+  return ( ( halfBits * 1000000u ) + ( 2 * stInitStruct->USART_BaudRate ) - 1 ) /
+         ( 2 * stInitStruct->USART_BaudRate );
 }
 
-static uint16_t usart6_rxBytesAvailable(void)
+// Run the pacing timer free at 1 MHz over its full 32-bit range.
+static void txPacingTimerStart(void)
 {
-  if(usartList[5].enabled)
+  TIM_TimeBaseInitTypeDef timInitStruct;
+  NVIC_InitTypeDef nvicInitStruct;
+  RCC_ClocksTypeDef clocks;
+  uint32_t timerClockHz;
+
+  if(txPacingTimerStarted)
   {
-    return rxBytesAvailable( &( usartList[5] ) );
+    return;
   }
 
-  else
+  RCC_APB1PeriphClockCmd(FS_STM32F4XXUSART_TX_PACING_TIM_RCC, ENABLE);
+
+  // APB1 timers are clocked at twice PCLK1 unless the APB1 prescaler is 1.
+  RCC_GetClocksFreq(&clocks);
+  timerClockHz = clocks.PCLK1_Frequency;
+
+  if(clocks.PCLK1_Frequency != clocks.HCLK_Frequency)
   {
-    return 0;
+    timerClockHz *= 2;
   }
-}
 
+  TIM_TimeBaseStructInit(&timInitStruct);
+  timInitStruct.TIM_Prescaler = (uint16_t)( ( timerClockHz / 1000000u ) - 1 );
+  timInitStruct.TIM_Period = 0xFFFFFFFF;
+  timInitStruct.TIM_CounterMode = TIM_CounterMode_Up;
+  TIM_TimeBaseInit(FS_STM32F4XXUSART_TX_PACING_TIM, &timInitStruct);
+  TIM_Cmd(FS_STM32F4XXUSART_TX_PACING_TIM, ENABLE);
 
-static uint16_t usart6_readBytes(char * buf, uint16_t numBytes)
+  nvicInitStruct.NVIC_IRQChannel = FS_STM32F4XXUSART_TX_PACING_TIM_IRQN;
+  nvicInitStruct.NVIC_IRQChannelPreemptionPriority = 8;
+  nvicInitStruct.NVIC_IRQChannelSubPriority = 1;
+  nvicInitStruct.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&nvicInitStruct);
+
+  txPacingTimerStarted = true;
+}
+
+/*
+Whether a paced U(S)ART's gap has passed. If not, arrange to be woken when it
+does. The elapsed time is compared rather than the deadline so that a U(S)ART
+left idle for longer than the timer's wrap isn't held up for a whole lap.
+*/
+RAMFUNC static _Bool txPacingReady(USART * usart)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[5].enabled)
+  if( ( FS_STM32F4XXUSART_TX_PACING_TIM->CNT - usart->txLastUs ) >= usart->txDelayUs )
   {
-    return readBytes( &( usartList[5] ), buf, numBytes );
+    return true;
   }
 
-  else
-  {
-    return 0;
-  }
+  return !txPacingArm(usart->txLastUs + usart->txDelayUs);
 }
 
-static uint16_t usart6_readLine(char * buf)
+/*
+Set the pacing timer to wake the service function at the deadline, unless an
+earlier wake-up is already set. Returns false if the deadline has already
+passed, in which case there may be no wake-up.
+*/
+RAMFUNC static _Bool txPacingArm(uint32_t deadline)
 {
-  // Redirect to implementation function if peripheral enabled.
-  if(usartList[5].enabled)
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+  TIM_TypeDef * timer;
+  _Bool armed;
+
+  timer = FS_STM32F4XXUSART_TX_PACING_TIM;
+  armed = true;
+
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+
+  if( !txPacingArmed || ( (int32_t)( deadline - txPacingDeadline ) < 0 ) )
   {
-    return readLine( &( usartList[5] ), buf );
+    txPacingDeadline = deadline;
+    txPacingArmed = true;
+
+    timer->SR = (uint16_t)~TIM_SR_CC1IF;
+    timer->CCR1 = deadline;
+    timer->DIER |= TIM_DIER_CC1IE;
   }
 
-  else
+  // The compare only matches on equality, so one set too late would not fire until the timer wraps.
+  if( (int32_t)( timer->CNT - deadline ) >= 0 )
   {
-    return 0;
+    armed = false;
   }
+
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+
+  return armed;
 }
+#endif
 
-static uint16_t usart6_readLineTruncate(char * buf, uint16_t maxLen)
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_BROADCAST)
+/*
+Next byte to transmit: from the tx buffer until the first queued shared
+block's gap has been sent, then from the block itself.
+*/
+RAMFUNC static _Bool txPop(USART * usart, char * data)
 {
-  if(usartList[5].enabled)
-  {
-    return readLineTruncate( &( usartList[5] ), buf, maxLen );
-  }
+  FS_STM32F4xxUSART_SharedBlock_t * finished;
+  USARTTxShared * entry;
+  _Bool success;
 
-  else
+  if( !FS_STM32F4xxOSAL_LockTake( &( usart->txBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
-    return 0;
+    return false;
   }
-}
 
-// Implementation of FS_DT_USARTDriver_t.
-static uint16_t writeBytes(USART * usart, const char * bytes, uint16_t numBytes)
-{
-  uint16_t spaceAfterTail, overflowBytes;
+  finished = NULL;
+  entry = &( usart->txShared[usart->txSharedHead] );
 
-  // Check that the number of bytes to write won't overwhelm the buffer.
-  if(numBytes > usart->txBuffer.length)
+  /*
+  If the tx buffer has overflowed, bytes counted in the gap may have been
+  overwritten. Don't hold the block back waiting for them.
+  */
+  if( usart->txSharedCount && entry->gap && ( 0 == usart->txBuffer.fillLevel ) )
   {
-    return 0;
+    usart->txSharedGapTotal -= entry->gap;
+    entry->gap = 0;
   }
 
-  // Get the buffer's mutex.
-  if( xSemaphoreTake( usart->txBuffer.mutex,
-                      FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  if( usart->txSharedCount && ( 0 == entry->gap ) )
   {
-    // Calculate how much space exists between the tail pointer and the end of the buffer.
-    spaceAfterTail = usart->txBuffer.base + usart->txBuffer.length - usart->txBuffer.tail;
+    *data = entry->block->data[usart->txSharedOffset++];
 
-    /*
-    If the bytes to write fit between the current tail and the end of the buffer,
-    we can simply block copy them.
-    */
-    if(spaceAfterTail >= numBytes)
+    if(entry->block->length == usart->txSharedOffset)
     {
-      memcpy( &( masterBuffer[usart->txBuffer.tail] ), bytes, numBytes);
+      finished = entry->block;
+      usart->txSharedOffset = 0;
+      usart->txSharedHead = ( usart->txSharedHead + 1 ) % FS_STM32F4XXUSART_TX_BROADCAST_DEPTH;
+      usart->txSharedCount--;
+    }
 
-      /*
-      If the number of bytes copied was an exact fit for the remaining space,
-      simply wrap the tail pointer.
-      */
-      if(numBytes == spaceAfterTail)
-      {
-        usart->txBuffer.tail = usart->txBuffer.base;
-      }
+    success = true;
+  }
 
-      // Otherwise, move the tail up appropriately.
-      else
-      {
-        usart->txBuffer.tail += numBytes;
-      }
-    }
+  else
+  {
+    success = bufferTake( &( usart->txBuffer ), data );
 
-    // If a wrap is required, split the bytes appropriately into two groups.
-    else
+    if( success && usart->txSharedCount )
     {
-      overflowBytes = numBytes - spaceAfterTail;
-
-      // Insert the first block at the end of the buffer.
-      memcpy( &( masterBuffer[usart->txBuffer.tail] ), bytes, spaceAfterTail);
+      entry->gap--;
+      usart->txSharedGapTotal--;
+    }
+  }
 
-      // Insert the remaining bytes at the beginning of the buffer.
-      memcpy( &( masterBuffer[usart->txBuffer.base] ), &( bytes[spaceAfterTail] ), overflowBytes);
+  FS_STM32F4xxOSAL_LockGive( &( usart->txBuffer.mutex ) );
 
-      usart->txBuffer.tail = usart->txBuffer.base + overflowBytes;
-    }
+  if(NULL != finished)
+  {
+    sharedBlockRelease(finished);
+  }
 
-    // Deal with the monitoring variables:
+  return success;
+}
 
-    // If the write hasn't caused any data loss...
-    if( ( usart->txBuffer.fillLevel + numBytes ) <= usart->txBuffer.length )
-    {
-      usart->txBuffer.fillLevel += numBytes;
-    }
+/*
+Queue a shared block behind everything already written to a U(S)ART. Returns
+false if the U(S)ART's queue is full or its tx buffer is busy.
+*/
+static _Bool txSharedQueue(USART * usart, FS_STM32F4xxUSART_SharedBlock_t * block)
+{
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+  USARTTxShared * entry;
 
-    // If data loss occurred, by definition the buffer is now full.
-    else
-    {
-      usart->txBuffer.fillLevel = usart->txBuffer.length;
-    }
+  if( !FS_STM32F4xxOSAL_LockTake( &( usart->txBuffer.mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    return false;
+  }
 
-    if(usart->txBuffer.highWater < usart->txBuffer.fillLevel)
-    {
-      usart->txBuffer.highWater = usart->txBuffer.fillLevel;
-    }
+  if(FS_STM32F4XXUSART_TX_BROADCAST_DEPTH == usart->txSharedCount)
+  {
+    FS_STM32F4xxOSAL_LockGive( &( usart->txBuffer.mutex ) );
+    return false;
+  }
 
-    // Give the mutex back.
-    xSemaphoreGive(usart->txBuffer.mutex);
+  // Take the reference before the service task can see the entry.
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+  block->refCount++;
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
 
-    // Trigger an interrupt when the tx buffer is empty to cause the main task to unblock.
-    USART_ITConfig(usart->peripheral, USART_IT_TXE, ENABLE);
+  entry = &( usart->txShared[( usart->txSharedHead + usart->txSharedCount ) %
+                             FS_STM32F4XXUSART_TX_BROADCAST_DEPTH] );
+  entry->block = block;
 
-    return numBytes;
+  // Buffered bytes not already ahead of an earlier block go ahead of this one.
+  if(usart->txBuffer.fillLevel > usart->txSharedGapTotal)
+  {
+    entry->gap = usart->txBuffer.fillLevel - usart->txSharedGapTotal;
   }
 
-  // Mutex timed out.
   else
   {
-    return 0;
+    entry->gap = 0;
   }
+
+  usart->txSharedGapTotal += entry->gap;
+  usart->txSharedCount++;
+
+  FS_STM32F4xxOSAL_LockGive( &( usart->txBuffer.mutex ) );
+  return true;
 }
 
-static uint16_t writeLine(USART * usart, const char * line)
+// Drop a reference to a shared block, releasing it if it was the last.
+RAMFUNC static void sharedBlockRelease(FS_STM32F4xxUSART_SharedBlock_t * block)
 {
-  size_t length;
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+  uint8_t refCount;
 
-  /*
-  First, check that the string will not overwhelm the buffer. Note
-  that strlen does not account for the NULL terminator, however,
-  we will be replacing it with a \n anyway so the value of length
-  does not need to be modified.
-  */
-  length = strlen(line);
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+  refCount = --( block->refCount );
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
 
-  if(length > usart->txBuffer.length)
+  if( ( 0 == refCount ) && ( NULL != block->release ) )
   {
-    return 0;
+    block->release(block, block->ctx);
+  }
+}
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+/*
+Compare the rx rate over the last measurement window with the thresholds
+and switch mode if appropriate. The window is stretched to however long it
+has been since the last call, since a quiet U(S)ART may not be serviced at all.
+*/
+static void adaptRxMode(USART * usart)
+{
+  FS_STM32F4xxOSAL_Ticks_t now;
+  uint32_t elapsed;
+
+  now = FS_STM32F4xxOSAL_GetTicks();
+  elapsed = (uint32_t)( now - usart->rxWindowStartTicks );
+
+  if(elapsed < FS_STM32F4XXUSART_ADAPTIVE_RX_WINDOW_TICKS)
+  {
+    return;
   }
 
-  if( writeBytes(usart, line, length - 1) )
+  // Compare rates by cross-multiplying rather than dividing.
+  if( ( USART_RX_MODE_RXNE == usart->rxMode ) &&
+      ( ( usart->rxWindowBytes * FS_STM32F4XXUSART_ADAPTIVE_RX_WINDOW_TICKS ) >=
+        ( FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_ENTER_BYTES * elapsed ) ) )
   {
-    bufferPush( &( usart->txBuffer ), '\n');
-    return length;
+    enterRxDmaMode(usart);
   }
 
-  // writeBytes failed - indicate to the caller.
-  else
+  else if( ( USART_RX_MODE_DMA == usart->rxMode ) &&
+           ( ( usart->rxWindowBytes * FS_STM32F4XXUSART_ADAPTIVE_RX_WINDOW_TICKS ) <=
+             ( FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_EXIT_BYTES * elapsed ) ) )
   {
-    return 0;
+    exitRxDmaMode(usart);
   }
+
+  usart->rxWindowBytes = 0;
+  usart->rxWindowStartTicks = now;
 }
 
-static uint16_t rxBytesAvailable(USART * usart)
+/*
+Hand reception over to the DMA stream, which writes circularly straight into
+the rx buffer's region of the master buffer. A stream always starts at the
+beginning of its memory region so the buffer contents are first rotated to
+put the tail there.
+*/
+static void enterRxDmaMode(USART * usart)
 {
-  uint16_t retVal;
+  DMA_InitTypeDef dmaInitStruct;
+  USARTBuffer * buf;
 
-  retVal = 0;
+  buf = &( usart->rxBuffer );
 
-  if( xSemaphoreTake( usart->rxBuffer.mutex,
-                      FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  if( !FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
-    retVal = usart->rxBuffer.fillLevel;
-    xSemaphoreGive(usart->txBuffer.mutex);
+    // Try again at the end of the next window.
+    return;
   }
 
-  return retVal;
-}
-
-static uint16_t readBytes(USART * usart, char * buf, uint16_t numBytes)
-{
-  uint16_t bytesToRead, bytesBeforeBufferEnd, bufferAfterHead, secondBlockLength;
+  USART_ITConfig(usart->peripheral, USART_IT_RXNE, DISABLE);
 
-  if( xSemaphoreTake( usart->rxBuffer.mutex,
-                      FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  // Collect any byte that arrived since the last service.
+  if( SET == USART_GetFlagStatus(usart->peripheral, USART_FLAG_RXNE) )
   {
-    // If there at least the requested number of bytes are available, we will copy the requested number.
-    if(usart->rxBuffer.fillLevel >= numBytes)
+    masterBuffer[buf->tail] = (char)USART_ReceiveData(usart->peripheral);
+    buf->tail = ( ( buf->base + buf->length ) == ( buf->tail + 1 ) ) ? buf->base : buf->tail + 1;
+
+    if(buf->fillLevel < buf->length)
     {
-      bytesToRead = numBytes;
+      buf->fillLevel++;
     }
 
-    // Otherwise we'll copy whatever is available.
     else
     {
-      bytesToRead = usart->rxBuffer.fillLevel;
+      buf->head = buf->tail;
     }
+  }
 
-    /*
-    Determine if the bytes to copy are in one contiguous block or if we need to
-    copy one block from the end of the buffer and then another from the start.
-    */
-    bufferAfterHead = usart->rxBuffer.base + usart->rxBuffer.length - usart->rxBuffer.head;
-
-    if(bytesToRead <= bufferAfterHead)
-    {
-      memcpy(buf, &( masterBuffer[usart->rxBuffer.head] ), bytesToRead);
+  bufferRotateToBase(buf);
+
+  usart->rxDmaBoundaries = 0;
+  usart->rxDmaBoundaryExcess = 0;
+
+  DMA_DeInit(usart->rxDma.stream);
+  DMA_StructInit(&dmaInitStruct);
+  dmaInitStruct.DMA_Channel = usart->rxDma.channel;
+  dmaInitStruct.DMA_PeripheralBaseAddr = (uint32_t)&( usart->peripheral->DR );
+  dmaInitStruct.DMA_Memory0BaseAddr = (uint32_t)&( masterBuffer[buf->base] );
+  dmaInitStruct.DMA_DIR = DMA_DIR_PeripheralToMemory;
+  dmaInitStruct.DMA_BufferSize = buf->length;
+  dmaInitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  dmaInitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  dmaInitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  dmaInitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  dmaInitStruct.DMA_Mode = DMA_Mode_Circular;
+  dmaInitStruct.DMA_Priority = DMA_Priority_High;
+  dmaInitStruct.DMA_FIFOMode = DMA_FIFOMode_Disable;
+  DMA_Init(usart->rxDma.stream, &dmaInitStruct);
+
+  // Half and full transfer interrupts prompt a service twice per lap of the buffer and mark laps for rxDmaUpdate.
+  DMA_ITConfig(usart->rxDma.stream, DMA_IT_TC | DMA_IT_HT, ENABLE);
+  DMA_Cmd(usart->rxDma.stream, ENABLE);
+  USART_DMACmd(usart->peripheral, USART_DMAReq_Rx, ENABLE);
+
+  // The end of each burst is signalled by the line going idle.
+  USART_ITConfig(usart->peripheral, USART_IT_IDLE, ENABLE);
+
+  usart->rxMode = USART_RX_MODE_DMA;
+
+  FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
+}
 
-      // Wrap the head pointer if necessary.
-      if(bytesToRead == bufferAfterHead)
-      {
-        usart->rxBuffer.head = usart->rxBuffer.base;
-      }
+/*
+Stop the DMA stream and return to per-byte interrupts. If the stream doesn't
+stop, the U(S)ART is left in DMA mode, with its DMA request off, and the exit
+is tried again at the end of the next window.
+*/
+static void exitRxDmaMode(USART * usart)
+{
+  uint32_t polls;
 
-      else
-      {
-        usart->rxBuffer.head += bytesToRead;
-      }
-    }
+  USART_DMACmd(usart->peripheral, USART_DMAReq_Rx, DISABLE);
+  DMA_ITConfig(usart->rxDma.stream, DMA_IT_TC | DMA_IT_HT, DISABLE);
+  DMA_Cmd(usart->rxDma.stream, DISABLE);
 
-    else
+  /*
+  The stream finishes any transfer in progress before it actually stops. With
+  no more requests from the U(S)ART that takes a few bus cycles.
+  */
+  for(polls = 0; polls < FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_STOP_POLLS; polls++)
+  {
+    if( DISABLE == DMA_GetCmdStatus(usart->rxDma.stream) )
     {
-      bytesBeforeBufferEnd = usart->rxBuffer.base + usart->rxBuffer.length - usart->rxBuffer.head;
-      secondBlockLength = bytesToRead - bytesBeforeBufferEnd;
-
-      memcpy( buf, &( masterBuffer[usart->rxBuffer.head] ), bytesBeforeBufferEnd);
-      memcpy( &( buf[bytesBeforeBufferEnd] ),
-              &( masterBuffer[usart->rxBuffer.base] ),
-              secondBlockLength );
-
-      usart->rxBuffer.head = usart->rxBuffer.base + secondBlockLength;
+      break;
     }
+  }
 
-    usart->rxBuffer.fillLevel -= bytesToRead;
-
-    // Release the buffer's mutex.
-    xSemaphoreGive(usart->rxBuffer.mutex);
-
-    return bytesToRead;
+  if(FS_STM32F4XXUSART_ADAPTIVE_RX_DMA_STOP_POLLS == polls)
+  {
+    return;
   }
 
-  // Could not get the mutex - no bytes read.
-  else
+  // The partial line timeout still needs the idle interrupt.
+  if(0 == usart->partialLineTimeoutTicks)
   {
-    return 0;
+    USART_ITConfig(usart->peripheral, USART_IT_IDLE, DISABLE);
   }
+
+  /*
+  Account for anything that arrived since the last service. This must not be
+  skipped - per-byte reception carries on from the tail.
+  */
+  rxDmaUpdate(usart, FS_STM32F4XXOSAL_WAIT_FOREVER);
+
+  usart->rxMode = USART_RX_MODE_RXNE;
+  USART_ITConfig(usart->peripheral, USART_IT_RXNE, ENABLE);
 }
 
-static uint16_t readLine(USART * usart, char * buf)
+/*
+Bring the rx buffer's tail and fill level up to date with the DMA stream's
+position. Returns the number of new bytes, or 0 without the mutex.
+
+The stream's position alone can't tell a whole lap of new data from none, so
+the half and full transfer interrupts are counted as well. More of them than
+the position accounts for means the stream has lapped the tail since the last
+update: the buffer is full of new data and the oldest has been overwritten.
+*/
+static uint16_t rxDmaUpdate(USART * usart, FS_STM32F4xxOSAL_Ticks_t lockTimeout)
 {
-  uint16_t i, bufPtr, bytesToReadAfterHead;
-  _Bool foundLineEnding;
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+  USARTBuffer * buf;
+  uint16_t dmaTail, received, half, tailOffset, end, start;
+  int8_t boundaries;
+  _Bool lapped;
 
+  buf = &( usart->rxBuffer );
 
-  if( xSemaphoreTake( usart->rxBuffer.mutex,
-                      FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  if( !FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), lockTimeout ) )
   {
-    // If there's no data in the buffer, we don't need to go any further.
-    if(usart->rxBuffer.fillLevel)
-    {
-      foundLineEnding = false;
-      bufPtr = usart->rxBuffer.head;
+    // The bytes will be picked up next time.
+    return 0;
+  }
 
-      // Loop over the received bytes to locate a line ending.
-      for(i = 0; i < usart->rxBuffer.fillLevel; i++)
-      {
-        if( '\n' == masterBuffer[bufPtr] )
-        {
-          foundLineEnding = true;
-          break;
-        }
+  // Boundaries first, so that any crossing they include is in the position read next.
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+  boundaries = (int8_t)usart->rxDmaBoundaries;
+  usart->rxDmaBoundaries = 0;
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
 
-        // Wrap the pointer if necessary.
-        if( bufPtr == ( usart->rxBuffer.base + usart->rxBuffer.length ) )
-        {
-          bufPtr = usart->rxBuffer.base;
-        }
+  // The counter runs down from the buffer length, reloading as it reaches zero.
+  dmaTail = buf->base + buf->length - DMA_GetCurrDataCounter(usart->rxDma.stream);
 
-        else
-        {
-          bufPtr++;
-        }
-      }
+  if( dmaTail == ( buf->base + buf->length ) )
+  {
+    dmaTail = buf->base;
+  }
 
-      // If a line was found, copy it into the callers buffer.
-      if(foundLineEnding)
-      {
-        /*
-        We only care about the cases where the line ending was *not* the first byte in the
-        buffer (as that would imply a line length of 0).
-        */
-        if(bufPtr > usart->rxBuffer.head)
-        {
-          /*
-          The line is entirely contained above the head pointer in memory -
-          a single block copy is required.
-          */
-          memcpy( buf, &( masterBuffer[usart->rxBuffer.head] ), i - 1 );
-        }
+  received = ( dmaTail + buf->length - buf->tail ) % buf->length;
 
-        /*
-        In this case, the string is split between the end and the beginning of the buffer
-        so 2 separate block copies are required.
-        */
-        else if(bufPtr < usart->rxBuffer.head)
-        {
-          bytesToReadAfterHead = usart->rxBuffer.base + usart->rxBuffer.length - usart->rxBuffer.head;
-          memcpy( buf, &( masterBuffer[usart->rxBuffer.head] ), bytesToReadAfterHead );
-          memcpy( &( buf[bytesToReadAfterHead] ),
-                  &( masterBuffer[usart->rxBuffer.base] ),
-                  ( i - 1 ) - bytesToReadAfterHead );
-        }
+  // Boundaries (half way and the end) passed in moving received bytes on from the tail.
+  half = buf->length / 2;
+  tailOffset = buf->tail - buf->base;
+  end = tailOffset + received;
 
-        // Append a NULL terminator so that the target buffer contains a string.
-        buf[i - 1] = 0;
-        xSemaphoreGive(usart->rxBuffer.mutex);
-        return i - 1;
-      }
+  if( ( tailOffset < half ) && ( end >= half ) )
+  {
+    boundaries--;
+  }
 
-      // No line found - no bytes read.
-      else
-      {
-        xSemaphoreGive(usart->rxBuffer.mutex);
-        return 0;
-      }
-    }
+  if(end >= buf->length)
+  {
+    boundaries--;
 
-    // No data available.
-    else
+    if( ( end - buf->length ) >= half )
     {
-      return 0;
+      boundaries--;
     }
   }
 
-  // Could not take the semaphore - no bytes read.
-  else
+  /*
+  An interrupt still pending for a boundary already passed leaves the excess
+  one short until it runs, so only a full lap's worth counts.
+  */
+  usart->rxDmaBoundaryExcess += boundaries;
+  lapped = ( usart->rxDmaBoundaryExcess >= 2 );
+
+  if(lapped)
   {
-    return 0;
+    usart->rxDmaBoundaryExcess %= 2;
   }
-}
-
-static uint16_t readLineTruncate(USART * usart, char * buf, uint16_t maxLen)
-{
-  // Only return anything if there's a line in the buffer. Read back a maximum
-  // of maxLen bytes and purge any excess bytes from the buffer.
 
-  uint16_t i, bufPtr, bytesToReadAfterHead;
-  _Bool foundLineEnding;
+  if( ( 0 == received ) && !lapped )
+  {
+    FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
+    return 0;
+  }
 
+  // After a lap, the whole buffer from the stream's position on is new.
+  start = lapped ? dmaTail : buf->tail;
 
-  if( xSemaphoreTake( usart->rxBuffer.mutex,
-                      FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+#if defined(FS_STM32F4XXUSART_ENABLE_RX_CAPTURE)
+  // Record the new bytes in place, in two parts if the DMA stream has wrapped.
+  if(NULL != usart->rxCapture)
   {
-    // If there's no data in the buffer, we don't need to go any further.
-    if(usart->rxBuffer.fillLevel)
+    if(dmaTail > start)
     {
-      foundLineEnding = false;
-      bufPtr = usart->rxBuffer.head;
-
-      // Loop over the received bytes to locate a line ending.
-      for(i = 0; i < usart->rxBuffer.fillLevel; i++)
-      {
-        if( '\n' == masterBuffer[bufPtr] )
-        {
-          foundLineEnding = true;
-          break;
-        }
-
-        // Wrap the pointer if necessary.
-        if( bufPtr == ( usart->rxBuffer.base + usart->rxBuffer.length ) )
-        {
-          bufPtr = usart->rxBuffer.base;
-        }
+      FS_STM32F4xxUSARTCapture_Record( usart->rxCapture, &( masterBuffer[start] ), dmaTail - start );
+    }
 
-        else
-        {
-          bufPtr++;
-        }
-      }
+    else
+    {
+      FS_STM32F4xxUSARTCapture_Record( usart->rxCapture,
+                                       &( masterBuffer[start] ),
+                                       buf->base + buf->length - start );
 
-      // If a line was found, copy it into the callers buffer.
-      if(foundLineEnding)
+      if(dmaTail > buf->base)
       {
-        // If a line was found but it's longer than maxLen, we need to truncate it.
-        if( ( i > 0 ) && ( i - 1 ) > maxLen )
-        {
-          i = maxLen + 1;
-        }
-
-        /*
-        We only care about the cases where the line ending was *not* the first byte in the
-        buffer (as that would imply a line length of 0).
-        */
-        if(bufPtr > usart->rxBuffer.head)
-        {
-          /*
-          The line is entirely contained above the head pointer in memory -
-          a single block copy is required.
-          */
-          memcpy( buf, &( masterBuffer[usart->rxBuffer.head] ), i - 1 );
-        }
+        FS_STM32F4xxUSARTCapture_Record( usart->rxCapture,
+                                         &( masterBuffer[buf->base] ),
+                                         dmaTail - buf->base );
+      }
+    }
+  }
+#endif
 
-        /*
-        In this case, the string is split between the end and the beginning of the buffer
-        so 2 separate block copies are required.
-        */
-        else if(bufPtr < usart->rxBuffer.head)
-        {
-          bytesToReadAfterHead = usart->rxBuffer.base + usart->rxBuffer.length - usart->rxBuffer.head;
-          memcpy( buf, &( masterBuffer[usart->rxBuffer.head] ), bytesToReadAfterHead );
-          memcpy( &( buf[bytesToReadAfterHead] ),
-                  &( masterBuffer[usart->rxBuffer.base] ),
-                  ( i - 1 ) - bytesToReadAfterHead );
-        }
+  buf->tail = dmaTail;
 
-        // Append a NULL terminator so that the target buffer contains a string.
-        buf[i - 1] = 0;
-        xSemaphoreGive(usart->rxBuffer.mutex);
-        return i - 1;
-      }
+  // The DMA stream doesn't stop for a full buffer - the oldest data has been overwritten.
+  if( !lapped && ( ( buf->fillLevel + received ) <= buf->length ) )
+  {
+    buf->fillLevel += received;
+  }
 
-      // No line found - no bytes read.
-      else
-      {
-        xSemaphoreGive(usart->rxBuffer.mutex);
-        return 0;
-      }
+  else
+  {
+    // Only a lap exactly filling an empty buffer loses nothing.
+    if( !lapped || received || buf->fillLevel )
+    {
+      latchError(usart, FS_STM32F4XXUSART_ERROR_RX_BUFFER_OVERFLOW);
     }
 
-    // No data available.
-    else
+    if(lapped)
     {
-      return 0;
+      received = buf->length;
     }
+
+    buf->fillLevel = buf->length;
+    buf->head = buf->tail;
   }
 
-  // Could not take the semaphore - no bytes read.
-  else
+  if(buf->fillLevel > buf->highWater)
   {
-    return 0;
+    buf->highWater = buf->fillLevel;
   }
+
+  FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
+  return received;
 }
 
-static void mainLoop(void * params)
+/*
+Rotate a buffer's contents in place so that its tail is at its base, keeping
+the data in order. The caller must hold the buffer's mutex.
+*/
+static void bufferRotateToBase(USARTBuffer * buf)
 {
-  uint8_t i;
-  uint16_t j;
-  USART * usart;
-  char data;
+  uint16_t shift;
+
+  shift = buf->tail - buf->base;
+
+  if(0 == shift)
+  {
+    return;
+  }
+
+  // Rotate left by 'shift' using three reversals.
+  reverseBytes( &( masterBuffer[buf->base] ), shift );
+  reverseBytes( &( masterBuffer[buf->tail] ), buf->length - shift );
+  reverseBytes( &( masterBuffer[buf->base] ), buf->length );
+
+  buf->head = buf->base + ( ( buf->head - buf->base + buf->length - shift ) % buf->length );
+  buf->tail = buf->base;
+}
+
+static void reverseBytes(char * bytes, uint16_t numBytes)
+{
+  uint16_t i;
+  char temp;
 
-  while(true)
+  for(i = 0; i < ( numBytes / 2 ); i++)
   {
-    // If the semaphore can't be taken, there's no work to do and the task will block.
-    if( pdTRUE == xSemaphoreTake( irqSyncSemaphore, 0 ) )
-    {
-      for(i = 0; i < 6; i++)
-      {
-        usart = &(usartList[i]);
-
-        if(usart->enabled)
-        {
-          if( SET == USART_GetFlagStatus(usart->peripheral, USART_FLAG_TXE) )
-          {
-            if( bufferPop( &( usart->txBuffer ), &data ) )
-            {
-              USART_SendData( usart->peripheral, ( (uint16_t)data & 0x00FF ) );
-              USART_ITConfig(usart->peripheral, USART_IT_TXE, ENABLE);
-            }
-          }
-
-          else
-          {
-            // If no data to send, prevent any further tx interrupts.
-            USART_ITConfig(usart->peripheral, USART_IT_TXE, DISABLE);
-          }
-
-          // Check if a byte has been received.
-          if( SET == USART_GetFlagStatus(usart->peripheral, USART_FLAG_RXNE) )
-          {
-            data = (char)USART_ReceiveData(usart->peripheral);
-            bufferPush( &( usart->rxBuffer), data );
-
-            // Re-enable rx interrupts.
-            USART_ITConfig(usart->peripheral, USART_IT_RXNE, ENABLE);
-          }
-        }
-      }
-    }
+    temp = bytes[i];
+    bytes[i] = bytes[numBytes - 1 - i];
+    bytes[numBytes - 1 - i] = temp;
   }
 }
+#endif
 
 // Buffer functions.
 static void bufferInit(USARTBuffer * buf)
@@ -1511,7 +4135,7 @@ static void bufferInit(USARTBuffer * buf)
   masterBufferAllocatedBytes += buf->length;
 
   // Set up a mutex for the buffer.
-  buf->mutex = xSemaphoreCreateMutex();
+  FS_STM32F4xxOSAL_LockCreate( &( buf->mutex ) );
 }
 
 static char bufferPeek(USARTBuffer * buf, uint16_t depth)
@@ -1519,12 +4143,12 @@ static char bufferPeek(USARTBuffer * buf, uint16_t depth)
   uint16_t bytesAfterHeadBeforeEnd;
   char retVal;
 
-  if( xSemaphoreTake(buf->mutex,  FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS) )
+  if( FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
     // Specified index is outside the fill level.
     if(buf->fillLevel > depth)
     {
-      xSemaphoreGive(buf->mutex);
+      FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
 
       // Signal an error with a byte value outside the ASCII range.
       return 0xFF;
@@ -1544,7 +4168,7 @@ static char bufferPeek(USARTBuffer * buf, uint16_t depth)
       retVal = masterBuffer[buf->base + depth - bytesAfterHeadBeforeEnd];
     }
 
-    xSemaphoreGive(buf->mutex);
+    FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
     return retVal;
   }
 
@@ -1556,10 +4180,10 @@ static char bufferPeek(USARTBuffer * buf, uint16_t depth)
   }
 }
 
-static void bufferPush(USARTBuffer * buf, char data)
+RAMFUNC static void bufferPush(USARTBuffer * buf, char data)
 {
   // Wait until the buffer is available.
-  if( xSemaphoreTake(buf->mutex,  FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS) )
+  if( FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
     masterBuffer[buf->tail] = data;
 
@@ -1589,7 +4213,7 @@ static void bufferPush(USARTBuffer * buf, char data)
       buf->highWater= buf->fillLevel;
     }
 
-    xSemaphoreGive(buf->mutex);
+    FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
   }
 
   else
@@ -1599,20 +4223,334 @@ static void bufferPush(USARTBuffer * buf, char data)
   }
 }
 
-static _Bool bufferPop(USARTBuffer *  buf, char * data)
+/*
+Block copy bytes into a buffer at its tail, wrapping as necessary. Unlike
+bufferPush, this does not take the buffer's mutex - the caller must hold it.
+*/
+static void bufferWriteBlock(USARTBuffer * buf, const char * bytes, uint16_t numBytes)
+{
+  uint16_t spaceAfterTail, overflowBytes;
+
+  // Calculate how much space exists between the tail pointer and the end of the buffer.
+  spaceAfterTail = buf->base + buf->length - buf->tail;
+
+  /*
+  If the bytes to write fit between the current tail and the end of the buffer,
+  we can simply block copy them.
+  */
+  if(spaceAfterTail >= numBytes)
+  {
+    copyBytes( &( masterBuffer[buf->tail] ), bytes, numBytes);
+
+    /*
+    If the number of bytes copied was an exact fit for the remaining space,
+    simply wrap the tail pointer.
+    */
+    if(numBytes == spaceAfterTail)
+    {
+      buf->tail = buf->base;
+    }
+
+    // Otherwise, move the tail up appropriately.
+    else
+    {
+      buf->tail += numBytes;
+    }
+  }
+
+  // If a wrap is required, split the bytes appropriately into two groups.
+  else
+  {
+    overflowBytes = numBytes - spaceAfterTail;
+
+    // Insert the first block at the end of the buffer.
+    copyBytes( &( masterBuffer[buf->tail] ), bytes, spaceAfterTail);
+
+    // Insert the remaining bytes at the beginning of the buffer.
+    copyBytes( &( masterBuffer[buf->base] ), &( bytes[spaceAfterTail] ), overflowBytes);
+
+    buf->tail = buf->base + overflowBytes;
+  }
+
+  // Deal with the monitoring variables:
+
+  // If the write hasn't caused any data loss...
+  if( ( buf->fillLevel + numBytes ) <= buf->length )
+  {
+    buf->fillLevel += numBytes;
+  }
+
+  // If data loss occurred, by definition the buffer is now full.
+  else
+  {
+    buf->fillLevel = buf->length;
+  }
+
+  if(buf->highWater < buf->fillLevel)
+  {
+    buf->highWater = buf->fillLevel;
+  }
+}
+
+/*
+Copy for ring transfers, in place of memcpy - newlib-nano's, which most STM32
+projects link, moves a byte at a time. Aligns the destination to a word
+boundary, then moves 16-byte LDM/STM bursts while the source is aligned too,
+or single words (unaligned loads are fine on the Cortex-M4) while it isn't.
+*/
+static void copyBytes(char * dest, const char * src, uint16_t numBytes)
+{
+  uint32_t word;
+
+  // Bytes up to the destination's next word boundary.
+  while( numBytes && ( (uintptr_t)dest & 3 ) )
+  {
+    *dest++ = *src++;
+    numBytes--;
+  }
+
+  if( 0 == ( (uintptr_t)src & 3 ) )
+  {
+    while(numBytes >= 16)
+    {
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+      __asm volatile( "ldmia %0!, {r3-r6}\n\t"
+                      "stmia %1!, {r3-r6}"
+                      : "+r" (src), "+r" (dest)
+                      :
+                      : "r3", "r4", "r5", "r6", "memory" );
+#else
+      ( (AliasedWord *)dest )[0] = ( (const AliasedWord *)src )[0];
+      ( (AliasedWord *)dest )[1] = ( (const AliasedWord *)src )[1];
+      ( (AliasedWord *)dest )[2] = ( (const AliasedWord *)src )[2];
+      ( (AliasedWord *)dest )[3] = ( (const AliasedWord *)src )[3];
+      dest += 16;
+      src += 16;
+#endif
+      numBytes -= 16;
+    }
+  }
+
+  // Whole words. A four byte memcpy compiles to a single, possibly unaligned, load.
+  while(numBytes >= 4)
+  {
+    memcpy(&word, src, 4);
+    *(AliasedWord *)dest = word;
+    dest += 4;
+    src += 4;
+    numBytes -= 4;
+  }
+
+  while(numBytes--)
+  {
+    *dest++ = *src++;
+  }
+}
+
+/*
+Find the first occurrence of a byte in a buffer's contents, searching each
+contiguous part with memchr rather than stepping a byte and checking for wrap
+at a time. Gives the byte's position counted from the head, or the fill level
+if it isn't present. The caller must hold the buffer's mutex.
+*/
+static _Bool bufferFindByte(USARTBuffer * buf, char byte, uint16_t * index)
+{
+  uint16_t bytesAfterHead, firstPartLength;
+  const char * found;
+
+  bytesAfterHead = buf->base + buf->length - buf->head;
+
+  if(buf->fillLevel < bytesAfterHead)
+  {
+    firstPartLength = buf->fillLevel;
+  }
+
+  else
+  {
+    firstPartLength = bytesAfterHead;
+  }
+
+  found = memchr( &( masterBuffer[buf->head] ), byte, firstPartLength );
+
+  if(NULL != found)
+  {
+    *index = (uint16_t)( found - &( masterBuffer[buf->head] ) );
+    return true;
+  }
+
+  found = memchr( &( masterBuffer[buf->base] ), byte, buf->fillLevel - firstPartLength );
+
+  if(NULL != found)
+  {
+    *index = firstPartLength + (uint16_t)( found - &( masterBuffer[buf->base] ) );
+    return true;
+  }
+
+  *index = buf->fillLevel;
+  return false;
+}
+
+// Copy bytes from the head of a buffer without removing them. The caller must hold the buffer's mutex.
+static void bufferCopyOut(USARTBuffer * buf, char * dest, uint16_t numBytes)
+{
+  uint16_t bytesAfterHead;
+
+  bytesAfterHead = buf->base + buf->length - buf->head;
+
+  if(numBytes <= bytesAfterHead)
+  {
+    copyBytes( dest, &( masterBuffer[buf->head] ), numBytes );
+  }
+
+  else
+  {
+    copyBytes( dest, &( masterBuffer[buf->head] ), bytesAfterHead );
+    copyBytes( &( dest[bytesAfterHead] ), &( masterBuffer[buf->base] ), numBytes - bytesAfterHead );
+  }
+}
+
+// Remove bytes (no more than the fill level) from the head of a buffer. The caller must hold the buffer's mutex.
+static void bufferDiscard(USARTBuffer * buf, uint16_t numBytes)
+{
+  uint16_t bytesAfterHead;
+
+  bytesAfterHead = buf->base + buf->length - buf->head;
+
+  // Move the head on, wrapping if necessary.
+  if(numBytes < bytesAfterHead)
+  {
+    buf->head += numBytes;
+  }
+
+  else
+  {
+    buf->head = buf->base + ( numBytes - bytesAfterHead );
+  }
+
+  buf->fillLevel -= numBytes;
+}
+
+RAMFUNC static _Bool bufferPop(USARTBuffer *  buf, char * data)
 {
    _Bool success;
 
   // Wait until the buffer is available.
-  if( xSemaphoreTake(buf->mutex,  FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS) )
+  if( FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    success = bufferTake(buf, data);
+
+    FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
+    return success;
+  }
+
+  else
+  {
+    return false;
+  }
+}
+
+// As bufferPop, but the caller must hold the buffer's mutex.
+RAMFUNC static _Bool bufferTake(USARTBuffer * buf, char * data)
+{
+  // Check whether there's any data...
+  if(buf->fillLevel)
+  {
+    *data = masterBuffer[buf->head];
+
+    // Wrap if necessary.
+    if( ( buf->base + buf->length ) == ( buf->head  + 1 ) )
+    {
+      buf->head = buf->base;
+    }
+
+    else
+    {
+      buf->head++;
+    }
+
+    buf->fillLevel--;
+
+    return true;
+  }
+
+  return false;
+}
+
+/*
+Set up a buffer of 16-bit elements for a 9-bit U(S)ART. buf->length must
+already hold the number of elements. The allocation is padded to an even
+offset so that the buffer can be addressed through masterWords.
+*/
+static void bufferInitWords(USARTBuffer * buf)
+{
+  masterBufferAllocatedBytes += ( masterBufferAllocatedBytes & 1 );
+
+  // Initialise the pointers, in elements from the start of the master buffer.
+  buf->base = masterBufferAllocatedBytes / 2;
+  buf->head = buf->base;
+  buf->tail = buf->base;
+
+  // Initialise the metric variables.
+  buf->fillLevel = 0;
+  buf->highWater = 0;
+
+  // Remove the allocated bytes from availability.
+  masterBufferAllocatedBytes += buf->length * 2;
+
+  // Set up a mutex for the buffer.
+  FS_STM32F4xxOSAL_LockCreate( &( buf->mutex ) );
+}
+
+// Returns false, dropping the word, if the buffer's mutex can't be taken.
+RAMFUNC static _Bool bufferPushWord(USARTBuffer * buf, uint16_t data)
+{
+  if( FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
+  {
+    masterWords[buf->tail] = data;
+
+    // Wrap if necessary.
+    if( ( buf->base + buf->length ) == ( buf->tail + 1 ) )
+    {
+      buf->tail = buf->base;
+    }
+
+    else
+    {
+      buf->tail++;
+    }
+
+    // As bufferPush - a full buffer loses data rather than growing.
+    if( !( buf->fillLevel == buf->length ) )
+    {
+      buf->fillLevel++;
+    }
+
+    if(buf->fillLevel > buf->highWater)
+    {
+      buf->highWater = buf->fillLevel;
+    }
+
+    FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
+    return true;
+  }
+
+  return false;
+}
+
+RAMFUNC static _Bool bufferPopWord(USARTBuffer * buf, uint16_t * data)
+{
+  _Bool success;
+
+  if( FS_STM32F4xxOSAL_LockTake( &( buf->mutex ), FS_STM32F4XXUSART_BUFFER_MUTEX_TIMEOUT_TICKS ) )
   {
-   // Check whether there's any data...
+    success = false;
+
     if(buf->fillLevel)
     {
-      *data = masterBuffer[buf->head];
+      *data = masterWords[buf->head];
 
       // Wrap if necessary.
-      if( ( buf->base + buf->length ) == ( buf->head  + 1 ) )
+      if( ( buf->base + buf->length ) == ( buf->head + 1 ) )
       {
         buf->head = buf->base;
       }
@@ -1623,16 +4561,10 @@ static _Bool bufferPop(USARTBuffer *  buf, char * data)
       }
 
       buf->fillLevel--;
-
       success = true;
     }
 
-    else
-    {
-      success = false;
-    }
-
-    xSemaphoreGive(buf->mutex);
+    FS_STM32F4xxOSAL_LockGive( &( buf->mutex ) );
     return success;
   }
 
@@ -1643,109 +4575,208 @@ static _Bool bufferPop(USARTBuffer *  buf, char * data)
 }
 
 // Interrupt handlers.
-void USART1_IRQHandler(void)
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+// Timing statistics.
+RAMFUNC static void cycleStatsAdd(FS_STM32F4xxUSART_CycleStats_t * stats, uint32_t cycles)
 {
-  static BaseType_t higherPriorityTaskWoken;
+  stats->count++;
+  stats->totalCycles += cycles;
+
+  if(cycles < stats->minCycles)
+  {
+    stats->minCycles = cycles;
+  }
+
+  if(cycles > stats->maxCycles)
+  {
+    stats->maxCycles = cycles;
+  }
+}
 
-  higherPriorityTaskWoken = pdFALSE;
-  xSemaphoreGiveFromISR(irqSyncSemaphore, &higherPriorityTaskWoken);
-  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+static void cycleStatsReset(FS_STM32F4xxUSART_CycleStats_t * stats)
+{
+  stats->count = 0;
+  stats->totalCycles = 0;
+  stats->minCycles = 0xFFFFFFFF;
+  stats->maxCycles = 0;
 }
+#endif
 
-void USART2_IRQHandler(void)
+/*
+The registers are accessed directly rather than through the ST library so
+that, with FS_STM32F4XXUSART_ENABLE_RAMFUNC, the whole handler runs from SRAM.
+Each test is the same as USART_GetITStatus makes: interrupt enabled and flag set.
+*/
+RAMFUNC static void usartIrqHandler(USART * usart)
 {
-  static BaseType_t higherPriorityTaskWoken;
+  USART_TypeDef * peripheral;
+  uint16_t sr, cr1;
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+  uint32_t startCycles;
+
+  startCycles = DWT->CYCCNT;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  activityStats.ports[usart - usartList].interrupts++;
+#endif
+
+  peripheral = usart->peripheral;
+  sr = peripheral->SR;
+  cr1 = peripheral->CR1;
+
+  // Latch any reception errors - the flags themselves clear when the data register is read.
+  usart->errors |= (uint8_t)( sr & ( USART_SR_PE | USART_SR_FE | USART_SR_NE | USART_SR_ORE ) );
 
   /*
   If a transmit empty condition caused the interrupt, prevent any further
   TXE interrupts until the main loop has put another data byte into
   the peripheral's data register.
   */
-  if( SET == USART_GetITStatus(USART2, USART_IT_TXE) )
+  if( ( cr1 & USART_CR1_TXEIE ) && ( sr & USART_SR_TXE ) )
   {
-    USART_ITConfig(USART2, USART_IT_TXE, DISABLE);
+    peripheral->CR1 &= (uint16_t)~USART_CR1_TXEIE;
   }
 
   /*
   If RXNE is set, disable RXNE interrupts to prevent the IRQ from
   being reinvoked by that flag until the main loop has serviced the U(S)ART.
   */
-  if( SET == USART_GetITStatus( USART2, USART_IT_RXNE ) )
-  {
-    USART_ITConfig(USART2, USART_IT_RXNE, DISABLE);
-  }
-
-  else
+  if( ( cr1 & USART_CR1_RXNEIE ) && ( sr & USART_SR_RXNE ) )
   {
-    // Clear spurious RXNE flag.
-    USART_ClearITPendingBit(USART2, USART_IT_RXNE);
+    peripheral->CR1 &= (uint16_t)~USART_CR1_RXNEIE;
   }
 
-  higherPriorityTaskWoken = pdFALSE;
-  xSemaphoreGiveFromISR(irqSyncSemaphore, &higherPriorityTaskWoken);
-  portYIELD_FROM_ISR(higherPriorityTaskWoken);
-}
-
-void USART3_IRQHandler(void)
-{
-  static BaseType_t higherPriorityTaskWoken;
-
   /*
-  If a transmit empty condition caused the interrupt, prevent any further
-  TXE interrupts until the main loop has put another data byte into
-  the peripheral's data register.
+  Clear spurious RXNE flag - but not while the receiver is served by DMA, since
+  RXNE is then the DMA request itself, nor while RXNE interrupts are disabled,
+  since a received byte is then waiting for the main loop. Either way clearing
+  it would lose a byte, and the latter becomes likely once TXE and IDLE
+  interrupts arrive between a reception and its service.
   */
-  if( SET == USART_GetITStatus(USART3, USART_IT_TXE) )
+  else if( ( cr1 & USART_CR1_RXNEIE ) && ( 0 == ( peripheral->CR3 & USART_CR3_DMAR ) ) )
   {
-    USART_ITConfig(USART3, USART_IT_TXE, DISABLE);
+    peripheral->SR = (uint16_t)~USART_SR_RXNE;
   }
 
   /*
-  If RXNE is set, disable RXNE interrupts to prevent the IRQ from
-  being reinvoked by that flag until the main loop has serviced the U(S)ART.
+  The line has gone idle after a burst, received by DMA or with the partial
+  line timeout in use. The flag is cleared by reading the status register
+  (done above) followed by the data register. The main loop wakes any task
+  waiting for a line to check for a partial one.
+
+  In per-byte mode the last byte of the burst may still be in the data
+  register awaiting the main loop, and reading it here would lose it. In that
+  case the idle interrupt is masked instead and the main loop's own read of
+  the byte clears the flag, after which it re-enables the interrupt.
   */
-  if( SET == USART_GetITStatus( USART3, USART_IT_RXNE ) )
+  if( ( cr1 & USART_CR1_IDLEIE ) && ( sr & USART_SR_IDLE ) )
   {
-    USART_ITConfig(USART3, USART_IT_RXNE, DISABLE);
-  }
+    if( ( 0 == ( sr & USART_SR_RXNE ) ) || ( peripheral->CR3 & USART_CR3_DMAR ) )
+    {
+      (void)peripheral->DR;
+    }
 
-  else
-  {
-    // Clear spurious RXNE flag.
-    USART_ClearITPendingBit(USART3, USART_IT_RXNE);
+    else
+    {
+      peripheral->CR1 &= (uint16_t)~USART_CR1_IDLEIE;
+    }
+
+    usart->rxIdle = true;
   }
 
-  higherPriorityTaskWoken = pdFALSE;
-  xSemaphoreGiveFromISR(irqSyncSemaphore, &higherPriorityTaskWoken);
-  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+  FS_STM32F4xxOSAL_SignalGiveFromISR(&irqSyncSignal);
+
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+  cycleStatsAdd( &( timingStats.irq ), DWT->CYCCNT - startCycles );
+#endif
+}
+
+RAMFUNC void USART1_IRQHandler(void)
+{
+  usartIrqHandler( &( usartList[0] ) );
+}
+
+RAMFUNC void USART2_IRQHandler(void)
+{
+  usartIrqHandler( &( usartList[1] ) );
+}
+
+RAMFUNC void USART3_IRQHandler(void)
+{
+  usartIrqHandler( &( usartList[2] ) );
+}
+
+RAMFUNC void UART4_IRQHandler(void)
+{
+  usartIrqHandler( &( usartList[3] ) );
 }
 
-void UART4_IRQHandler(void)
+RAMFUNC void UART5_IRQHandler(void)
 {
-  static BaseType_t higherPriorityTaskWoken;
+  usartIrqHandler( &( usartList[4] ) );
+}
 
-  higherPriorityTaskWoken = pdFALSE;
-  xSemaphoreGiveFromISR(irqSyncSemaphore, &higherPriorityTaskWoken);
-  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+RAMFUNC void USART6_IRQHandler(void)
+{
+  usartIrqHandler( &( usartList[5] ) );
 }
 
-void UART5_IRQHandler(void)
+#if defined(FS_STM32F4XXUSART_ENABLE_TX_PACING)
+// A paced U(S)ART's gap has passed - wake the main loop to send its next byte.
+void FS_STM32F4XXUSART_TX_PACING_TIM_IRQHANDLER(void)
 {
-  static BaseType_t higherPriorityTaskWoken;
+  TIM_TypeDef * timer;
+
+  timer = FS_STM32F4XXUSART_TX_PACING_TIM;
+
+  if( ( timer->DIER & TIM_DIER_CC1IE ) && ( timer->SR & TIM_SR_CC1IF ) )
+  {
+    timer->SR = (uint16_t)~TIM_SR_CC1IF;
+    timer->DIER &= (uint16_t)~TIM_DIER_CC1IE;
+    txPacingArmed = false;
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+    activityStats.timerInterrupts++;
+#endif
 
-  higherPriorityTaskWoken = pdFALSE;
-  xSemaphoreGiveFromISR(irqSyncSemaphore, &higherPriorityTaskWoken);
-  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+    FS_STM32F4xxOSAL_SignalGiveFromISR(&irqSyncSignal);
+  }
 }
+#endif
 
-void USART6_IRQHandler(void)
+#if defined(FS_STM32F4XXUSART_ENABLE_ADAPTIVE_RX)
+// Rx DMA half/full transfer, dispatched by FS_STM32F4xxDMA - wake the main loop to account for the new data.
+RAMFUNC static void rxDmaIrqHandler(void * ctx, uint32_t flags)
 {
-  static BaseType_t higherPriorityTaskWoken;
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+  uint32_t startCycles;
+
+  startCycles = DWT->CYCCNT;
+#endif
+
+#if defined(FS_STM32F4XXUSART_ENABLE_ACTIVITY_STATS)
+  activityStats.ports[(USART *)ctx - usartList].interrupts++;
+#endif
+
+  // Counted so that rxDmaUpdate can tell a whole lap of the buffer from nothing.
+  if(flags & FS_STM32F4XXDMA_FLAG_HALF_TRANSFER)
+  {
+    ( (USART *)ctx )->rxDmaBoundaries++;
+  }
+
+  if(flags & FS_STM32F4XXDMA_FLAG_COMPLETE)
+  {
+    ( (USART *)ctx )->rxDmaBoundaries++;
+  }
+
+  FS_STM32F4xxOSAL_SignalGiveFromISR(&irqSyncSignal);
 
-  higherPriorityTaskWoken = pdFALSE;
-  xSemaphoreGiveFromISR(irqSyncSemaphore, &higherPriorityTaskWoken);
-  portYIELD_FROM_ISR(higherPriorityTaskWoken);
+#if defined(FS_STM32F4XXUSART_ENABLE_TIMING_STATS)
+  cycleStatsAdd( &( timingStats.irq ), DWT->CYCCNT - startCycles );
+#endif
 }
+#endif
 
 /*------------------------------------------------------------------------------
 ----------------------- START PRIVATE FUNCTIONS --------------------------------
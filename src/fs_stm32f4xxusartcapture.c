@@ -0,0 +1,239 @@
+/**
+ *******************************************************************************
+ *
+ * @file
+ *
+ * @brief Recording and replay of timestamped U(S)ART rx traffic.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_STM32F4xxUSARTCapture.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <string.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static void putU16(uint8_t * dest, uint16_t value);
+static void putU32(uint8_t * dest, uint32_t value);
+static uint16_t getU16(const uint8_t * src);
+static uint32_t getU32(const uint8_t * src);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+_Bool FS_STM32F4xxUSARTCapture_Init(FS_STM32F4xxUSARTCapture_t * capture,
+                                    uint8_t * mem,
+                                    uint32_t size,
+                                    FS_STM32F4xxUSARTCapture_Clock_t clock,
+                                    uint32_t clockHz)
+{
+  if(size < FS_STM32F4XXUSARTCAPTURE_HEADER_BYTES)
+  {
+    return false;
+  }
+
+  memcpy(mem, "FSRX", 4);
+  mem[4] = FS_STM32F4XXUSARTCAPTURE_VERSION;
+  mem[5] = 0;
+  mem[6] = 0;
+  mem[7] = 0;
+  putU32( &( mem[8] ), clockHz );
+
+  capture->data = mem;
+  capture->size = size;
+  capture->length = FS_STM32F4XXUSARTCAPTURE_HEADER_BYTES;
+  capture->clock = clock;
+  capture->droppedBytes = 0;
+  capture->startTime = clock();
+
+  return true;
+}
+
+void FS_STM32F4xxUSARTCapture_Record(FS_STM32F4xxUSARTCapture_t * capture,
+                                     const char * bytes,
+                                     uint16_t numBytes)
+{
+  uint8_t * record;
+
+  // Stop for good at the first record that won't fit.
+  if( capture->droppedBytes ||
+      ( ( capture->size - capture->length ) <
+        ( FS_STM32F4XXUSARTCAPTURE_RECORD_HEADER_BYTES + (uint32_t)numBytes ) ) )
+  {
+    capture->droppedBytes += numBytes;
+    return;
+  }
+
+  record = &( capture->data[capture->length] );
+
+  putU32( record, capture->clock() - capture->startTime );
+  putU16( &( record[4] ), numBytes );
+  memcpy( &( record[FS_STM32F4XXUSARTCAPTURE_RECORD_HEADER_BYTES] ), bytes, numBytes );
+
+  capture->length += FS_STM32F4XXUSARTCAPTURE_RECORD_HEADER_BYTES + numBytes;
+}
+
+uint32_t FS_STM32F4xxUSARTCapture_Length(FS_STM32F4xxUSARTCapture_t * capture)
+{
+  return capture->length;
+}
+
+_Bool FS_STM32F4xxUSARTCapture_ReplayInit(FS_STM32F4xxUSARTCapture_Replay_t * replay,
+                                          FS_STM32F4xxUSART_Port_e port,
+                                          const uint8_t * data,
+                                          uint32_t length,
+                                          FS_STM32F4xxUSARTCapture_Clock_t clock,
+                                          uint32_t clockHz)
+{
+  if( ( length < FS_STM32F4XXUSARTCAPTURE_HEADER_BYTES ) ||
+      ( 0 != memcmp(data, "FSRX", 4) ) ||
+      ( FS_STM32F4XXUSARTCAPTURE_VERSION != data[4] ) ||
+      ( clockHz != getU32( &( data[8] ) ) ) )
+  {
+    return false;
+  }
+
+  replay->port = port;
+  replay->data = data;
+  replay->length = length;
+  replay->offset = FS_STM32F4XXUSARTCAPTURE_HEADER_BYTES;
+  replay->recordSent = 0;
+  replay->clock = clock;
+  replay->maxLateness = 0;
+  replay->startTime = clock();
+
+  return true;
+}
+
+_Bool FS_STM32F4xxUSARTCapture_ReplayPoll(FS_STM32F4xxUSARTCapture_Replay_t * replay)
+{
+  const uint8_t * record;
+  uint32_t now, due;
+  uint16_t numBytes, chunk, maxChunk;
+
+  // A port not in use, or taking only words, will never accept anything.
+  maxChunk = FS_STM32F4xxUSART_RxBufferLength(replay->port);
+
+  if(0 == maxChunk)
+  {
+    return false;
+  }
+
+  if(maxChunk > FS_STM32F4XXUSARTCAPTURE_REPLAY_CHUNK_BYTES)
+  {
+    maxChunk = FS_STM32F4XXUSARTCAPTURE_REPLAY_CHUNK_BYTES;
+  }
+
+  now = replay->clock() - replay->startTime;
+
+  while( ( replay->length - replay->offset ) >= FS_STM32F4XXUSARTCAPTURE_RECORD_HEADER_BYTES )
+  {
+    record = &( replay->data[replay->offset] );
+    due = getU32(record);
+    numBytes = getU16( &( record[4] ) );
+
+    // A truncated final record ends the replay.
+    if( ( replay->length - replay->offset - FS_STM32F4XXUSARTCAPTURE_RECORD_HEADER_BYTES ) < numBytes )
+    {
+      replay->offset = replay->length;
+      break;
+    }
+
+    // Not yet due. The subtraction keeps this correct across clock wrap.
+    if( (int32_t)( now - due ) < 0 )
+    {
+      return true;
+    }
+
+    /*
+    In pieces, so that a record longer than the rx buffer's free space - or the
+    whole buffer - still goes in. If the driver can't take the next piece right
+    now, try again next time.
+    */
+    while(replay->recordSent < numBytes)
+    {
+      chunk = numBytes - replay->recordSent;
+
+      if(chunk > maxChunk)
+      {
+        chunk = maxChunk;
+      }
+
+      if( chunk != FS_STM32F4xxUSART_RxInject( replay->port,
+                                               (const char *)&( record[FS_STM32F4XXUSARTCAPTURE_RECORD_HEADER_BYTES +
+                                                                      replay->recordSent] ),
+                                               chunk ) )
+      {
+        return true;
+      }
+
+      replay->recordSent += chunk;
+    }
+
+    if( ( now - due ) > replay->maxLateness )
+    {
+      replay->maxLateness = now - due;
+    }
+
+    replay->offset += FS_STM32F4XXUSARTCAPTURE_RECORD_HEADER_BYTES + numBytes;
+    replay->recordSent = 0;
+  }
+
+  return false;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+static void putU16(uint8_t * dest, uint16_t value)
+{
+  dest[0] = (uint8_t)value;
+  dest[1] = (uint8_t)( value >> 8 );
+}
+
+static void putU32(uint8_t * dest, uint32_t value)
+{
+  putU16( dest, (uint16_t)value );
+  putU16( &( dest[2] ), (uint16_t)( value >> 16 ) );
+}
+
+static uint16_t getU16(const uint8_t * src)
+{
+  return (uint16_t)( src[0] | ( (uint16_t)src[1] << 8 ) );
+}
+
+static uint32_t getU32(const uint8_t * src)
+{
+  return getU16(src) | ( (uint32_t)getU16( &( src[2] ) ) << 16 );
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
@@ -0,0 +1,262 @@
+/**
+ *******************************************************************************
+ *
+ * @file
+ *
+ * @brief Streaming LZSS compressor/decompressor for U(S)ART tx streams.
+ *
+ *        See the header for a description of the stream format.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_STM32F4xxUSARTCompress.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <string.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PRIVATE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+#define ITEMS_PER_GROUP FS_STM32F4XXUSARTCOMPRESS_ITEMS_PER_GROUP
+
+/*------------------------------------------------------------------------------
+-------------------------- END PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+void FS_STM32F4xxUSARTCompress_EncoderInit(FS_STM32F4xxUSARTCompress_Encoder_t * encoder,
+                                           char * window)
+{
+  encoder->window = window;
+  encoder->windowPos = 0;
+  encoder->group[0] = 0;
+  encoder->groupLength = 1;
+  encoder->items = 0;
+
+  // The decoder starts from a zeroed window too so early matches against it are valid.
+  memset(window, 0, FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES);
+}
+
+uint16_t FS_STM32F4xxUSARTCompress_Encode(FS_STM32F4xxUSARTCompress_Encoder_t * encoder,
+                                          const char * bytes,
+                                          uint16_t numBytes,
+                                          _Bool flush,
+                                          FS_STM32F4xxUSARTCompress_Sink_t sink,
+                                          void * sinkCtx)
+{
+  char * group;
+  char candidate;
+  uint8_t groupLength, items, bestDistance;
+  uint16_t i, k, distance, maxLength, bestLength, advance;
+
+  // Carry on with any group left open by the previous call.
+  group = encoder->group;
+  groupLength = encoder->groupLength;
+  items = encoder->items;
+  bestDistance = 0;
+  i = 0;
+
+  while(i < numBytes)
+  {
+    /*
+    Matches never extend beyond the end of this call's input. Holding bytes back
+    for a longer match would delay them on the wire indefinitely.
+    */
+    maxLength = numBytes - i;
+
+    if(maxLength > FS_STM32F4XXUSARTCOMPRESS_MAX_MATCH)
+    {
+      maxLength = FS_STM32F4XXUSARTCOMPRESS_MAX_MATCH;
+    }
+
+    bestLength = 0;
+
+    if(maxLength >= FS_STM32F4XXUSARTCOMPRESS_MIN_MATCH)
+    {
+      // Search the whole window for the longest match, nearest first.
+      for(distance = 1; distance < FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES; distance++)
+      {
+        // Cheap rejection on the first byte before comparing in full.
+        if( encoder->window[(uint8_t)( encoder->windowPos - distance )] != bytes[i] )
+        {
+          continue;
+        }
+
+        for(k = 1; k < maxLength; k++)
+        {
+          /*
+          A match may run on into the bytes it is itself encoding, which are not
+          in the window yet - take those from the input instead.
+          */
+          if(k < distance)
+          {
+            candidate = encoder->window[(uint8_t)( encoder->windowPos - distance + k )];
+          }
+
+          else
+          {
+            candidate = bytes[i + k - distance];
+          }
+
+          if(candidate != bytes[i + k])
+          {
+            break;
+          }
+        }
+
+        if(k > bestLength)
+        {
+          bestLength = k;
+          bestDistance = (uint8_t)distance;
+
+          // Can't do any better than this.
+          if(k == maxLength)
+          {
+            break;
+          }
+        }
+      }
+    }
+
+    if(bestLength >= FS_STM32F4XXUSARTCOMPRESS_MIN_MATCH)
+    {
+      group[0] |= (char)( 1 << items );
+      group[groupLength++] = (char)bestDistance;
+      group[groupLength++] = (char)( bestLength - FS_STM32F4XXUSARTCOMPRESS_MIN_MATCH );
+      advance = bestLength;
+    }
+
+    else
+    {
+      group[groupLength++] = bytes[i];
+      advance = 1;
+    }
+
+    // Move the consumed input into the history window.
+    for(k = 0; k < advance; k++)
+    {
+      encoder->window[encoder->windowPos++] = bytes[i++];
+    }
+
+    // Hand complete groups straight on.
+    if(ITEMS_PER_GROUP == ++items)
+    {
+      sink(sinkCtx, group, groupLength);
+      group[0] = 0;
+      groupLength = 1;
+      items = 0;
+    }
+  }
+
+  // Close off a part-filled group with a zero-distance back-reference.
+  if(flush && items)
+  {
+    group[0] |= (char)( 1 << items );
+    group[groupLength++] = 0;
+    group[groupLength++] = 0;
+    sink(sinkCtx, group, groupLength);
+    group[0] = 0;
+    groupLength = 1;
+    items = 0;
+  }
+
+  encoder->groupLength = groupLength;
+  encoder->items = items;
+
+  return numBytes;
+}
+
+void FS_STM32F4xxUSARTCompress_DecoderInit(FS_STM32F4xxUSARTCompress_Decoder_t * decoder,
+                                           char * window)
+{
+  decoder->window = window;
+  decoder->windowPos = 0;
+  decoder->flags = 0;
+  decoder->itemsRemaining = 0;
+  decoder->haveDistance = false;
+  decoder->distance = 0;
+
+  memset(window, 0, FS_STM32F4XXUSARTCOMPRESS_WINDOW_BYTES);
+}
+
+void FS_STM32F4xxUSARTCompress_Decode(FS_STM32F4xxUSARTCompress_Decoder_t * decoder,
+                                      const char * bytes,
+                                      uint32_t numBytes,
+                                      FS_STM32F4xxUSARTCompress_ByteSink_t sink,
+                                      void * sinkCtx)
+{
+  uint32_t i;
+  uint16_t k, length;
+  char data;
+
+  for(i = 0; i < numBytes; i++)
+  {
+    // Start of a new group.
+    if(0 == decoder->itemsRemaining)
+    {
+      decoder->flags = (uint8_t)bytes[i];
+      decoder->itemsRemaining = ITEMS_PER_GROUP;
+      continue;
+    }
+
+    if(decoder->flags & 0x01)
+    {
+      // Back-references are two bytes long - wait for the second.
+      if(!decoder->haveDistance)
+      {
+        decoder->distance = (uint8_t)bytes[i];
+        decoder->haveDistance = true;
+        continue;
+      }
+
+      decoder->haveDistance = false;
+
+      // Group terminator - the next byte is a new flag byte.
+      if(0 == decoder->distance)
+      {
+        decoder->itemsRemaining = 0;
+        continue;
+      }
+
+      length = (uint8_t)bytes[i] + FS_STM32F4XXUSARTCOMPRESS_MIN_MATCH;
+
+      // Copy byte by byte so that overlapping references repeat correctly.
+      for(k = 0; k < length; k++)
+      {
+        data = decoder->window[(uint8_t)( decoder->windowPos - decoder->distance )];
+        decoder->window[decoder->windowPos++] = data;
+        sink(sinkCtx, data);
+      }
+    }
+
+    else
+    {
+      decoder->window[decoder->windowPos++] = bytes[i];
+      sink(sinkCtx, bytes[i]);
+    }
+
+    decoder->flags >>= 1;
+    decoder->itemsRemaining--;
+  }
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
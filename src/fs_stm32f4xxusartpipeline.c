@@ -0,0 +1,198 @@
+/**
+ *******************************************************************************
+ *
+ * @file
+ *
+ * @brief Chains of incremental processing stages on U(S)ART rx data.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_STM32F4xxUSARTPipeline.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static void lineFramerAppend(FS_STM32F4xxUSARTPipeline_LineFramer_t * framer,
+                             const char * data,
+                             uint16_t length);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+_Bool FS_STM32F4xxUSARTPipeline_Init(FS_STM32F4xxUSARTPipeline_t * pipeline,
+                                     FS_STM32F4xxUSARTPipeline_Stage_t * stages,
+                                     uint8_t numStages,
+                                     FS_STM32F4xxUSARTPipeline_EventHandler_t eventHandler,
+                                     void * eventCtx)
+{
+  uint8_t i;
+
+  if(0 == numStages)
+  {
+    return false;
+  }
+
+  for(i = 0; i < numStages; i++)
+  {
+    if(NULL == stages[i].process)
+    {
+      return false;
+    }
+
+    stages[i].pipeline = pipeline;
+    stages[i].next = ( i < ( numStages - 1 ) ) ? &( stages[i + 1] ) : NULL;
+  }
+
+  pipeline->stages = stages;
+  pipeline->numStages = numStages;
+  pipeline->eventHandler = eventHandler;
+  pipeline->eventCtx = eventCtx;
+  pipeline->bytesIn = 0;
+
+  return true;
+}
+
+void FS_STM32F4xxUSARTPipeline_Feed(FS_STM32F4xxUSARTPipeline_t * pipeline,
+                                    const char * data,
+                                    uint16_t length)
+{
+  if(length)
+  {
+    pipeline->bytesIn += length;
+    pipeline->stages[0].process( &( pipeline->stages[0] ), data, length );
+  }
+}
+
+void FS_STM32F4xxUSARTPipeline_Emit(FS_STM32F4xxUSARTPipeline_Stage_t * stage,
+                                    const char * data,
+                                    uint16_t length)
+{
+  if( ( NULL != stage->next ) && length )
+  {
+    stage->next->process(stage->next, data, length);
+  }
+}
+
+void FS_STM32F4xxUSARTPipeline_Event(FS_STM32F4xxUSARTPipeline_Stage_t * stage,
+                                     uint16_t event,
+                                     const void * data,
+                                     uint16_t length)
+{
+  FS_STM32F4xxUSARTPipeline_t * pipeline;
+
+  pipeline = stage->pipeline;
+
+  if(NULL != pipeline->eventHandler)
+  {
+    pipeline->eventHandler(pipeline->eventCtx, stage, event, data, length);
+  }
+}
+
+void FS_STM32F4xxUSARTPipeline_LineFramer(FS_STM32F4xxUSARTPipeline_Stage_t * stage,
+                                          const char * data,
+                                          uint16_t length)
+{
+  FS_STM32F4xxUSARTPipeline_LineFramer_t * framer;
+  const char * end;
+  uint16_t lineBytes;
+
+  framer = (FS_STM32F4xxUSARTPipeline_LineFramer_t *)stage->ctx;
+
+  while(length)
+  {
+    end = (const char *)memchr(data, '\n', length);
+
+    // No line ending - hold on to the partial line until the next span.
+    if(NULL == end)
+    {
+      lineFramerAppend(framer, data, length);
+      return;
+    }
+
+    lineBytes = (uint16_t)( end - data );
+
+    // The whole line is in this span, so pass it on in place.
+    if( ( 0 == framer->length ) && ( 0 == framer->droppedBytes ) )
+    {
+      FS_STM32F4xxUSARTPipeline_Emit(stage, data, lineBytes);
+    }
+
+    else
+    {
+      lineFramerAppend(framer, data, lineBytes);
+
+      if(framer->droppedBytes)
+      {
+        FS_STM32F4xxUSARTPipeline_Event(stage,
+                                        FS_STM32F4XXUSARTPIPELINE_EVENT_LINE_TOO_LONG,
+                                        NULL,
+                                        framer->droppedBytes);
+      }
+
+      FS_STM32F4xxUSARTPipeline_Emit(stage, framer->buffer, framer->length);
+      framer->length = 0;
+      framer->droppedBytes = 0;
+    }
+
+    data = end + 1;
+    length -= lineBytes + 1;
+  }
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+// Add to the partial line, keeping as much as fits and counting the rest.
+static void lineFramerAppend(FS_STM32F4xxUSARTPipeline_LineFramer_t * framer,
+                             const char * data,
+                             uint16_t length)
+{
+  uint16_t space, dropped;
+
+  space = framer->size - framer->length;
+
+  if(length > space)
+  {
+    dropped = length - space;
+    length = space;
+
+    framer->droppedBytes = ( dropped > ( UINT16_MAX - framer->droppedBytes ) ) ?
+                           UINT16_MAX : framer->droppedBytes + dropped;
+  }
+
+  memcpy( &( framer->buffer[framer->length] ), data, length );
+  framer->length += length;
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
@@ -0,0 +1,282 @@
+/**
+ *******************************************************************************
+ *
+ * @file
+ *
+ * @brief Per-stream token bucket rate limiting for U(S)ART output.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_STM32F4xxUSARTRateLimit.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <string.h>
+
+// FS library includes.
+#include "FS_STM32F4xxOSAL.h"
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PRIVATE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Bucket credit is held in units of 1/FS_STM32F4XXOSAL_TICK_RATE_HZ of a message,
+so each elapsed tick adds exactly messagesPerSecond units and each message
+costs FS_STM32F4XXOSAL_TICK_RATE_HZ units.
+*/
+#define CREDIT_PER_MESSAGE ( (uint32_t)FS_STM32F4XXOSAL_TICK_RATE_HZ )
+
+// Room for a name, the count and the fixed text of a suppression summary.
+#define SUMMARY_MAX_NAME_LENGTH 24
+#define SUMMARY_BUFFER_LENGTH ( SUMMARY_MAX_NAME_LENGTH + 40 )
+
+/*------------------------------------------------------------------------------
+-------------------------- END PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static _Bool admit(FS_STM32F4xxUSARTRateLimit_Stream_t * stream, uint32_t * unreported);
+static void writeSummary(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                         FS_STM32F4xxUSARTRateLimit_Stream_t * stream,
+                         uint32_t count);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+void FS_STM32F4xxUSARTRateLimit_Init(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                                     FS_DT_IOStream_t * output,
+                                     FS_STM32F4xxUSARTRateLimit_Stream_t * streams,
+                                     uint8_t numStreams)
+{
+  uint8_t i;
+  FS_STM32F4xxOSAL_Ticks_t now;
+
+  limiter->output = output;
+  limiter->streams = streams;
+  limiter->numStreams = numStreams;
+
+  now = FS_STM32F4xxOSAL_GetTicks();
+
+  for(i = 0; i < numStreams; i++)
+  {
+    streams[i].credit = (uint32_t)streams[i].burst * CREDIT_PER_MESSAGE;
+    streams[i].lastRefillTicks = now;
+    streams[i].suppressed = 0;
+    streams[i].dropped = 0;
+  }
+}
+
+uint16_t FS_STM32F4xxUSARTRateLimit_WriteBytes(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                                               uint8_t streamId,
+                                               const char * bytes,
+                                               uint16_t numBytes)
+{
+  FS_STM32F4xxUSARTRateLimit_Stream_t * stream;
+  uint32_t unreported;
+
+  if(streamId >= limiter->numStreams)
+  {
+    return 0;
+  }
+
+  stream = &( limiter->streams[streamId] );
+
+  if( !admit(stream, &unreported) )
+  {
+    return 0;
+  }
+
+  // The summary rides on the admitted message's credit so it can't itself be dropped.
+  if(unreported)
+  {
+    writeSummary(limiter, stream, unreported);
+  }
+
+  return limiter->output->writeBytes(bytes, numBytes);
+}
+
+uint16_t FS_STM32F4xxUSARTRateLimit_WriteLine(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                                              uint8_t streamId,
+                                              const char * line)
+{
+  FS_STM32F4xxUSARTRateLimit_Stream_t * stream;
+  uint32_t unreported;
+
+  if(streamId >= limiter->numStreams)
+  {
+    return 0;
+  }
+
+  stream = &( limiter->streams[streamId] );
+
+  if( !admit(stream, &unreported) )
+  {
+    return 0;
+  }
+
+  if(unreported)
+  {
+    writeSummary(limiter, stream, unreported);
+  }
+
+  return limiter->output->writeLine(line);
+}
+
+uint32_t FS_STM32F4xxUSARTRateLimit_GetDropped(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                                               uint8_t streamId)
+{
+  if(streamId >= limiter->numStreams)
+  {
+    return 0;
+  }
+
+  return limiter->streams[streamId].dropped;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Refill a stream's bucket for the time elapsed since it was last used and take
+one message's worth of credit from it if possible. If the message is admitted,
+*unreported is set to the number of suppressed messages awaiting a summary.
+*/
+static _Bool admit(FS_STM32F4xxUSARTRateLimit_Stream_t * stream, uint32_t * unreported)
+{
+  FS_STM32F4xxOSAL_Ticks_t now;
+  uint32_t elapsed, fullCredit;
+  _Bool admitted;
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+
+  *unreported = 0;
+  fullCredit = (uint32_t)stream->burst * CREDIT_PER_MESSAGE;
+
+  // Several tasks may write to the same stream.
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+
+  now = FS_STM32F4xxOSAL_GetTicks();
+  elapsed = (uint32_t)( now - stream->lastRefillTicks );
+  stream->lastRefillTicks = now;
+
+  // Test against the time to fill an empty bucket first so the multiplication can't overflow.
+  if( ( stream->messagesPerSecond > 0 ) &&
+      ( elapsed >= ( fullCredit / stream->messagesPerSecond ) ) )
+  {
+    stream->credit = fullCredit;
+  }
+
+  else
+  {
+    stream->credit += elapsed * stream->messagesPerSecond;
+
+    if(stream->credit > fullCredit)
+    {
+      stream->credit = fullCredit;
+    }
+  }
+
+  if(stream->credit >= CREDIT_PER_MESSAGE)
+  {
+    stream->credit -= CREDIT_PER_MESSAGE;
+    *unreported = stream->suppressed;
+    stream->suppressed = 0;
+    admitted = true;
+  }
+
+  else
+  {
+    if(stream->summarise)
+    {
+      stream->suppressed++;
+    }
+
+    stream->dropped++;
+    admitted = false;
+  }
+
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+
+  return admitted;
+}
+
+// Write "<name>: N messages suppressed" as a line of its own.
+static void writeSummary(FS_STM32F4xxUSARTRateLimit_t * limiter,
+                         FS_STM32F4xxUSARTRateLimit_Stream_t * stream,
+                         uint32_t count)
+{
+  static const char text[] = " messages suppressed\n";
+  char summary[SUMMARY_BUFFER_LENGTH];
+  char digits[10];
+  uint16_t length;
+  uint8_t numDigits;
+  size_t nameLength;
+
+  length = 0;
+
+  if(NULL != stream->name)
+  {
+    nameLength = strlen(stream->name);
+
+    if(nameLength > SUMMARY_MAX_NAME_LENGTH)
+    {
+      nameLength = SUMMARY_MAX_NAME_LENGTH;
+    }
+
+    memcpy(summary, stream->name, nameLength);
+    length = nameLength;
+    summary[length++] = ':';
+    summary[length++] = ' ';
+  }
+
+  // Digits come out least significant first.
+  numDigits = 0;
+
+  do
+  {
+    digits[numDigits++] = '0' + ( count % 10 );
+    count /= 10;
+
+  }while(count);
+
+  while(numDigits)
+  {
+    summary[length++] = digits[--numDigits];
+  }
+
+  memcpy( &( summary[length] ), text, sizeof(text) - 1 );
+  length += sizeof(text) - 1;
+
+  limiter->output->writeBytes(summary, length);
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
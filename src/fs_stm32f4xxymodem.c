@@ -0,0 +1,730 @@
+/**
+ *******************************************************************************
+ *
+ * @file
+ *
+ * @brief YMODEM (batch) and XMODEM-1K receiver for firmware images.
+ *
+ *******************************************************************************
+ */
+
+/*------------------------------------------------------------------------------
+------------------------------ START INCLUDES ----------------------------------
+------------------------------------------------------------------------------*/
+
+// Own header.
+#include "FS_STM32F4xxYModem.h"
+
+// C standard library includes.
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/*------------------------------------------------------------------------------
+------------------------------- END INCLUDES -----------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------- START PRIVATE DEFINITIONS ----------------------------
+------------------------------------------------------------------------------*/
+
+// Protocol control characters.
+#define SOH 0x01
+#define STX 0x02
+#define EOT 0x04
+#define ACK 0x06
+#define NAK 0x15
+#define CAN 0x18
+#define CRC_REQUEST 'C'
+
+// Type, sequence number and its complement.
+#define HEADER_BYTES 3
+#define CRC_BYTES 2
+
+// Receiver states.
+#define STATE_START 0
+#define STATE_RECEIVE 1
+#define STATE_WAIT_SLOT 2
+#define STATE_DRAIN 3
+#define STATE_ABANDON 4
+#define STATE_DONE 5
+
+/*------------------------------------------------------------------------------
+-------------------------- END PRIVATE DEFINITIONS -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------- START PRIVATE FUNCTION PROTOTYPES --------------------------
+------------------------------------------------------------------------------*/
+
+static void receive(FS_STM32F4xxYModem_t * ym);
+static void checkTimeouts(FS_STM32F4xxYModem_t * ym);
+static void handleBlock(FS_STM32F4xxYModem_t * ym);
+static void handleHeaderBlock(FS_STM32F4xxYModem_t * ym, FS_STM32F4xxYModem_Block_t * slot);
+static void handleDataBlock(FS_STM32F4xxYModem_t * ym, FS_STM32F4xxYModem_Block_t * slot);
+static void handleEot(FS_STM32F4xxYModem_t * ym);
+static void finishFile(FS_STM32F4xxYModem_t * ym);
+static void commitBlock(FS_STM32F4xxYModem_t * ym);
+static _Bool countError(FS_STM32F4xxYModem_t * ym);
+static void purge(FS_STM32F4xxYModem_t * ym);
+static void abandon(FS_STM32F4xxYModem_t * ym, FS_STM32F4xxYModem_Status_e status);
+static FS_STM32F4xxYModem_Block_t * freeSlot(FS_STM32F4xxYModem_t * ym);
+static void sendByte(FS_STM32F4xxYModem_t * ym, uint8_t byte);
+static uint16_t crc16(const uint8_t * data, uint16_t length);
+
+/*------------------------------------------------------------------------------
+-------------------- END PRIVATE FUNCTION PROTOTYPES ---------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+-------------------- START PRIVATE GLOBAL VARIABLES ----------------------------
+------------------------------------------------------------------------------*/
+
+// CRC-16/XMODEM (polynomial 0x1021, initial value 0), a byte at a time.
+static const uint16_t crcTable[256] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+  0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+  0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+  0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+  0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+  0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+  0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+  0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+  0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+  0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+  0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+  0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+  0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+  0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+  0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+  0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+  0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+  0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+  0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+  0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+  0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+  0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+/*------------------------------------------------------------------------------
+--------------------- END PRIVATE GLOBAL VARIABLES -----------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+------------------------ START PUBLIC FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+_Bool FS_STM32F4xxYModem_Init(FS_STM32F4xxYModem_t * ym,
+                              FS_DT_IOStream_t * stream,
+                              const FS_STM32F4xxYModem_Sink_t * sink,
+                              FS_STM32F4xxYModem_Block_t * blocks,
+                              uint8_t depth)
+{
+  // The queue indices wrap modulo the depth.
+  if(0 == depth)
+  {
+    return false;
+  }
+
+  ym->stream = stream;
+  ym->sink = *sink;
+  ym->blocks = blocks;
+  ym->depth = depth;
+
+  ym->queueHead = 0;
+  ym->queueTail = 0;
+  ym->queueCount = 0;
+  ym->sinkFailed = false;
+
+  ym->state = STATE_START;
+  ym->status = FS_STM32F4xxYModem_Status_Busy;
+  ym->batch = false;
+  ym->inFile = false;
+  ym->eotReceived = false;
+  ym->started = false;
+  ym->expectedSeq = 0;
+  ym->errors = 0;
+  ym->cancels = 0;
+
+  ym->frameBytes = 0;
+  ym->dataLength = 0;
+
+  ym->fileSize = 0;
+  ym->fileOffset = 0;
+  ym->lastActivityTicks = FS_STM32F4xxOSAL_GetTicks();
+
+  return true;
+}
+
+FS_STM32F4xxYModem_Status_e FS_STM32F4xxYModem_Poll(FS_STM32F4xxYModem_t * ym)
+{
+  if( ym->sinkFailed && ( STATE_ABANDON != ym->state ) && ( STATE_DONE != ym->state ) )
+  {
+    abandon(ym, FS_STM32F4xxYModem_Status_Failed);
+  }
+
+  switch(ym->state)
+  {
+    case STATE_START:
+    case STATE_RECEIVE:
+      receive(ym);
+      checkTimeouts(ym);
+      break;
+
+    // The last block took the last free slot - acknowledge it once the sink frees one.
+    case STATE_WAIT_SLOT:
+      if(ym->queueCount < ym->depth)
+      {
+        sendByte(ym, ACK);
+        ym->state = STATE_RECEIVE;
+        ym->lastActivityTicks = FS_STM32F4xxOSAL_GetTicks();
+      }
+      break;
+
+    // End of file - only acknowledged once everything has been written.
+    case STATE_DRAIN:
+      if(0 == ym->queueCount)
+      {
+        finishFile(ym);
+      }
+      break;
+
+    // The sink may still be working on a block which is being discarded.
+    case STATE_ABANDON:
+      if(0 == ym->queueCount)
+      {
+        if(ym->inFile)
+        {
+          ym->inFile = false;
+          ym->sink.end(ym->sink.ctx, false);
+        }
+
+        ym->state = STATE_DONE;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  if(STATE_DONE == ym->state)
+  {
+    return ym->status;
+  }
+
+  return FS_STM32F4xxYModem_Status_Busy;
+}
+
+_Bool FS_STM32F4xxYModem_ServiceSink(FS_STM32F4xxYModem_t * ym)
+{
+  FS_STM32F4xxYModem_Block_t * block;
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+
+  if(0 == ym->queueCount)
+  {
+    return false;
+  }
+
+  block = &( ym->blocks[ym->queueHead] );
+
+  // Once the transfer has been abandoned, queued blocks are simply discarded.
+  if( ( STATE_ABANDON != ym->state ) && !ym->sinkFailed )
+  {
+    if( !ym->sink.write(ym->sink.ctx, block->offset, block->data, block->length) )
+    {
+      ym->sinkFailed = true;
+    }
+  }
+
+  ym->queueHead = ( ym->queueHead + 1 ) % ym->depth;
+
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+  ym->queueCount--;
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+
+  return true;
+}
+
+/*------------------------------------------------------------------------------
+------------------------- END PUBLIC FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/
+
+
+/*------------------------------------------------------------------------------
+----------------------- START PRIVATE FUNCTIONS --------------------------------
+------------------------------------------------------------------------------*/
+
+/*
+Read whatever has arrived. Block data is read straight into the next free
+queue slot, in as few reads as the stream allows.
+*/
+static void receive(FS_STM32F4xxYModem_t * ym)
+{
+  FS_STM32F4xxYModem_Block_t * slot;
+  uint8_t * dest;
+  uint16_t wanted, received;
+  uint8_t byte;
+
+  while( ( STATE_START == ym->state ) || ( STATE_RECEIVE == ym->state ) )
+  {
+    // Between blocks - look at a byte at a time.
+    if(0 == ym->frameBytes)
+    {
+      if( 0 == ym->stream->readBytes( (char *)&byte, 1 ) )
+      {
+        return;
+      }
+
+      ym->lastActivityTicks = FS_STM32F4xxOSAL_GetTicks();
+
+      if(CAN == byte)
+      {
+        // Two in a row cancel the transfer.
+        if( ++( ym->cancels ) >= 2 )
+        {
+          abandon(ym, FS_STM32F4xxYModem_Status_Cancelled);
+        }
+
+        continue;
+      }
+
+      ym->cancels = 0;
+
+      if(SOH == byte)
+      {
+        ym->dataLength = 128;
+      }
+
+      else if(STX == byte)
+      {
+        ym->dataLength = FS_STM32F4XXYMODEM_BLOCK_BYTES;
+      }
+
+      else if(EOT == byte)
+      {
+        handleEot(ym);
+        continue;
+      }
+
+      // Line noise.
+      else
+      {
+        continue;
+      }
+
+      ym->header[0] = byte;
+      ym->frameBytes = 1;
+      continue;
+    }
+
+    slot = freeSlot(ym);
+
+    if(ym->frameBytes < HEADER_BYTES)
+    {
+      dest = &( ym->header[ym->frameBytes] );
+      wanted = HEADER_BYTES - ym->frameBytes;
+    }
+
+    else if( ym->frameBytes < ( HEADER_BYTES + ym->dataLength ) )
+    {
+      dest = &( slot->data[ym->frameBytes - HEADER_BYTES] );
+      wanted = HEADER_BYTES + ym->dataLength - ym->frameBytes;
+    }
+
+    else
+    {
+      dest = &( ym->crc[ym->frameBytes - HEADER_BYTES - ym->dataLength] );
+      wanted = HEADER_BYTES + ym->dataLength + CRC_BYTES - ym->frameBytes;
+    }
+
+    received = ym->stream->readBytes( (char *)dest, wanted );
+
+    if(0 == received)
+    {
+      return;
+    }
+
+    ym->lastActivityTicks = FS_STM32F4xxOSAL_GetTicks();
+    ym->frameBytes += received;
+
+    if( ( HEADER_BYTES + ym->dataLength + CRC_BYTES ) == ym->frameBytes )
+    {
+      ym->frameBytes = 0;
+      handleBlock(ym);
+    }
+  }
+}
+
+static void checkTimeouts(FS_STM32F4xxYModem_t * ym)
+{
+  FS_STM32F4xxOSAL_Ticks_t now;
+  uint32_t elapsed;
+
+  if( ( STATE_START != ym->state ) && ( STATE_RECEIVE != ym->state ) )
+  {
+    return;
+  }
+
+  now = FS_STM32F4xxOSAL_GetTicks();
+  elapsed = (uint32_t)( now - ym->lastActivityTicks );
+
+  // A block stalled part way through.
+  if(ym->frameBytes)
+  {
+    if(elapsed >= FS_STM32F4XXYMODEM_BYTE_TIMEOUT_TICKS)
+    {
+      ym->frameBytes = 0;
+      ym->lastActivityTicks = now;
+
+      if( countError(ym) )
+      {
+        sendByte(ym, NAK);
+      }
+    }
+  }
+
+  // Invite the sender to start, repeatedly until it does.
+  else if(STATE_START == ym->state)
+  {
+    if( !ym->started || ( elapsed >= FS_STM32F4XXYMODEM_START_INTERVAL_TICKS ) )
+    {
+      if( !ym->started || countError(ym) )
+      {
+        sendByte(ym, CRC_REQUEST);
+        ym->started = true;
+        ym->lastActivityTicks = now;
+      }
+    }
+  }
+
+  else if(elapsed >= FS_STM32F4XXYMODEM_BLOCK_TIMEOUT_TICKS)
+  {
+    ym->lastActivityTicks = now;
+
+    if( countError(ym) )
+    {
+      sendByte(ym, NAK);
+    }
+  }
+}
+
+static void handleBlock(FS_STM32F4xxYModem_t * ym)
+{
+  FS_STM32F4xxYModem_Block_t * slot;
+  uint8_t seq;
+
+  slot = freeSlot(ym);
+  seq = ym->header[1];
+
+  if( ( 0xFF != (uint8_t)( ym->header[1] ^ ym->header[2] ) ) ||
+      ( crc16(slot->data, ym->dataLength) != ( ( (uint16_t)ym->crc[0] << 8 ) | ym->crc[1] ) ) )
+  {
+    // Discard whatever else of the damaged block has arrived before asking for it again.
+    purge(ym);
+
+    if( countError(ym) )
+    {
+      sendByte(ym, NAK);
+    }
+
+    return;
+  }
+
+  if(STATE_START == ym->state)
+  {
+    if(0 == seq)
+    {
+      handleHeaderBlock(ym, slot);
+    }
+
+    // No header block - XMODEM. Only possible at the start of a session.
+    else if( ( 1 == seq ) && !ym->batch )
+    {
+      if( !ym->sink.begin(ym->sink.ctx, NULL, 0) )
+      {
+        abandon(ym, FS_STM32F4xxYModem_Status_Failed);
+        return;
+      }
+
+      ym->inFile = true;
+      ym->fileSize = 0;
+      ym->fileOffset = 0;
+      ym->expectedSeq = 1;
+      ym->eotReceived = false;
+      ym->state = STATE_RECEIVE;
+
+      handleDataBlock(ym, slot);
+    }
+
+    else if( countError(ym) )
+    {
+      sendByte(ym, NAK);
+    }
+
+    return;
+  }
+
+  if(seq == ym->expectedSeq)
+  {
+    handleDataBlock(ym, slot);
+  }
+
+  // Our acknowledgement was lost and the sender has repeated the previous block.
+  else if( seq == (uint8_t)( ym->expectedSeq - 1 ) )
+  {
+    sendByte(ym, ACK);
+
+    // For a repeated header block, repeat the request for data too.
+    if( ym->batch && ( 0 == seq ) && ( 0 == ym->fileOffset ) )
+    {
+      sendByte(ym, CRC_REQUEST);
+    }
+  }
+
+  // Blocks have been lost - unrecoverable.
+  else
+  {
+    abandon(ym, FS_STM32F4xxYModem_Status_Failed);
+  }
+}
+
+/*
+Block 0: the file name, NUL terminated, followed by the size in decimal and
+optionally other fields. An empty name ends the batch.
+*/
+static void handleHeaderBlock(FS_STM32F4xxYModem_t * ym, FS_STM32F4xxYModem_Block_t * slot)
+{
+  const char * name;
+  const uint8_t * field;
+  uint16_t nameLength;
+  uint32_t size;
+
+  ym->batch = true;
+
+  // The block is NUL padded anyway - make certain the name is terminated.
+  slot->data[ym->dataLength - 1] = 0;
+  name = (const char *)slot->data;
+
+  if(0 == name[0])
+  {
+    sendByte(ym, ACK);
+    ym->status = FS_STM32F4xxYModem_Status_Complete;
+    ym->state = STATE_DONE;
+    return;
+  }
+
+  nameLength = (uint16_t)strlen(name);
+  size = 0;
+
+  if( ( nameLength + 1 ) < ym->dataLength )
+  {
+    for(field = &( slot->data[nameLength + 1] ); ( *field >= '0' ) && ( *field <= '9' ); field++)
+    {
+      size = ( size * 10 ) + ( *field - '0' );
+    }
+  }
+
+  if( !ym->sink.begin(ym->sink.ctx, name, size) )
+  {
+    abandon(ym, FS_STM32F4xxYModem_Status_Failed);
+    return;
+  }
+
+  ym->inFile = true;
+  ym->fileSize = size;
+  ym->fileOffset = 0;
+  ym->expectedSeq = 1;
+  ym->eotReceived = false;
+  ym->errors = 0;
+  ym->state = STATE_RECEIVE;
+
+  sendByte(ym, ACK);
+  sendByte(ym, CRC_REQUEST);
+}
+
+static void handleDataBlock(FS_STM32F4xxYModem_t * ym, FS_STM32F4xxYModem_Block_t * slot)
+{
+  uint16_t length;
+
+  length = ym->dataLength;
+
+  // Trim the sender's padding from the last block where the file size is known.
+  if(ym->fileSize)
+  {
+    if(ym->fileOffset >= ym->fileSize)
+    {
+      length = 0;
+    }
+
+    else if( ( ym->fileSize - ym->fileOffset ) < length )
+    {
+      length = (uint16_t)( ym->fileSize - ym->fileOffset );
+    }
+  }
+
+  if(length)
+  {
+    slot->offset = ym->fileOffset;
+    slot->length = length;
+    commitBlock(ym);
+  }
+
+  ym->fileOffset += ym->dataLength;
+  ym->expectedSeq++;
+  ym->errors = 0;
+
+  if(ym->queueCount < ym->depth)
+  {
+    sendByte(ym, ACK);
+  }
+
+  else
+  {
+    ym->state = STATE_WAIT_SLOT;
+  }
+}
+
+static void handleEot(FS_STM32F4xxYModem_t * ym)
+{
+  // Between files - the sender has repeated an EOT whose acknowledgement was lost.
+  if(STATE_START == ym->state)
+  {
+    if(ym->batch)
+    {
+      sendByte(ym, ACK);
+      sendByte(ym, CRC_REQUEST);
+    }
+
+    return;
+  }
+
+  // NAK the first EOT to make sure it wasn't line noise.
+  if(!ym->eotReceived)
+  {
+    ym->eotReceived = true;
+    sendByte(ym, NAK);
+    return;
+  }
+
+  ym->state = STATE_DRAIN;
+}
+
+// Called once the sink has written everything in the file.
+static void finishFile(FS_STM32F4xxYModem_t * ym)
+{
+  ym->inFile = false;
+
+  if( !ym->sink.end(ym->sink.ctx, true) )
+  {
+    abandon(ym, FS_STM32F4xxYModem_Status_Failed);
+    return;
+  }
+
+  sendByte(ym, ACK);
+
+  // YMODEM - ask for the next file's header block.
+  if(ym->batch)
+  {
+    sendByte(ym, CRC_REQUEST);
+    ym->state = STATE_START;
+    ym->started = true;
+    ym->expectedSeq = 0;
+    ym->errors = 0;
+    ym->lastActivityTicks = FS_STM32F4xxOSAL_GetTicks();
+  }
+
+  else
+  {
+    ym->status = FS_STM32F4xxYModem_Status_Complete;
+    ym->state = STATE_DONE;
+  }
+}
+
+static void commitBlock(FS_STM32F4xxYModem_t * ym)
+{
+  FS_STM32F4xxOSAL_CriticalState_t criticalState;
+
+  ym->queueTail = ( ym->queueTail + 1 ) % ym->depth;
+
+  criticalState = FS_STM32F4xxOSAL_EnterCritical();
+  ym->queueCount++;
+  FS_STM32F4xxOSAL_ExitCritical(criticalState);
+}
+
+// Returns false, having abandoned the transfer, once there have been too many errors.
+static _Bool countError(FS_STM32F4xxYModem_t * ym)
+{
+  if( ++( ym->errors ) >= FS_STM32F4XXYMODEM_MAX_ERRORS )
+  {
+    abandon(ym, FS_STM32F4xxYModem_Status_Failed);
+    return false;
+  }
+
+  return true;
+}
+
+static void purge(FS_STM32F4xxYModem_t * ym)
+{
+  char discard[16];
+
+  while( ym->stream->readBytes( discard, sizeof(discard) ) );
+}
+
+/*
+Stop, telling the sender unless it was the one to cancel. The sink is told
+once any block it is working on is finished with (see Poll).
+*/
+static void abandon(FS_STM32F4xxYModem_t * ym, FS_STM32F4xxYModem_Status_e status)
+{
+  if(FS_STM32F4xxYModem_Status_Cancelled != status)
+  {
+    sendByte(ym, CAN);
+    sendByte(ym, CAN);
+  }
+
+  ym->status = status;
+  ym->state = STATE_ABANDON;
+}
+
+// The sender only transmits a block once the previous one has been acknowledged, so there is always one free.
+static FS_STM32F4xxYModem_Block_t * freeSlot(FS_STM32F4xxYModem_t * ym)
+{
+  return &( ym->blocks[ym->queueTail] );
+}
+
+static void sendByte(FS_STM32F4xxYModem_t * ym, uint8_t byte)
+{
+  ym->stream->writeBytes( (const char *)&byte, 1 );
+}
+
+static uint16_t crc16(const uint8_t * data, uint16_t length)
+{
+  uint16_t crc;
+
+  crc = 0;
+
+  while(length--)
+  {
+    crc = (uint16_t)( crc << 8 ) ^ crcTable[( crc >> 8 ) ^ *data++];
+  }
+
+  return crc;
+}
+
+/*------------------------------------------------------------------------------
+------------------------ END PRIVATE FUNCTIONS ---------------------------------
+------------------------------------------------------------------------------*/